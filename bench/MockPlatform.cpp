@@ -0,0 +1,594 @@
+#include "MockPlatform.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// One SIP message; views point into the receive buffer
+struct SipMessage {
+    bool response = false;
+    int status = 0;
+    std::string_view method; // Of the request, or the CSeq method of a response
+    std::string_view uri;
+    std::vector<std::pair<std::string_view, std::string_view>> headers;
+    std::string_view body;
+
+    // First header called name (or its compact form), empty if none
+    std::string_view header(std::string_view name) const;
+};
+
+namespace {
+const size_t RTP_BATCH = 32;
+const size_t RTP_MAX_PACKET = 2048;
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] - 'A' + 'a' : a[i];
+        char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] - 'A' + 'a' : b[i];
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// RFC 3261 section 7.3.3
+std::string_view compactForm(std::string_view name) {
+    static const std::pair<const char*, const char*> forms[] = {
+        {"Via", "v"}, {"From", "f"}, {"To", "t"}, {"Call-ID", "i"},
+        {"Contact", "m"}, {"Content-Length", "l"}, {"Content-Type", "c"}, {"Subject", "s"},
+    };
+    for (const auto& form : forms) {
+        if (equalsIgnoreCase(name, form.first)) {
+            return form.second;
+        }
+    }
+    return std::string_view();
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+bool parseSip(std::string_view data, SipMessage& out) {
+    out = SipMessage();
+    size_t headEnd = data.find("\r\n\r\n");
+    if (headEnd == std::string_view::npos) {
+        return false;
+    }
+    std::string_view head = data.substr(0, headEnd);
+    out.body = data.substr(headEnd + 4);
+
+    size_t lineEnd = head.find("\r\n");
+    std::string_view startLine = head.substr(0, lineEnd);
+    head.remove_prefix(lineEnd == std::string_view::npos ? head.size() : lineEnd + 2);
+    if (startLine.compare(0, 8, "SIP/2.0 ") == 0) {
+        out.response = true;
+        out.status = atoi(std::string(startLine.substr(8, 3)).c_str());
+    } else {
+        size_t space = startLine.find(' ');
+        if (space == std::string_view::npos) {
+            return false;
+        }
+        out.method = startLine.substr(0, space);
+        std::string_view rest = startLine.substr(space + 1);
+        out.uri = rest.substr(0, rest.find(' '));
+    }
+
+    while (!head.empty()) {
+        lineEnd = head.find("\r\n");
+        std::string_view line = head.substr(0, lineEnd);
+        head.remove_prefix(lineEnd == std::string_view::npos ? head.size() : lineEnd + 2);
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos) {
+            out.headers.emplace_back(trim(line.substr(0, colon)), trim(line.substr(colon + 1)));
+        }
+    }
+
+    if (out.response) {
+        std::string_view cseq = out.header("CSeq");
+        size_t space = cseq.find(' ');
+        out.method = space == std::string_view::npos ? std::string_view() : trim(cseq.substr(space + 1));
+    }
+    std::string_view length = out.header("Content-Length");
+    if (!length.empty()) {
+        size_t bodyLength = static_cast<size_t>(atol(std::string(length).c_str()));
+        out.body = out.body.substr(0, bodyLength);
+    }
+    return true;
+}
+
+// sip:<user>@... in a From or To header
+std::string userOf(std::string_view header) {
+    size_t begin = header.find("sip:");
+    if (begin == std::string_view::npos) {
+        return std::string();
+    }
+    begin += 4;
+    size_t end = header.find_first_of("@>;", begin);
+    return std::string(header.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin));
+}
+
+size_t countOccurrences(std::string_view text, std::string_view pattern) {
+    size_t count = 0;
+    for (size_t at = text.find(pattern); at != std::string_view::npos; at = text.find(pattern, at + pattern.size())) {
+        ++count;
+    }
+    return count;
+}
+
+// PTZCmd for instruction code with speeds, checksum included
+std::string ptzCmd(uint8_t code, uint8_t panSpeed, uint8_t tiltSpeed, uint8_t zoomSpeed) {
+    uint8_t bytes[8] = {0xA5, 0x0F, 0x01, code, panSpeed, tiltSpeed, static_cast<uint8_t>(zoomSpeed << 4), 0};
+    unsigned sum = 0;
+    for (size_t i = 0; i < 7; ++i) {
+        sum += bytes[i];
+    }
+    bytes[7] = static_cast<uint8_t>(sum);
+    char hex[17];
+    for (size_t i = 0; i < 8; ++i) {
+        snprintf(hex + i * 2, 3, "%02X", bytes[i]);
+    }
+    return std::string(hex, 16);
+}
+
+int openUdp(int port, int receiveBuffer) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (receiveBuffer > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "MockPlatform: cannot bind port " << port << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+}
+
+std::string_view SipMessage::header(std::string_view name) const {
+    std::string_view compact = compactForm(name);
+    for (const auto& [key, value] : headers) {
+        if (equalsIgnoreCase(key, name) || (!compact.empty() && equalsIgnoreCase(key, compact))) {
+            return value;
+        }
+    }
+    return std::string_view();
+}
+
+MockPlatform::MockPlatform(const Options& options)
+    : options_(options), sipSocket_(-1), rtpSocket_(-1), rng_(std::random_device{}()), nextId_(0), nextSn_(0),
+      sessions_(0), buffer_(RTP_BATCH * RTP_MAX_PACKET) {
+    tag_ = newId("");
+}
+
+MockPlatform::~MockPlatform() {
+    if (sipSocket_ >= 0) {
+        close(sipSocket_);
+    }
+    if (rtpSocket_ >= 0) {
+        close(rtpSocket_);
+    }
+}
+
+bool MockPlatform::open() {
+    sipSocket_ = openUdp(options_.sipPort, 4 << 20);
+    rtpSocket_ = openUdp(options_.rtpPort, 16 << 20);
+    return sipSocket_ >= 0 && rtpSocket_ >= 0;
+}
+
+bool MockPlatform::waitForRegistrations(size_t deviceCount, Clock::duration timeout) {
+    Clock::time_point deadline = Clock::now() + timeout;
+    while (results_.registrations < deviceCount) {
+        Clock::time_point now = Clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        pump(std::min(deadline, now + std::chrono::milliseconds(100)));
+    }
+    return true;
+}
+
+void MockPlatform::runCalls(const std::vector<std::string>& channelIds, Clock::duration duration) {
+    using Seconds = std::chrono::duration<double>;
+    const Clock::time_point never = Clock::time_point::max();
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + duration;
+    auto inviteInterval = std::chrono::duration_cast<Clock::duration>(Seconds(1.0 / std::max(options_.inviteRate, 1e-9)));
+    auto ptzInterval = std::chrono::duration_cast<Clock::duration>(Seconds(1.0 / std::max(options_.ptzRate, 1e-9)));
+    Clock::time_point nextInvite = options_.inviteRate > 0 && !channelIds.empty() ? start : never;
+    Clock::time_point nextPtz = options_.ptzRate > 0 && !channelIds.empty() ? start : never;
+    size_t inviteCursor = 0;
+    size_t ptzCursor = 0;
+
+    while (true) {
+        Clock::time_point now = Clock::now();
+        if (now >= end) {
+            break;
+        }
+        while (now >= nextInvite) {
+            if (options_.maxSessions == 0 || calls_.size() < options_.maxSessions) {
+                sendInvite(channelIds[inviteCursor++ % channelIds.size()]);
+            }
+            nextInvite += inviteInterval;
+        }
+        while (now >= nextPtz) {
+            sendPtz(channelIds[ptzCursor++ % channelIds.size()]);
+            nextPtz += ptzInterval;
+        }
+        while (!hangups_.empty() && hangups_.front().first <= now) {
+            sendBye(hangups_.front().second);
+            hangups_.pop_front();
+        }
+        Clock::time_point wake = std::min({end, nextInvite, nextPtz, hangups_.empty() ? never : hangups_.front().first});
+        pump(wake);
+    }
+
+    // Hang up what is still up and give the BYEs a moment to be answered
+    for (auto& [callId, call] : calls_) {
+        if (call.up) {
+            sendBye(callId);
+        }
+    }
+    hangups_.clear();
+    Clock::time_point deadline = Clock::now() + std::chrono::seconds(2);
+    while (Clock::now() < deadline) {
+        bool closing = std::any_of(calls_.begin(), calls_.end(), [](const auto& entry) {
+            return entry.second.established != Clock::time_point();
+        });
+        if (!closing) {
+            break;
+        }
+        pump(std::min(deadline, Clock::now() + std::chrono::milliseconds(50)));
+    }
+}
+
+void MockPlatform::pump(Clock::time_point deadline) {
+    pollfd fds[2] = {{sipSocket_, POLLIN, 0}, {rtpSocket_, POLLIN, 0}};
+    while (true) {
+        Clock::time_point now = Clock::now();
+        int timeoutMs = 0;
+        if (deadline > now) {
+            timeoutMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()) + 1;
+        }
+        int ready = poll(fds, 2, timeoutMs);
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "MockPlatform: poll failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (ready > 0) {
+            if (fds[0].revents & POLLIN) {
+                receiveSip();
+            }
+            if (fds[1].revents & POLLIN) {
+                receiveRtp();
+            }
+        }
+        if (Clock::now() >= deadline) {
+            return;
+        }
+    }
+}
+
+void MockPlatform::receiveSip() {
+    while (true) {
+        sockaddr_in from{};
+        socklen_t fromLength = sizeof(from);
+        ssize_t length = recvfrom(sipSocket_, buffer_.data(), buffer_.size(), 0, reinterpret_cast<sockaddr*>(&from),
+                                  &fromLength);
+        if (length <= 0) {
+            return;
+        }
+        SipMessage message;
+        if (!parseSip(std::string_view(reinterpret_cast<const char*>(buffer_.data()), static_cast<size_t>(length)),
+                      message)) {
+            continue;
+        }
+        if (message.response) {
+            handleResponse(message);
+        } else {
+            handleRequest(message, from);
+        }
+    }
+}
+
+void MockPlatform::receiveRtp() {
+    mmsghdr messages[RTP_BATCH];
+    iovec iov[RTP_BATCH];
+    while (true) {
+        for (size_t i = 0; i < RTP_BATCH; ++i) {
+            iov[i].iov_base = buffer_.data() + i * RTP_MAX_PACKET;
+            iov[i].iov_len = RTP_MAX_PACKET;
+            messages[i] = mmsghdr{};
+            messages[i].msg_hdr.msg_iov = &iov[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        int count = recvmmsg(rtpSocket_, messages, RTP_BATCH, MSG_DONTWAIT, nullptr);
+        if (count <= 0) {
+            return;
+        }
+        results_.rtpPackets += static_cast<uint64_t>(count);
+        for (int i = 0; i < count; ++i) {
+            results_.rtpBytes += messages[i].msg_len;
+        }
+    }
+}
+
+void MockPlatform::handleRequest(const SipMessage& request, const sockaddr_in& from) {
+    Clock::time_point now = Clock::now();
+    if (request.method == "REGISTER") {
+        if (results_.firstRegister == Clock::time_point()) {
+            results_.firstRegister = now;
+        }
+        // Every new registration is challenged once; the digest itself is not checked
+        if (request.header("Authorization").empty()) {
+            ++results_.challenges;
+            respond(request, from, 401, "Unauthorized",
+                    "WWW-Authenticate: Digest realm=\"" + options_.realm + "\", nonce=\"" + newId("") + "\", algorithm=MD5\r\n");
+            return;
+        }
+        std::string expires(request.header("Expires"));
+        if (expires.empty()) {
+            expires = "3600";
+        }
+        std::string extra = "Expires: " + expires + "\r\n";
+        std::string_view contact = request.header("Contact");
+        if (!contact.empty()) {
+            extra += "Contact: " + std::string(contact) + "\r\n";
+        }
+        respond(request, from, 200, "OK", extra);
+
+        std::string deviceId = userOf(request.header("From"));
+        Device& device = devices_[deviceId];
+        device.address = from;
+        if (expires == "0") {
+            device.registered = false;
+            return;
+        }
+        if (!device.registered) {
+            device.registered = true;
+            ++results_.registrations;
+            results_.lastRegistered = now;
+            std::string body = "<?xml version=\"1.0\"?>\r\n<Query>\r\n<CmdType>Catalog</CmdType>\r\n<SN>" +
+                               std::to_string(++nextSn_) + "</SN>\r\n<DeviceID>" + deviceId + "</DeviceID>\r\n</Query>\r\n";
+            sendMessage(deviceId, from, newId("catalog-"), body);
+        }
+        return;
+    }
+
+    if (request.method == "MESSAGE") {
+        respond(request, from, 200, "OK");
+        if (request.body.find("<CmdType>Keepalive</CmdType>") != std::string_view::npos) {
+            ++results_.keepalives;
+        } else if (request.body.find("<CmdType>Catalog</CmdType>") != std::string_view::npos) {
+            ++results_.catalogResponses;
+            results_.catalogItems += countOccurrences(request.body, "<Item>");
+        }
+        return;
+    }
+
+    if (request.method == "BYE") {
+        // The device ended the call, e.g. at the end of a playback
+        respond(request, from, 200, "OK");
+        auto it = calls_.find(std::string(request.header("Call-ID")));
+        if (it != calls_.end()) {
+            if (it->second.up) {
+                --sessions_;
+                results_.sessionSeconds += std::chrono::duration<double>(now - it->second.established).count();
+            }
+            calls_.erase(it);
+        }
+        return;
+    }
+
+    if (request.method != "ACK") {
+        respond(request, from, 200, "OK");
+    }
+}
+
+void MockPlatform::handleResponse(const SipMessage& response) {
+    std::string callId(response.header("Call-ID"));
+    if (response.method == "MESSAGE") {
+        if (response.status >= 200 && response.status < 300 && callId.compare(0, 4, "ptz-") == 0) {
+            ++results_.ptzAnswered;
+        }
+        return;
+    }
+
+    auto it = calls_.find(callId);
+    if (it == calls_.end()) {
+        return;
+    }
+    Call& call = it->second;
+    if (response.method == "BYE") {
+        if (!call.up) {
+            calls_.erase(it);
+        }
+        return;
+    }
+    if (response.method != "INVITE" || response.status < 200) {
+        return;
+    }
+
+    if (response.status >= 300) {
+        // A non-2xx is acknowledged within the INVITE transaction
+        ++results_.failed;
+        call.to = std::string(response.header("To"));
+        sendAck(callId, call, call.branch);
+        calls_.erase(it);
+        return;
+    }
+    if (call.established == Clock::time_point()) {
+        Clock::time_point now = Clock::now();
+        call.established = now;
+        call.up = true;
+        call.to = std::string(response.header("To"));
+        ++results_.answered;
+        results_.inviteLatencyMs.push_back(std::chrono::duration<double, std::milli>(now - call.invited).count());
+        ++sessions_;
+        results_.peakSessions = std::max(results_.peakSessions, sessions_);
+        hangups_.emplace_back(now + std::chrono::duration_cast<Clock::duration>(
+                                        std::chrono::duration<double>(options_.holdSeconds)), callId);
+    }
+    // Retransmitted 200s are acknowledged again
+    sendAck(callId, call, newId("z9hG4bK"));
+}
+
+void MockPlatform::sendInvite(const std::string& channelId) {
+    const Device* device = deviceOf(channelId);
+    if (!device || !device->registered) {
+        return;
+    }
+    std::string callId = newId("call-");
+    Call call;
+    call.channelId = channelId;
+    call.to = "<sip:" + channelId + "@" + options_.realm + ">";
+    call.branch = newId("z9hG4bK");
+    call.address = device->address;
+    call.invited = Clock::now();
+
+    char ssrc[16];
+    snprintf(ssrc, sizeof(ssrc), "0%09u", static_cast<unsigned>(nextId_ % 1000000000));
+    std::string sdp = "v=0\r\n"
+                      "o=" + options_.platformId + " 0 0 IN IP4 127.0.0.1\r\n"
+                      "s=Play\r\n"
+                      "c=IN IP4 127.0.0.1\r\n"
+                      "t=0 0\r\n"
+                      "m=video " + std::to_string(options_.rtpPort) + " RTP/AVP 96\r\n"
+                      "a=recvonly\r\n"
+                      "a=rtpmap:96 PS/90000\r\n"
+                      "y=" + ssrc + "\r\n";
+    std::string message = requestHead("INVITE", channelId, callId, 1, call.branch, call.to);
+    message += "Contact: <sip:" + options_.platformId + "@127.0.0.1:" + std::to_string(options_.sipPort) + ">\r\n";
+    message += "Subject: " + channelId + ":" + ssrc + "," + options_.platformId + ":0\r\n";
+    message += "Content-Type: APPLICATION/SDP\r\n";
+    message += "Content-Length: " + std::to_string(sdp.size()) + "\r\n\r\n";
+    message += sdp;
+    send(message, call.address);
+    ++results_.invites;
+    calls_.emplace(std::move(callId), std::move(call));
+}
+
+void MockPlatform::sendAck(const std::string& callId, const Call& call, const std::string& branch) {
+    std::string message = requestHead("ACK", call.channelId, callId, 1, branch, call.to);
+    message += "Content-Length: 0\r\n\r\n";
+    send(message, call.address);
+}
+
+void MockPlatform::sendBye(const std::string& callId) {
+    auto it = calls_.find(callId);
+    if (it == calls_.end() || !it->second.up) {
+        return;
+    }
+    Call& call = it->second;
+    call.up = false;
+    --sessions_;
+    results_.sessionSeconds += std::chrono::duration<double>(Clock::now() - call.established).count();
+    std::string message = requestHead("BYE", call.channelId, callId, 2, newId("z9hG4bK"), call.to);
+    message += "Content-Length: 0\r\n\r\n";
+    send(message, call.address);
+}
+
+void MockPlatform::sendMessage(const std::string& targetId, const sockaddr_in& address, const std::string& callId,
+                               const std::string& body) {
+    std::string message = requestHead("MESSAGE", targetId, callId, 1, newId("z9hG4bK"),
+                                      "<sip:" + targetId + "@" + options_.realm + ">");
+    message += "Content-Type: Application/MANSCDP+xml\r\n";
+    message += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    message += body;
+    send(message, address);
+}
+
+void MockPlatform::sendPtz(const std::string& channelId) {
+    const Device* device = deviceOf(channelId);
+    if (!device || !device->registered) {
+        return;
+    }
+    // Joystick pattern: up, left, down, right, stop
+    static const uint8_t codes[] = {0x08, 0x02, 0x04, 0x01, 0x00};
+    uint8_t code = codes[results_.ptzSent % (sizeof(codes) / sizeof(codes[0]))];
+    std::string body = "<?xml version=\"1.0\"?>\r\n<Control>\r\n<CmdType>DeviceControl</CmdType>\r\n<SN>" +
+                       std::to_string(++nextSn_) + "</SN>\r\n<DeviceID>" + channelId + "</DeviceID>\r\n<PTZCmd>" +
+                       ptzCmd(code, 0x40, 0x40, 0) + "</PTZCmd>\r\n</Control>\r\n";
+    sendMessage(channelId, device->address, newId("ptz-"), body);
+    ++results_.ptzSent;
+}
+
+void MockPlatform::respond(const SipMessage& request, const sockaddr_in& to, int status, const char* reason,
+                           const std::string& extraHeaders) {
+    std::string message = "SIP/2.0 " + std::to_string(status) + " " + reason + "\r\n";
+    for (const auto& [name, value] : request.headers) {
+        if (equalsIgnoreCase(name, "Via") || equalsIgnoreCase(name, "v")) {
+            message += "Via: ";
+            message += value;
+            message += "\r\n";
+        }
+    }
+    message += "From: " + std::string(request.header("From")) + "\r\n";
+    std::string_view toHeader = request.header("To");
+    message += "To: " + std::string(toHeader);
+    if (toHeader.find(";tag=") == std::string_view::npos) {
+        message += ";tag=" + tag_;
+    }
+    message += "\r\n";
+    message += "Call-ID: " + std::string(request.header("Call-ID")) + "\r\n";
+    message += "CSeq: " + std::string(request.header("CSeq")) + "\r\n";
+    message += extraHeaders;
+    message += "Content-Length: 0\r\n\r\n";
+    send(message, to);
+}
+
+void MockPlatform::send(const std::string& message, const sockaddr_in& to) {
+    if (sendto(sipSocket_, message.data(), message.size(), 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) < 0) {
+        std::cerr << "MockPlatform: send failed: " << strerror(errno) << std::endl;
+    }
+}
+
+std::string MockPlatform::requestHead(const char* method, const std::string& targetId, const std::string& callId,
+                                      uint32_t cseq, const std::string& branch, const std::string& to) {
+    std::string head;
+    head.reserve(512);
+    head += method;
+    head += " sip:" + targetId + "@127.0.0.1:" + std::to_string(options_.devicePort) + " SIP/2.0\r\n";
+    head += "Via: SIP/2.0/UDP 127.0.0.1:" + std::to_string(options_.sipPort) + ";rport;branch=" + branch + "\r\n";
+    head += "From: <sip:" + options_.platformId + "@" + options_.realm + ">;tag=" + tag_ + "\r\n";
+    head += "To: " + to + "\r\n";
+    head += "Call-ID: " + callId + "\r\n";
+    head += "CSeq: " + std::to_string(cseq) + " " + method + "\r\n";
+    head += "Max-Forwards: 70\r\n";
+    return head;
+}
+
+std::string MockPlatform::newId(const char* prefix) {
+    char id[48];
+    snprintf(id, sizeof(id), "%s%llu%08x", prefix, static_cast<unsigned long long>(++nextId_),
+             static_cast<unsigned>(rng_()));
+    return id;
+}
+
+const MockPlatform::Device* MockPlatform::deviceOf(const std::string& channelId) const {
+    // Channel IDs extend their device's 20-digit ID
+    auto it = devices_.find(channelId.substr(0, std::min<size_t>(channelId.size(), 20)));
+    return it == devices_.end() ? nullptr : &it->second;
+}
@@ -0,0 +1,133 @@
+#ifndef MOCK_PLATFORM_H
+#define MOCK_PLATFORM_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <netinet/in.h>
+
+struct SipMessage;
+
+// The platform side of GB28181, just enough of it to load a Gb28181Client
+// over loopback UDP: it challenges each REGISTER once, accepts the retry,
+// sends each device a Catalog query, answers MESSAGEs, and places
+// INVITE/ACK/BYE calls and PTZ DeviceControl MESSAGEs at fixed rates. All RTP
+// goes to one sink socket. Single-threaded: the bench thread drives it
+// through the calls below.
+class MockPlatform {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        int sipPort = 15060;
+        int rtpPort = 15070;   // Media sink for every session
+        int devicePort = 15080; // Where the client under test listens
+        std::string realm = "3402000000";
+        std::string platformId = "34020000002000000001";
+        double inviteRate = 10; // Per second
+        double holdSeconds = 10; // INVITE to BYE
+        size_t maxSessions = 0; // Calls in progress; 0 for no cap
+        double ptzRate = 0;     // Per second
+    };
+
+    struct Results {
+        size_t registrations = 0; // Devices, each counted once
+        size_t challenges = 0;
+        Clock::time_point firstRegister;
+        Clock::time_point lastRegistered;
+        size_t keepalives = 0;
+        size_t catalogResponses = 0;
+        size_t catalogItems = 0;
+
+        size_t invites = 0;
+        size_t answered = 0;
+        size_t failed = 0;
+        std::vector<double> inviteLatencyMs; // INVITE sent to 200 OK received
+        size_t peakSessions = 0;
+        double sessionSeconds = 0; // Summed over calls, for the average
+
+        size_t ptzSent = 0;
+        size_t ptzAnswered = 0;
+
+        uint64_t rtpPackets = 0;
+        uint64_t rtpBytes = 0;
+    };
+
+    explicit MockPlatform(const Options& options);
+    ~MockPlatform();
+
+    MockPlatform(const MockPlatform&) = delete;
+    MockPlatform& operator=(const MockPlatform&) = delete;
+
+    bool open();
+
+    // Serves the devices until deviceCount of them have registered. Returns
+    // false on timeout.
+    bool waitForRegistrations(size_t deviceCount, Clock::duration timeout);
+
+    // Calls channelIds round robin for duration, then hangs up everything
+    // still up and waits briefly for the answers
+    void runCalls(const std::vector<std::string>& channelIds, Clock::duration duration);
+
+    const Results& results() const { return results_; }
+
+private:
+    struct Device {
+        sockaddr_in address{};
+        bool registered = false;
+    };
+
+    struct Call {
+        std::string channelId;
+        std::string to;     // To header, with the device's tag once answered
+        std::string branch; // Of the INVITE; a non-2xx is ACKed on it
+        sockaddr_in address{};
+        Clock::time_point invited;
+        Clock::time_point established;
+        bool up = false;
+    };
+
+    // Handles whatever arrives until deadline
+    void pump(Clock::time_point deadline);
+    void receiveSip();
+    void receiveRtp();
+    void handleRequest(const SipMessage& request, const sockaddr_in& from);
+    void handleResponse(const SipMessage& response);
+
+    void sendInvite(const std::string& channelId);
+    void sendAck(const std::string& callId, const Call& call, const std::string& branch);
+    void sendBye(const std::string& callId);
+    void sendMessage(const std::string& targetId, const sockaddr_in& address, const std::string& callId,
+                     const std::string& body);
+    void sendPtz(const std::string& channelId);
+    void respond(const SipMessage& request, const sockaddr_in& to, int status, const char* reason,
+                 const std::string& extraHeaders = std::string());
+    void send(const std::string& message, const sockaddr_in& to);
+
+    std::string requestHead(const char* method, const std::string& targetId, const std::string& callId, uint32_t cseq,
+                            const std::string& branch, const std::string& to);
+    std::string newId(const char* prefix);
+    const Device* deviceOf(const std::string& channelId) const;
+
+    Options options_;
+    int sipSocket_;
+    int rtpSocket_;
+    Results results_;
+    std::mt19937 rng_;
+    uint64_t nextId_;
+    uint32_t nextSn_;
+    std::string tag_; // Ours on every dialog
+
+    std::unordered_map<std::string, Device> devices_;
+    std::unordered_map<std::string, Call> calls_; // By Call-ID
+    std::deque<std::pair<Clock::time_point, std::string>> hangups_; // Hold time is fixed, so in time order
+    size_t sessions_; // Calls answered and not yet hung up
+    std::vector<uint8_t> buffer_;
+};
+
+#endif // MOCK_PLATFORM_H
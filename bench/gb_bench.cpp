@@ -0,0 +1,197 @@
+// Loopback load test: runs a Gb28181Client in-process against MockPlatform
+// and reports registration rate, INVITE->200 latency, sessions sustained and
+// memory/CPU per session.
+//
+//   gb_bench [--devices N] [--channels N] [--invite-rate R] [--hold S]
+//            [--duration S] [--max-sessions N] [--ptz-rate R] [--media PATH]
+//            [--sip-workers N] [--verbose]
+//
+// CPU and RSS are the whole process's, so they include the mock platform and
+// its RTP sink.
+#include "Config.h"
+#include "Gb28181Client.h"
+#include "Log.h"
+#include "MockPlatform.h"
+#include "StreamRegistry.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+namespace {
+struct BenchOptions {
+    int devices = 100;
+    int channels = 1;
+    double durationSeconds = 30;
+    std::string media = "media/sample.h264";
+    int sipWorkers = 4;
+    bool verbose = false; // Keep the client's per-event logging
+    MockPlatform::Options platform;
+};
+
+void usage(const char* program) {
+    std::cerr << "Usage: " << program
+              << " [--devices N] [--channels N] [--invite-rate R] [--hold S] [--duration S]"
+                 " [--max-sessions N] [--ptz-rate R] [--media PATH] [--sip-workers N] [--verbose]"
+              << std::endl;
+}
+
+bool parseArguments(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string name = argv[i];
+        if (name == "--verbose") {
+            options.verbose = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        if (name == "--devices") options.devices = atoi(value);
+        else if (name == "--channels") options.channels = atoi(value);
+        else if (name == "--invite-rate") options.platform.inviteRate = atof(value);
+        else if (name == "--hold") options.platform.holdSeconds = atof(value);
+        else if (name == "--duration") options.durationSeconds = atof(value);
+        else if (name == "--max-sessions") options.platform.maxSessions = static_cast<size_t>(atol(value));
+        else if (name == "--ptz-rate") options.platform.ptzRate = atof(value);
+        else if (name == "--media") options.media = value;
+        else if (name == "--sip-workers") options.sipWorkers = atoi(value);
+        else return false;
+    }
+    return options.devices > 0 && options.channels > 0 && options.durationSeconds > 0;
+}
+
+// Field of /proc/self/status in kB, e.g. VmRSS or VmHWM
+long statusKb(const char* field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    size_t length = strlen(field);
+    while (std::getline(status, line)) {
+        if (line.compare(0, length, field) == 0 && line.size() > length && line[length] == ':') {
+            return atol(line.c_str() + length + 1);
+        }
+    }
+    return 0;
+}
+
+double cpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    return sorted[index];
+}
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Two UDP sockets per session on the client side
+    rlimit files{};
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    AppConfig config;
+    config.serverIp = "127.0.0.1";
+    config.serverPort = options.platform.sipPort;
+    config.realm = options.platform.realm;
+    config.sipPort = options.platform.devicePort;
+    config.sipWorkers = options.sipWorkers;
+    config.registerSpreadMs = 0; // Measure the registration rate, not the spread
+    config.mediaSource = options.media;
+    config.rtpPortFirst = 20000;
+    config.rtpPortLast = 40000;
+    config.recordingDir.clear();
+    config.latencyFile.clear();
+    DeviceTemplate devices;
+    devices.count = options.devices;
+    devices.channels = options.channels;
+    config.devices.push_back(devices);
+
+    std::vector<std::string> channelIds;
+    for (int i = 0; i < options.devices; ++i) {
+        std::string deviceId = generateDeviceId(devices, i);
+        for (int channel = 0; channel < options.channels; ++channel) {
+            channelIds.push_back(generateChannelId(deviceId, channel));
+        }
+    }
+
+    MockPlatform platform(options.platform);
+    if (!platform.open()) {
+        return 1;
+    }
+
+    // The client logs every SIP event; at these rates that is the benchmark
+    if (!options.verbose) {
+        Log::setLevel(Log::Warn);
+    }
+
+    StreamRegistry registry;
+    Gb28181Client client(config, registry);
+    client.start();
+
+    bool registered = platform.waitForRegistrations(static_cast<size_t>(options.devices), std::chrono::seconds(60));
+    long baselineRssKb = statusKb("VmRSS");
+    double cpuBefore = cpuSeconds();
+    auto callsStart = MockPlatform::Clock::now();
+    if (registered) {
+        platform.runCalls(channelIds, std::chrono::duration_cast<MockPlatform::Clock::duration>(
+                                          std::chrono::duration<double>(options.durationSeconds)));
+    }
+    double wallSeconds = std::chrono::duration<double>(MockPlatform::Clock::now() - callsStart).count();
+    double cpu = cpuSeconds() - cpuBefore;
+    long peakRssKb = statusKb("VmHWM");
+
+    client.stop();
+    Log::flush();
+
+    const MockPlatform::Results& results = platform.results();
+    double registerSeconds = std::chrono::duration<double>(results.lastRegistered - results.firstRegister).count();
+    std::printf("Registrations: %zu of %d devices in %.3f s (%.0f/s), %zu challenged%s\n", results.registrations,
+                options.devices, registerSeconds, registerSeconds > 0 ? results.registrations / registerSeconds : 0.0,
+                results.challenges, registered ? "" : " - TIMED OUT");
+    std::printf("Catalog: %zu responses, %zu items; %zu keepalives\n", results.catalogResponses, results.catalogItems,
+                results.keepalives);
+    if (!registered) {
+        return 1;
+    }
+
+    std::vector<double> latency = results.inviteLatencyMs;
+    std::sort(latency.begin(), latency.end());
+    size_t unanswered = results.invites - results.answered - results.failed;
+    std::printf("INVITE->200: %zu sent, %zu answered, %zu failed, %zu unanswered\n", results.invites, results.answered,
+                results.failed, unanswered);
+    std::printf("  p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms\n", percentile(latency, 0.5),
+                percentile(latency, 0.9), percentile(latency, 0.99), percentile(latency, 0.999),
+                latency.empty() ? 0.0 : latency.back());
+
+    double averageSessions = wallSeconds > 0 ? results.sessionSeconds / wallSeconds : 0;
+    std::printf("Sessions: %zu peak, %.1f average\n", results.peakSessions, averageSessions);
+    std::printf("PTZ: %zu sent, %zu answered\n", results.ptzSent, results.ptzAnswered);
+    std::printf("RTP: %llu packets, %.1f MB (%.1f Mbit/s)\n", static_cast<unsigned long long>(results.rtpPackets),
+                results.rtpBytes / 1e6, wallSeconds > 0 ? results.rtpBytes * 8 / wallSeconds / 1e6 : 0.0);
+    std::printf("RSS: %.1f MB registered, %.1f MB peak, %.1f KB per peak session\n", baselineRssKb / 1024.0,
+                peakRssKb / 1024.0,
+                results.peakSessions > 0 ? double(peakRssKb - baselineRssKb) / results.peakSessions : 0.0);
+    double cpuPercent = wallSeconds > 0 ? cpu / wallSeconds * 100 : 0;
+    std::printf("CPU: %.1f%% of a core, %.3f%% per average session\n", cpuPercent,
+                averageSessions > 0 ? cpuPercent / averageSessions : 0.0);
+    return 0;
+}
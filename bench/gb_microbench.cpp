@@ -0,0 +1,256 @@
+// Per-message cost of the SIP-side hot paths: Catalog rendering, keepalive
+// and SDP answer building, SDP offer and MANSCDP parsing, PTZCmd decoding.
+// Payloads come from corpus/sdp and corpus/manscdp. Besides time per op,
+// every benchmark reports allocs/op, counted by replacing the global
+// operator new.
+#include "CatalogPages.h"
+#include "Config.h"
+#include "ManscdpDispatcher.h"
+#include "ManscdpParser.h"
+#include "PtzCommand.h"
+#include "PtzController.h"
+#include "Sdp.h"
+#include "VirtualDevice.h"
+#include <benchmark/benchmark.h>
+#include <dirent.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+std::atomic<uint64_t> allocationCount(0);
+}
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+struct Sample {
+    std::string name;
+    std::string body;
+};
+
+std::vector<Sample> loadCorpus(const std::string& dir, const std::string& extension) {
+    std::vector<Sample> samples;
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        return samples;
+    }
+    while (dirent* entry = readdir(handle)) {
+        std::string name = entry->d_name;
+        if (name.size() <= extension.size() ||
+            name.compare(name.size() - extension.size(), extension.size(), extension) != 0) {
+            continue;
+        }
+        std::ifstream file(dir + "/" + name, std::ios::binary);
+        std::stringstream body;
+        body << file.rdbuf();
+        samples.push_back(Sample{name.substr(0, name.size() - extension.size()), body.str()});
+    }
+    closedir(handle);
+    std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) { return a.name < b.name; });
+    return samples;
+}
+
+// Allocations made during the timed loop, per iteration
+class AllocationCounter {
+public:
+    explicit AllocationCounter(benchmark::State& state)
+        : state_(state), start_(allocationCount.load(std::memory_order_relaxed)) {}
+    ~AllocationCounter() {
+        double count = static_cast<double>(allocationCount.load(std::memory_order_relaxed) - start_);
+        state_.counters["allocs/op"] = benchmark::Counter(count, benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    benchmark::State& state_;
+    uint64_t start_;
+};
+
+std::unique_ptr<VirtualDevice> makeDevice(int channels) {
+    DeviceTemplate deviceTemplate;
+    auto device = std::make_unique<VirtualDevice>();
+    device->deviceId = generateDeviceId(deviceTemplate, 0);
+    device->fromUri = "sip:" + device->deviceId + "@3402000000";
+    for (int i = 0; i < channels; ++i) {
+        device->channelIds.push_back(generateChannelId(device->deviceId, i));
+    }
+    device->prepareKeepAlive();
+    return device;
+}
+
+// Pages are built once per device, on its first query
+void catalogBuild(benchmark::State& state) {
+    std::unique_ptr<VirtualDevice> device = makeDevice(static_cast<int>(state.range(0)));
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        CatalogPages pages(*device, 4);
+        benchmark::DoNotOptimize(pages.pageCount());
+    }
+}
+
+// Answering a query: every page rendered with the query's SN
+void catalogRender(benchmark::State& state) {
+    std::unique_ptr<VirtualDevice> device = makeDevice(static_cast<int>(state.range(0)));
+    CatalogPages pages(*device, 4);
+    std::string page;
+    page.reserve(pages.maxPageSize());
+    size_t bytes = 0;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        for (size_t i = 0; i < pages.pageCount(); ++i) {
+            pages.render(i, "17", page);
+            bytes += page.size();
+            benchmark::DoNotOptimize(page.data());
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+
+void keepAlive(benchmark::State& state) {
+    std::unique_ptr<VirtualDevice> device = makeDevice(1);
+    std::string xml;
+    uint32_t sn = 0;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        device->renderKeepAlive(std::to_string(++sn), xml);
+        benchmark::DoNotOptimize(xml.data());
+    }
+}
+
+void sdpParse(benchmark::State& state, const std::string* body) {
+    SdpOffer offer;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        bool ok = parseSdpOffer(*body, offer);
+        benchmark::DoNotOptimize(ok);
+        benchmark::DoNotOptimize(offer);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body->size()));
+}
+
+void sdpAnswer(benchmark::State& state, const std::string* body) {
+    SdpOffer offer;
+    parseSdpOffer(*body, offer);
+    const std::string deviceId = "34020000001320000001";
+    const std::string localIp = "192.168.1.64";
+    MediaTransport transport = offer.transport();
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        std::string answer = buildSdpAnswer(offer, deviceId, localIp, transport, 10000, 1 << 30);
+        benchmark::DoNotOptimize(answer.data());
+    }
+}
+
+// What handleMessage does before reaching a handler
+void manscdpDispatch(benchmark::State& state, const std::string* body) {
+    ManscdpMessage message;
+    std::string storage;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        ManscdpParseResult result = parseManscdp(*body, message);
+        if (result == ManscdpParseResult::Unsupported) {
+            result = parseManscdpDom(*body, message, storage);
+        }
+        ManscdpCommand command = lookupManscdpCommand(message.cmdType);
+        benchmark::DoNotOptimize(result);
+        benchmark::DoNotOptimize(command);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body->size()));
+}
+
+void ptzDecode(benchmark::State& state, const char* hex) {
+    PtzCommand command;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        PtzDecodeResult result = decodePtzCmd(hex, command);
+        benchmark::DoNotOptimize(result);
+        benchmark::DoNotOptimize(command);
+    }
+}
+
+class NullPtzDriver : public PtzDriver {
+public:
+    void execute(const std::string&, const PtzCommand& command) override { benchmark::DoNotOptimize(command); }
+};
+
+// Decode plus the hand-off to the PTZ thread, as handleDeviceControl does it
+void ptzSubmit(benchmark::State& state) {
+    PtzController controller(std::make_unique<NullPtzDriver>());
+    controller.addChannel("3402000000132000000101");
+    controller.start();
+    PtzCommand command;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        decodePtzCmd("A50F010800FA00B7", command);
+        benchmark::DoNotOptimize(controller.submit("3402000000132000000101", command));
+    }
+    controller.stop();
+}
+}
+
+int main(int argc, char** argv) {
+    const char* dir = getenv("BENCH_CORPUS");
+    std::string corpusDir = dir ? dir : BENCH_CORPUS_DIR;
+    static std::vector<Sample> sdp = loadCorpus(corpusDir + "/sdp", ".sdp");
+    static std::vector<Sample> manscdp = loadCorpus(corpusDir + "/manscdp", ".xml");
+    if (sdp.empty() || manscdp.empty()) {
+        std::cerr << "No samples found in " << corpusDir << "/sdp or " << corpusDir << "/manscdp" << std::endl;
+        return 1;
+    }
+
+    benchmark::RegisterBenchmark("Catalog/Build", catalogBuild)->Arg(1)->Arg(16)->Arg(1000);
+    benchmark::RegisterBenchmark("Catalog/Render", catalogRender)->Arg(1)->Arg(16)->Arg(1000);
+    benchmark::RegisterBenchmark("Keepalive", keepAlive);
+    for (const Sample& sample : sdp) {
+        benchmark::RegisterBenchmark(("Sdp/Parse/" + sample.name).c_str(), sdpParse, &sample.body);
+        if (sample.name.compare(0, 9, "malformed") != 0) {
+            benchmark::RegisterBenchmark(("Sdp/Answer/" + sample.name).c_str(), sdpAnswer, &sample.body);
+        }
+    }
+    for (const Sample& sample : manscdp) {
+        benchmark::RegisterBenchmark(("Manscdp/" + sample.name).c_str(), manscdpDispatch, &sample.body);
+    }
+    benchmark::RegisterBenchmark("Ptz/Decode/Move", ptzDecode, "A50F010800FA00B7");
+    benchmark::RegisterBenchmark("Ptz/Decode/Preset", ptzDecode, "A50F01820005003C");
+    benchmark::RegisterBenchmark("Ptz/Decode/BadChecksum", ptzDecode, "A50F010800FA00B8");
+    benchmark::RegisterBenchmark("Ptz/Decode/BadHex", ptzDecode, "A50F0108Z0FA00B7");
+    benchmark::RegisterBenchmark("Ptz/Submit", ptzSubmit);
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Compares the in-place MANSCDP pull parser with the libxml2 DOM fallback on
+// the captured message bodies in corpus/manscdp.
+#include "ManscdpParser.h"
+#include <benchmark/benchmark.h>
+#include <dirent.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+struct Sample {
+    std::string name;
+    std::string body;
+};
+
+std::vector<Sample> loadCorpus(const std::string& dir) {
+    std::vector<Sample> samples;
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        return samples;
+    }
+    while (dirent* entry = readdir(handle)) {
+        std::string name = entry->d_name;
+        if (name.size() < 5 || name.compare(name.size() - 4, 4, ".xml") != 0) {
+            continue;
+        }
+        std::ifstream file(dir + "/" + name);
+        std::stringstream body;
+        body << file.rdbuf();
+        samples.push_back(Sample{name.substr(0, name.size() - 4), body.str()});
+    }
+    closedir(handle);
+    std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) { return a.name < b.name; });
+    return samples;
+}
+
+void fastPath(benchmark::State& state, const std::string* body) {
+    ManscdpMessage message;
+    for (auto _ : state) {
+        ManscdpParseResult result = parseManscdp(*body, message);
+        benchmark::DoNotOptimize(result);
+        benchmark::DoNotOptimize(message);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body->size()));
+}
+
+void domPath(benchmark::State& state, const std::string* body) {
+    ManscdpMessage message;
+    std::string storage;
+    for (auto _ : state) {
+        ManscdpParseResult result = parseManscdpDom(*body, message, storage);
+        benchmark::DoNotOptimize(result);
+        benchmark::DoNotOptimize(message);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body->size()));
+}
+
+// What handleMessage does: fast path first, DOM only when it gives up
+void dispatchPath(benchmark::State& state, const std::string* body) {
+    ManscdpMessage message;
+    std::string storage;
+    for (auto _ : state) {
+        ManscdpParseResult result = parseManscdp(*body, message);
+        if (result == ManscdpParseResult::Unsupported) {
+            result = parseManscdpDom(*body, message, storage);
+        }
+        benchmark::DoNotOptimize(result);
+        benchmark::DoNotOptimize(message);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body->size()));
+}
+}
+
+int main(int argc, char** argv) {
+    const char* dir = getenv("MANSCDP_CORPUS");
+    static std::vector<Sample> corpus = loadCorpus(dir ? dir : MANSCDP_CORPUS_DIR);
+    if (corpus.empty()) {
+        std::cerr << "No .xml samples found in " << (dir ? dir : MANSCDP_CORPUS_DIR) << std::endl;
+        return 1;
+    }
+
+    for (const Sample& sample : corpus) {
+        benchmark::RegisterBenchmark(("Fast/" + sample.name).c_str(), fastPath, &sample.body);
+        benchmark::RegisterBenchmark(("Dom/" + sample.name).c_str(), domPath, &sample.body);
+        benchmark::RegisterBenchmark(("Dispatch/" + sample.name).c_str(), dispatchPath, &sample.body);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "AnnexB.h"
+
+namespace {
+// Exp-Golomb bit reader over an RBSP (emulation prevention bytes removed)
+class BitReader {
+public:
+    explicit BitReader(const std::vector<uint8_t>& data) : data_(data), bit_(0), malformed_(false) {}
+
+    // Read past the end, or hit a code no 32-bit field can hold
+    bool exhausted() const { return malformed_ || bit_ > data_.size() * 8; }
+
+    uint32_t bits(int count) {
+        uint32_t value = 0;
+        for (int i = 0; i < count; ++i) {
+            value = (value << 1) | bit();
+        }
+        return value;
+    }
+
+    uint32_t bit() {
+        size_t byte = bit_ / 8;
+        uint32_t value = byte < data_.size() ? (data_[byte] >> (7 - bit_ % 8)) & 1 : 0;
+        ++bit_;
+        return value;
+    }
+
+    uint32_t ue() {
+        int zeros = 0;
+        while (bit() == 0 && !exhausted()) {
+            if (++zeros > 31) {
+                malformed_ = true;
+                return 0;
+            }
+        }
+        return ((1u << zeros) - 1) + bits(zeros);
+    }
+
+    int32_t se() {
+        uint32_t value = ue();
+        return value & 1 ? static_cast<int32_t>((value + 1) / 2) : -static_cast<int32_t>(value / 2);
+    }
+
+private:
+    const std::vector<uint8_t>& data_;
+    size_t bit_;
+    bool malformed_;
+};
+
+std::vector<uint8_t> toRbsp(const uint8_t* nal, size_t size) {
+    std::vector<uint8_t> rbsp;
+    rbsp.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        if (i >= 2 && nal[i] == 3 && nal[i - 1] == 0 && nal[i - 2] == 0) {
+            continue; // Emulation prevention byte
+        }
+        rbsp.push_back(nal[i]);
+    }
+    return rbsp;
+}
+
+void skipScalingList(BitReader& reader, int size) {
+    int last = 8;
+    int next = 8;
+    for (int i = 0; i < size && next != 0; ++i) {
+        next = (last + reader.se() + 256) % 256;
+        last = next == 0 ? last : next;
+    }
+}
+
+bool parseSps(const uint8_t* nal, size_t size, int& width, int& height) {
+    std::vector<uint8_t> rbsp = toRbsp(nal + 1, size - 1); // Skip the NAL header
+    BitReader reader(rbsp);
+
+    uint32_t profile = reader.bits(8);
+    reader.bits(16); // Constraint flags, level
+    reader.ue();     // seq_parameter_set_id
+
+    uint32_t chromaFormat = 1;
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 244 || profile == 44 ||
+        profile == 83 || profile == 86 || profile == 118 || profile == 128 || profile == 138 ||
+        profile == 139 || profile == 134 || profile == 135) {
+        chromaFormat = reader.ue();
+        if (chromaFormat == 3) {
+            reader.bit(); // separate_colour_plane_flag
+        }
+        reader.ue(); // bit_depth_luma_minus8
+        reader.ue(); // bit_depth_chroma_minus8
+        reader.bit(); // qpprime_y_zero_transform_bypass_flag
+        if (reader.bit()) { // seq_scaling_matrix_present_flag
+            for (int i = 0; i < (chromaFormat != 3 ? 8 : 12); ++i) {
+                if (reader.bit()) {
+                    skipScalingList(reader, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+
+    reader.ue(); // log2_max_frame_num_minus4
+    uint32_t pocType = reader.ue();
+    if (pocType == 0) {
+        reader.ue(); // log2_max_pic_order_cnt_lsb_minus4
+    } else if (pocType == 1) {
+        reader.bit();
+        reader.se();
+        reader.se();
+        uint32_t cycle = reader.ue();
+        for (uint32_t i = 0; i < cycle && !reader.exhausted(); ++i) {
+            reader.se();
+        }
+    }
+    reader.ue();  // max_num_ref_frames
+    reader.bit(); // gaps_in_frame_num_value_allowed_flag
+
+    uint32_t widthInMbs = reader.ue() + 1;
+    uint32_t heightInMapUnits = reader.ue() + 1;
+    uint32_t frameMbsOnly = reader.bit();
+    if (!frameMbsOnly) {
+        reader.bit(); // mb_adaptive_frame_field_flag
+    }
+    reader.bit(); // direct_8x8_inference_flag
+
+    uint32_t cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
+    if (reader.bit()) {
+        cropLeft = reader.ue();
+        cropRight = reader.ue();
+        cropTop = reader.ue();
+        cropBottom = reader.ue();
+    }
+    if (reader.exhausted()) {
+        return false;
+    }
+
+    uint32_t cropUnitX = chromaFormat == 0 ? 1 : (chromaFormat == 3 ? 1 : 2);
+    uint32_t cropUnitY = (chromaFormat == 1 ? 2 : 1) * (2 - frameMbsOnly);
+    width = static_cast<int>(widthInMbs * 16 - (cropLeft + cropRight) * cropUnitX);
+    height = static_cast<int>((2 - frameMbsOnly) * heightInMapUnits * 16 - (cropTop + cropBottom) * cropUnitY);
+    return width > 0 && height > 0;
+}
+}
+
+bool parseH264Config(const uint8_t* data, size_t size, H264Config& config) {
+    forEachNalUnit(data, size, [&](const uint8_t* nal, size_t nalSize) {
+        uint8_t type = nal[0] & 0x1F;
+        if (type == H264_NAL_SPS && config.sps.empty() && nalSize >= 4) {
+            if (parseSps(nal, nalSize, config.width, config.height)) {
+                config.sps.assign(nal, nal + nalSize);
+            }
+        } else if (type == H264_NAL_PPS && config.pps.empty()) {
+            config.pps.assign(nal, nal + nalSize);
+        }
+    });
+    return config.valid();
+}
+
+void annexBToLengthPrefixed(const uint8_t* data, size_t size, std::string& out) {
+    forEachNalUnit(data, size, [&](const uint8_t* nal, size_t nalSize) {
+        uint8_t type = nal[0] & 0x1F;
+        if (type == H264_NAL_SPS || type == H264_NAL_PPS || type == H264_NAL_AUD) {
+            return;
+        }
+        uint32_t length = static_cast<uint32_t>(nalSize);
+        char prefix[4] = {static_cast<char>(length >> 24), static_cast<char>(length >> 16),
+                          static_cast<char>(length >> 8), static_cast<char>(length)};
+        out.append(prefix, 4);
+        out.append(reinterpret_cast<const char*>(nal), nalSize);
+    });
+}
+
+bool isReferenceAccessUnit(const uint8_t* data, size_t size, bool hevc) {
+    bool sawPicture = false;
+    bool reference = false;
+    forEachNalUnit(data, size, [&](const uint8_t* nal, size_t) {
+        if (hevc) {
+            uint8_t type = (nal[0] >> 1) & 0x3F;
+            if (type < 32) { // VCL
+                sawPicture = true;
+                // Types 0..14 even are the _N (sub-layer non-reference) variants
+                reference = reference || type >= 16 || (type & 1);
+            }
+        } else {
+            uint8_t type = nal[0] & 0x1F;
+            if (type >= 1 && type <= H264_NAL_IDR) {
+                sawPicture = true;
+                reference = reference || (nal[0] & 0x60) != 0;
+            }
+        }
+    });
+    return reference || !sawPicture; // Unknown content is kept
+}
+
+std::string buildAvcDecoderConfig(const H264Config& config) {
+    std::string record;
+    record += static_cast<char>(1);           // configurationVersion
+    record += static_cast<char>(config.sps[1]); // AVCProfileIndication
+    record += static_cast<char>(config.sps[2]); // profile_compatibility
+    record += static_cast<char>(config.sps[3]); // AVCLevelIndication
+    record += static_cast<char>(0xFF);        // lengthSizeMinusOne = 3
+    record += static_cast<char>(0xE1);        // One SPS
+    record += static_cast<char>(config.sps.size() >> 8);
+    record += static_cast<char>(config.sps.size());
+    record.append(config.sps.begin(), config.sps.end());
+    record += static_cast<char>(1);           // One PPS
+    record += static_cast<char>(config.pps.size() >> 8);
+    record += static_cast<char>(config.pps.size());
+    record.append(config.pps.begin(), config.pps.end());
+    return record;
+}
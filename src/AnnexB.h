@@ -0,0 +1,69 @@
+#ifndef ANNEX_B_H
+#define ANNEX_B_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// H.264 NAL unit types used when repackaging Annex B access units
+const uint8_t H264_NAL_IDR = 5;
+const uint8_t H264_NAL_SPS = 7;
+const uint8_t H264_NAL_PPS = 8;
+const uint8_t H264_NAL_AUD = 9;
+
+// Calls fn(nal, size) for every NAL unit of an Annex B buffer, start codes removed
+template <typename Fn>
+void forEachNalUnit(const uint8_t* data, size_t size, Fn fn) {
+    size_t i = 0;
+    size_t start = size; // Start of the current NAL unit, size if none yet
+    while (i + 3 <= size) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if (start < size) {
+                size_t end = i;
+                while (end > start && data[end - 1] == 0) {
+                    --end; // Trailing zero of a 4-byte start code
+                }
+                if (end > start) {
+                    fn(data + start, end - start);
+                }
+            }
+            i += 3;
+            start = i;
+        } else {
+            ++i;
+        }
+    }
+    if (start < size) {
+        fn(data + start, size - start);
+    }
+}
+
+// SPS/PPS and picture size of an H.264 stream
+struct H264Config {
+    std::vector<uint8_t> sps;
+    std::vector<uint8_t> pps;
+    int width = 0;
+    int height = 0;
+
+    bool valid() const { return !sps.empty() && !pps.empty() && width > 0 && height > 0; }
+};
+
+// Picks the SPS and PPS out of an access unit (normally a keyframe) and
+// decodes the picture size from the SPS. Returns config.valid().
+bool parseH264Config(const uint8_t* data, size_t size, H264Config& config);
+
+// Appends the access unit as 4-byte length-prefixed NAL units, the layout
+// FLV and MP4 expect. Parameter sets and AUDs are left out; they travel in the
+// decoder configuration record instead.
+void annexBToLengthPrefixed(const uint8_t* data, size_t size, std::string& out);
+
+// False if no other picture may predict from this access unit: H.264
+// slices with nal_ref_idc 0, or H.265 sub-layer non-reference pictures
+// (TRAIL_N, RASL_N, ...). Such frames can be dropped without breaking decoding.
+bool isReferenceAccessUnit(const uint8_t* data, size_t size, bool hevc);
+
+// AVCDecoderConfigurationRecord (ISO/IEC 14496-15) for config
+std::string buildAvcDecoderConfig(const H264Config& config);
+
+#endif // ANNEX_B_H
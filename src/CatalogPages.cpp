@@ -0,0 +1,80 @@
+#include "CatalogPages.h"
+#include "VirtualDevice.h"
+#include <algorithm>
+
+namespace {
+const size_t MAX_SN_LENGTH = 20;
+}
+
+CatalogPages::CatalogPages(const VirtualDevice& device, size_t itemsPerPage)
+    : maxPageSize_(0) {
+    if (itemsPerPage == 0) {
+        itemsPerPage = 1;
+    }
+
+    std::vector<std::string> items;
+    items.reserve(device.channelIds.size());
+    for (size_t i = 0; i < device.channelIds.size(); ++i) {
+        items.push_back(renderItem(device, i));
+    }
+
+    std::string sumNum = std::to_string(items.size());
+    // A device without channels still answers with one empty page
+    size_t pageCount = items.empty() ? 1 : (items.size() + itemsPerPage - 1) / itemsPerPage;
+    for (size_t index = 0; index < pageCount; ++index) {
+        size_t first = index * itemsPerPage;
+        size_t last = std::min(items.size(), first + itemsPerPage);
+        std::string num = std::to_string(last - first);
+
+        Page page;
+        page.head = "<?xml version=\"1.0\" encoding=\"GB2312\"?>\n";
+        page.head += "<Response>\n";
+        page.head += "  <CmdType>Catalog</CmdType>\n";
+        page.head += "  <SN>";
+
+        page.tail = "</SN>\n";
+        page.tail += "  <DeviceID>" + device.deviceId + "</DeviceID>\n";
+        page.tail += "  <SumNum>" + sumNum + "</SumNum>\n";
+        page.tail += "  <DeviceList Num=\'" + num + "\'>\n";
+        for (size_t i = first; i < last; ++i) {
+            page.tail += items[i];
+        }
+        page.tail += "  </DeviceList>\n";
+        page.tail += "</Response>";
+
+        maxPageSize_ = std::max(maxPageSize_, page.head.size() + MAX_SN_LENGTH + page.tail.size());
+        pages_.push_back(std::move(page));
+    }
+}
+
+void CatalogPages::render(size_t index, std::string_view sn, std::string& out) const {
+    const Page& page = pages_[index];
+    out.clear();
+    out.reserve(page.head.size() + sn.size() + page.tail.size());
+    out.append(page.head);
+    out.append(sn);
+    out.append(page.tail);
+}
+
+std::string CatalogPages::renderItem(const VirtualDevice& device, size_t channel) {
+    std::string number = std::to_string(channel + 1);
+    std::string item = "    <Item>\n";
+    item += "      <DeviceID>" + device.channelIds[channel] + "</DeviceID>\n";
+    item += "      <Name>Camera " + (channel < 9 ? "0" + number : number) + "</Name>\n";
+    item += "      <Manufacturer>Manus</Manufacturer>\n";
+    item += "      <Model>Model A</Model>\n";
+    item += "      <Owner>Owner A</Owner>\n";
+    item += "      <CivilCode>440300</CivilCode>\n";
+    item += "      <Block>Block A</Block>\n";
+    item += "      <Address>Address A</Address>\n";
+    item += "      <Parental>1</Parental>\n";
+    item += "      <ParentID>" + device.deviceId + "</ParentID>\n";
+    item += "      <RegisterWay>1</RegisterWay>\n";
+    item += "      <Secrecy>0</Secrecy>\n";
+    item += "      <Status>ON</Status>\n";
+    item += "      <Longitude>113.94</Longitude>\n";
+    item += "      <Latitude>22.55</Latitude>\n";
+    item += "      <StreamStatus>ON</StreamStatus>\n";
+    item += "    </Item>\n";
+    return item;
+}
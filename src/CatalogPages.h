@@ -0,0 +1,37 @@
+#ifndef CATALOG_PAGES_H
+#define CATALOG_PAGES_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+struct VirtualDevice;
+
+// Catalog response for one device, split into GB28181 pages (SumNum/Num) and
+// rendered once. Answering a query only splices the request's SN into each
+// pre-built page.
+class CatalogPages {
+public:
+    CatalogPages(const VirtualDevice& device, size_t itemsPerPage);
+
+    size_t pageCount() const { return pages_.size(); }
+
+    // Writes page "index" with sn filled in to out (replacing its contents)
+    void render(size_t index, std::string_view sn, std::string& out) const;
+
+    size_t maxPageSize() const { return maxPageSize_; }
+
+private:
+    static std::string renderItem(const VirtualDevice& device, size_t channel);
+
+    struct Page {
+        std::string head; // Everything up to and including "<SN>"
+        std::string tail; // From "</SN>" to the end
+    };
+
+    std::vector<Page> pages_;
+    size_t maxPageSize_;
+};
+
+#endif // CATALOG_PAGES_H
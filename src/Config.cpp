@@ -0,0 +1,213 @@
+#include "Config.h"
+#include <fstream>
+#include <cctype>
+#include <cstdio>
+
+namespace {
+const size_t GB_ID_LENGTH = 20;
+const size_t SERIAL_DIGITS = 7;
+const long SERIAL_LIMIT = 10000000;
+
+std::string trim(const std::string& text) {
+    size_t begin = 0;
+    size_t end = text.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) {
+        ++begin;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+        --end;
+    }
+    return text.substr(begin, end - begin);
+}
+
+// A '#' or ';' starts a comment at the beginning of a line or after
+// whitespace, so values such as passwords and URLs may contain them
+std::string stripComment(const std::string& line) {
+    for (size_t i = 0; i < line.size(); ++i) {
+        if ((line[i] == '#' || line[i] == ';') && (i == 0 || std::isspace(static_cast<unsigned char>(line[i - 1])))) {
+            return line.substr(0, i);
+        }
+    }
+    return line;
+}
+
+bool parseInt(const std::string& value, int& out) {
+    try {
+        size_t used = 0;
+        out = std::stoi(value, &used);
+        return used == value.size();
+    } catch (...) {
+        return false;
+    }
+}
+
+bool parseBool(const std::string& value, bool& out) {
+    if (value == "true" || value == "yes" || value == "1") {
+        out = true;
+    } else if (value == "false" || value == "no" || value == "0") {
+        out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseLogLevel(const std::string& value, int& out) {
+    static const char* const NAMES[] = {"debug", "info", "warn", "error"};
+    for (int level = 0; level < 4; ++level) {
+        if (value == NAMES[level]) {
+            out = level;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool isGbId(const std::string& id) {
+    if (id.size() != GB_ID_LENGTH) {
+        return false;
+    }
+    for (char c : id) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+bool loadConfig(const std::string& path, AppConfig& config, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::vector<DeviceTemplate> devices;
+    std::string section;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        std::string where = path + ":" + std::to_string(lineNumber) + ": ";
+        line = trim(stripComment(line));
+        if (line.empty()) {
+            continue;
+        }
+
+        if (line.front() == '[') {
+            if (line.back() != ']') {
+                error = where + "unterminated section header";
+                return false;
+            }
+            section = trim(line.substr(1, line.size() - 2));
+            if (section == "device") {
+                devices.emplace_back();
+            }
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            error = where + "expected key = value";
+            return false;
+        }
+        std::string key = trim(line.substr(0, eq));
+        std::string value = trim(line.substr(eq + 1));
+        bool ok = true;
+
+        if (section == "server") {
+            if (key == "ip") config.serverIp = value;
+            else if (key == "port") ok = parseInt(value, config.serverPort) && config.serverPort > 0 && config.serverPort < 65536;
+            else if (key == "realm") config.realm = value;
+            else if (key == "password") config.password = value;
+            else ok = false;
+        } else if (section == "local") {
+            if (key == "sip_port") ok = parseInt(value, config.sipPort) && config.sipPort > 0 && config.sipPort < 65536;
+            else if (key == "sip_workers") ok = parseInt(value, config.sipWorkers) && config.sipWorkers >= 0;
+            else if (key == "http_port") ok = parseInt(value, config.httpPort) && config.httpPort > 0 && config.httpPort < 65536;
+            else ok = false;
+        } else if (section == "register") {
+            if (key == "expires") ok = parseInt(value, config.registerExpires) && config.registerExpires > 0;
+            else if (key == "spread_ms") ok = parseInt(value, config.registerSpreadMs) && config.registerSpreadMs >= 0;
+            else if (key == "keepalive_interval") ok = parseInt(value, config.keepaliveInterval) && config.keepaliveInterval > 0;
+            else if (key == "retry_min_ms") ok = parseInt(value, config.registerRetryMinMs) && config.registerRetryMinMs > 0;
+            else if (key == "retry_max_ms") ok = parseInt(value, config.registerRetryMaxMs) && config.registerRetryMaxMs > 0;
+            else ok = false;
+        } else if (section == "media") {
+            if (key == "source") config.mediaSource = value;
+            else if (key == "rtp_port_first") ok = parseInt(value, config.rtpPortFirst) && config.rtpPortFirst > 0;
+            else if (key == "rtp_port_last") ok = parseInt(value, config.rtpPortLast) && config.rtpPortLast < 65536;
+            else if (key == "rtp_reuse_port") ok = parseBool(value, config.rtpReusePort);
+            else if (key == "sender_workers") ok = parseInt(value, config.senderWorkers) && config.senderWorkers >= 0;
+            else if (key == "egress_budget_kbps") ok = parseInt(value, config.egressBudgetKbps) && config.egressBudgetKbps >= 0;
+            else ok = false;
+        } else if (section == "recording") {
+            if (key == "dir") config.recordingDir = value;
+            else ok = false;
+        } else if (section == "catalog") {
+            if (key == "page_size") ok = parseInt(value, config.catalogPageSize) && config.catalogPageSize > 0;
+            else ok = false;
+        } else if (section == "stats") {
+            if (key == "latency_file") config.latencyFile = value;
+            else ok = false;
+        } else if (section == "log") {
+            if (key == "level") ok = parseLogLevel(value, config.logLevel);
+            else ok = false;
+        } else if (section == "device") {
+            DeviceTemplate& device = devices.back();
+            if (key == "first_id") device.firstId = value;
+            else if (key == "count") ok = parseInt(value, device.count);
+            else if (key == "channels") ok = parseInt(value, device.channels);
+            else if (key == "password") device.password = value;
+            else if (key == "media_source") device.mediaSource = value;
+            else ok = false;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            error = where + "invalid setting '" + key + "' in [" + section + "]";
+            return false;
+        }
+    }
+
+    if (config.rtpPortLast <= config.rtpPortFirst) {
+        error = path + ": rtp_port_last must be above rtp_port_first";
+        return false;
+    }
+
+    for (const DeviceTemplate& device : devices) {
+        if (!isGbId(device.firstId)) {
+            error = path + ": first_id " + device.firstId + " is not a 20-digit GB28181 ID";
+            return false;
+        }
+        long serial = std::stol(device.firstId.substr(GB_ID_LENGTH - SERIAL_DIGITS));
+        if (device.count < 1 || serial + device.count > SERIAL_LIMIT) {
+            error = path + ": count " + std::to_string(device.count) + " does not fit the serial range of " + device.firstId;
+            return false;
+        }
+        if (device.channels < 1) {
+            error = path + ": device " + device.firstId + " needs at least one channel";
+            return false;
+        }
+    }
+    if (!devices.empty()) {
+        config.devices = devices;
+    }
+    return true;
+}
+
+std::string generateDeviceId(const DeviceTemplate& deviceTemplate, int index) {
+    const std::string& first = deviceTemplate.firstId;
+    long serial = std::stol(first.substr(GB_ID_LENGTH - SERIAL_DIGITS)) + index;
+    char digits[SERIAL_DIGITS + 1];
+    snprintf(digits, sizeof(digits), "%07ld", serial);
+    return first.substr(0, GB_ID_LENGTH - SERIAL_DIGITS) + digits;
+}
+
+std::string generateChannelId(const std::string& deviceId, int index) {
+    char number[16];
+    snprintf(number, sizeof(number), "%02d", index + 1);
+    return deviceId + number;
+}
@@ -0,0 +1,70 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <vector>
+
+// A range of virtual devices generated from one template
+struct DeviceTemplate {
+    std::string firstId = "34020000001320000001"; // 20-digit GB28181 ID; the last 7 digits are incremented
+    int count = 1;
+    int channels = 1;
+    std::string password;    // Empty: use the server password
+    std::string mediaSource; // Empty: use the media default
+};
+
+struct AppConfig {
+    // [server] - the SIP platform we register with
+    std::string serverIp = "192.168.1.100";
+    int serverPort = 5060;
+    std::string realm = "3402000000";
+    std::string password = "admin123";
+
+    // [local]
+    int sipPort = 5060;
+    int sipWorkers = 4; // Threads running SIP handlers; 0 = one per core
+    int httpPort = 8080; // Web server: stream list, live playback, /metrics
+
+    // [register]
+    int registerExpires = 3600;
+    int registerSpreadMs = 10000;  // Initial REGISTERs are spread over this window
+    int keepaliveInterval = 60;    // Seconds
+    int registerRetryMinMs = 1000;  // Backoff after a failed REGISTER, doubling per failure
+    int registerRetryMaxMs = 60000;
+
+    // [media]
+    std::string mediaSource = "media/sample.h264";
+    int rtpPortFirst = 10000; // RTP/RTCP pairs are leased from [rtpPortFirst, rtpPortLast]
+    int rtpPortLast = 20000;
+    bool rtpReusePort = false; // SO_REUSEPORT on media sockets
+    int senderWorkers = 0;     // Threads sending RTP; 0 = one per core
+    int egressBudgetKbps = 0;  // RTP sent by the whole host; streams thin above it. 0 = unlimited
+
+    // [recording]
+    std::string recordingDir = "recordings"; // <dir>/<channel ID>/<YYYYmmddHHMMSS>.<ext>; empty disables
+
+    // [catalog]
+    int catalogPageSize = 4; // <Item>s per Catalog MESSAGE
+
+    // [stats]
+    std::string latencyFile = "latency-histograms.txt"; // Written at shutdown; empty disables
+
+    // [log]
+    int logLevel = 1; // 0 debug, 1 info, 2 warn, 3 error; debug needs a LOG_LEVEL=0 build
+
+    // [device] sections, one per template
+    std::vector<DeviceTemplate> devices;
+};
+
+// Reads an INI-style file ("[section]" headers, "key = value" lines, '#' or ';'
+// comments at the start of a line or after whitespace). Returns false and sets
+// error on malformed input.
+bool loadConfig(const std::string& path, AppConfig& config, std::string& error);
+
+// Expands template into "index"-th device ID (0-based)
+std::string generateDeviceId(const DeviceTemplate& deviceTemplate, int index);
+
+// Channel IDs are the device ID followed by a two-digit (or wider) channel number
+std::string generateChannelId(const std::string& deviceId, int index);
+
+#endif // CONFIG_H
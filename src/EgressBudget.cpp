@@ -0,0 +1,42 @@
+#include "EgressBudget.h"
+
+namespace {
+// Debt tolerated before thinning starts, and before only keyframes go out.
+// The first absorbs keyframe bursts; the second leaves room to recover.
+const int64_t BURST_NS = 200 * 1000000LL;
+const int64_t KEYFRAMES_ONLY_NS = 1000 * 1000000LL;
+}
+
+EgressBudget::EgressBudget(uint64_t bitsPerSecond)
+    : bitsPerSecond_(bitsPerSecond), epoch_(Clock::now()), theoreticalNs_(0) {
+}
+
+int64_t EgressBudget::toNanos(Clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch_).count();
+}
+
+Thinning EgressBudget::pressure(Clock::time_point now) const {
+    if (!limited()) {
+        return Thinning::None;
+    }
+    int64_t debt = theoreticalNs_.load(std::memory_order_relaxed) - toNanos(now);
+    if (debt < BURST_NS) {
+        return Thinning::None;
+    }
+    return debt < KEYFRAMES_ONLY_NS ? Thinning::NonReference : Thinning::KeyframesOnly;
+}
+
+void EgressBudget::charge(size_t bytes, Clock::time_point now) {
+    uint64_t bitsPerSecond = this->bitsPerSecond();
+    if (bitsPerSecond == 0) {
+        return;
+    }
+    int64_t cost = static_cast<int64_t>(bytes * 8 * 1000000000ULL / bitsPerSecond);
+    int64_t nowNs = toNanos(now);
+    int64_t current = theoreticalNs_.load(std::memory_order_relaxed);
+    int64_t next;
+    do {
+        // Idle time is not banked beyond the present
+        next = (current > nowNs ? current : nowNs) + cost;
+    } while (!theoreticalNs_.compare_exchange_weak(current, next, std::memory_order_relaxed));
+}
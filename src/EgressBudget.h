@@ -0,0 +1,43 @@
+#ifndef EGRESS_BUDGET_H
+#define EGRESS_BUDGET_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// How much of a stream to drop, mildest first
+enum class Thinning : uint8_t {
+    None,
+    NonReference,  // Frames no other frame predicts from
+    KeyframesOnly
+};
+
+// Host-wide media bandwidth budget shared by every sender worker. A GCRA
+// (virtual scheduling) meter: each send moves a theoretical arrival time
+// forward by the bytes' share of the budget, and how far that time runs ahead
+// of the clock tells streams how hard to thin. One atomic, no lock.
+class EgressBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // bitsPerSecond 0 means unlimited
+    explicit EgressBudget(uint64_t bitsPerSecond = 0);
+
+    bool limited() const { return bitsPerSecond() != 0; }
+    uint64_t bitsPerSecond() const { return bitsPerSecond_.load(std::memory_order_relaxed); }
+    // Takes effect from the next send; debt already run up is kept
+    void setBitsPerSecond(uint64_t bitsPerSecond) { bitsPerSecond_.store(bitsPerSecond, std::memory_order_relaxed); }
+
+    Thinning pressure(Clock::time_point now) const;
+    void charge(size_t bytes, Clock::time_point now);
+
+private:
+    int64_t toNanos(Clock::time_point time) const;
+
+    std::atomic<uint64_t> bitsPerSecond_;
+    Clock::time_point epoch_;
+    std::atomic<int64_t> theoreticalNs_; // Since epoch_
+};
+
+#endif // EGRESS_BUDGET_H
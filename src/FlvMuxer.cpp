@@ -0,0 +1,81 @@
+#include "FlvMuxer.h"
+
+namespace {
+const uint8_t FLV_TAG_VIDEO = 9;
+const uint8_t FLV_CODEC_AVC = 7;
+const uint8_t FLV_FRAME_KEY = 1;
+const uint8_t FLV_FRAME_INTER = 2;
+const uint8_t AVC_SEQUENCE_HEADER = 0;
+const uint8_t AVC_NALU = 1;
+const size_t FLV_TAG_HEADER_SIZE = 11;
+
+void put24(std::string& out, uint32_t value) {
+    out += static_cast<char>(value >> 16);
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value);
+}
+
+void put32(std::string& out, uint32_t value) {
+    out += static_cast<char>(value >> 24);
+    put24(out, value);
+}
+
+// Header of a VIDEODATA body; the composition time is signed 24-bit
+void videoHeader(std::string& out, uint8_t frameType, uint8_t packetType, int32_t compositionMs) {
+    out += static_cast<char>((frameType << 4) | FLV_CODEC_AVC);
+    out += static_cast<char>(packetType);
+    put24(out, static_cast<uint32_t>(compositionMs) & 0xFFFFFF);
+}
+}
+
+FlvMuxer::FlvMuxer(const H264Config& config)
+    : decoderConfig_(buildAvcDecoderConfig(config)) {
+}
+
+std::string FlvMuxer::header() const {
+    std::string out;
+    out.append("FLV", 3);
+    out += static_cast<char>(1);    // Version
+    out += static_cast<char>(0x01); // Video only
+    put32(out, 9);                  // Header size
+    put32(out, 0);                  // PreviousTagSize0
+
+    std::string body;
+    videoHeader(body, FLV_FRAME_KEY, AVC_SEQUENCE_HEADER, 0);
+    body += decoderConfig_;
+    writeTag(0, body, out);
+    return out;
+}
+
+void FlvMuxer::writeFrame(const uint8_t* data, size_t size, uint64_t pts90k, uint64_t dts90k, bool keyframe, std::string& out) const {
+    // The payload is written in place and the tag's DataSize patched afterwards
+    uint32_t timestampMs = static_cast<uint32_t>(dts90k / 90);
+    size_t tagStart = out.size();
+    out.reserve(tagStart + FLV_TAG_HEADER_SIZE + size + 16);
+    out += static_cast<char>(FLV_TAG_VIDEO);
+    put24(out, 0);
+    put24(out, timestampMs & 0xFFFFFF);
+    out += static_cast<char>(timestampMs >> 24);
+    put24(out, 0);
+
+    int32_t compositionMs = static_cast<int32_t>((static_cast<int64_t>(pts90k) - static_cast<int64_t>(dts90k)) / 90);
+    videoHeader(out, keyframe ? FLV_FRAME_KEY : FLV_FRAME_INTER, AVC_NALU, compositionMs);
+    annexBToLengthPrefixed(data, size, out);
+
+    uint32_t dataSize = static_cast<uint32_t>(out.size() - tagStart - FLV_TAG_HEADER_SIZE);
+    out[tagStart + 1] = static_cast<char>(dataSize >> 16);
+    out[tagStart + 2] = static_cast<char>(dataSize >> 8);
+    out[tagStart + 3] = static_cast<char>(dataSize);
+    put32(out, static_cast<uint32_t>(FLV_TAG_HEADER_SIZE + dataSize));
+}
+
+void FlvMuxer::writeTag(uint32_t timestampMs, const std::string& body, std::string& out) {
+    out.reserve(out.size() + FLV_TAG_HEADER_SIZE + body.size() + 4);
+    out += static_cast<char>(FLV_TAG_VIDEO);
+    put24(out, static_cast<uint32_t>(body.size()));
+    put24(out, timestampMs & 0xFFFFFF);
+    out += static_cast<char>(timestampMs >> 24); // TimestampExtended
+    put24(out, 0);                               // StreamID
+    out += body;
+    put32(out, static_cast<uint32_t>(FLV_TAG_HEADER_SIZE + body.size()));
+}
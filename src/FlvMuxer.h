@@ -0,0 +1,27 @@
+#ifndef FLV_MUXER_H
+#define FLV_MUXER_H
+
+#include <cstdint>
+#include <string>
+#include "AnnexB.h"
+
+// HTTP-FLV packaging of an H.264 elementary stream. The header (FLV header +
+// AVC sequence header tag) is written once per stream; each frame becomes one
+// self-contained video tag that can be handed to any number of viewers.
+class FlvMuxer {
+public:
+    explicit FlvMuxer(const H264Config& config);
+
+    // FLV file header followed by the AVCDecoderConfigurationRecord tag
+    std::string header() const;
+
+    // One video tag (plus its PreviousTagSize) for an Annex B access unit
+    void writeFrame(const uint8_t* data, size_t size, uint64_t pts90k, uint64_t dts90k, bool keyframe, std::string& out) const;
+
+private:
+    static void writeTag(uint32_t timestampMs, const std::string& body, std::string& out);
+
+    std::string decoderConfig_;
+};
+
+#endif // FLV_MUXER_H
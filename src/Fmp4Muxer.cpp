@@ -0,0 +1,238 @@
+#include "Fmp4Muxer.h"
+
+namespace {
+const uint32_t TIMESCALE = 90000;
+const uint32_t TRACK_ID = 1;
+
+// trun sample flags
+const uint32_t SAMPLE_SYNC = 0x02000000;     // sample_depends_on = 2 (no other samples)
+const uint32_t SAMPLE_NON_SYNC = 0x01010000; // sample_depends_on = 1, sample_is_non_sync_sample
+
+void put8(std::string& out, uint32_t value) {
+    out += static_cast<char>(value);
+}
+
+void put16(std::string& out, uint32_t value) {
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value);
+}
+
+void put32(std::string& out, uint32_t value) {
+    put16(out, value >> 16);
+    put16(out, value);
+}
+
+void put64(std::string& out, uint64_t value) {
+    put32(out, static_cast<uint32_t>(value >> 32));
+    put32(out, static_cast<uint32_t>(value));
+}
+
+void zeros(std::string& out, size_t count) {
+    out.append(count, '\0');
+}
+
+// Writes a box header with a placeholder size; endBox() patches it
+size_t beginBox(std::string& out, const char* type) {
+    size_t start = out.size();
+    put32(out, 0);
+    out.append(type, 4);
+    return start;
+}
+
+size_t beginFullBox(std::string& out, const char* type, uint8_t version, uint32_t flags) {
+    size_t start = beginBox(out, type);
+    put8(out, version);
+    put8(out, flags >> 16);
+    put16(out, flags);
+    return start;
+}
+
+void endBox(std::string& out, size_t start) {
+    uint32_t size = static_cast<uint32_t>(out.size() - start);
+    out[start] = static_cast<char>(size >> 24);
+    out[start + 1] = static_cast<char>(size >> 16);
+    out[start + 2] = static_cast<char>(size >> 8);
+    out[start + 3] = static_cast<char>(size);
+}
+
+void matrix(std::string& out) {
+    static const uint32_t UNITY[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+    for (uint32_t value : UNITY) {
+        put32(out, value);
+    }
+}
+
+// Empty sample table box; all samples live in fragments
+void emptyTable(std::string& out, const char* type) {
+    size_t box = beginFullBox(out, type, 0, 0);
+    put32(out, 0);
+    endBox(out, box);
+}
+}
+
+Fmp4Muxer::Fmp4Muxer(const H264Config& config)
+    : config_(config) {
+}
+
+std::string Fmp4Muxer::initSegment() const {
+    std::string out;
+    out.reserve(1024);
+
+    size_t ftyp = beginBox(out, "ftyp");
+    out.append("iso5", 4);
+    put32(out, 512);
+    out.append("iso5iso6mp41", 12);
+    endBox(out, ftyp);
+
+    size_t moov = beginBox(out, "moov");
+
+    size_t mvhd = beginFullBox(out, "mvhd", 0, 0);
+    put32(out, 0);            // creation_time
+    put32(out, 0);            // modification_time
+    put32(out, 1000);         // timescale
+    put32(out, 0);            // duration
+    put32(out, 0x00010000);   // rate
+    put16(out, 0x0100);       // volume
+    zeros(out, 10);
+    matrix(out);
+    zeros(out, 24);           // pre_defined
+    put32(out, TRACK_ID + 1); // next_track_ID
+    endBox(out, mvhd);
+
+    size_t trak = beginBox(out, "trak");
+    size_t tkhd = beginFullBox(out, "tkhd", 0, 0x000003); // Enabled, in movie
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, TRACK_ID);
+    put32(out, 0);
+    put32(out, 0);            // duration
+    zeros(out, 8);
+    put16(out, 0);            // layer
+    put16(out, 0);            // alternate_group
+    put16(out, 0);            // volume
+    put16(out, 0);
+    matrix(out);
+    put32(out, static_cast<uint32_t>(config_.width) << 16);
+    put32(out, static_cast<uint32_t>(config_.height) << 16);
+    endBox(out, tkhd);
+
+    size_t mdia = beginBox(out, "mdia");
+    size_t mdhd = beginFullBox(out, "mdhd", 0, 0);
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, TIMESCALE);
+    put32(out, 0);
+    put16(out, 0x55C4);       // Language "und"
+    put16(out, 0);
+    endBox(out, mdhd);
+
+    size_t hdlr = beginFullBox(out, "hdlr", 0, 0);
+    put32(out, 0);
+    out.append("vide", 4);
+    zeros(out, 12);
+    out.append("VideoHandler", 13); // Including the terminating NUL
+    endBox(out, hdlr);
+
+    size_t minf = beginBox(out, "minf");
+    size_t vmhd = beginFullBox(out, "vmhd", 0, 1);
+    zeros(out, 8);            // graphicsmode, opcolor
+    endBox(out, vmhd);
+
+    size_t dinf = beginBox(out, "dinf");
+    size_t dref = beginFullBox(out, "dref", 0, 0);
+    put32(out, 1);
+    size_t url = beginFullBox(out, "url ", 0, 1); // Media is in this file
+    endBox(out, url);
+    endBox(out, dref);
+    endBox(out, dinf);
+
+    size_t stbl = beginBox(out, "stbl");
+    size_t stsd = beginFullBox(out, "stsd", 0, 0);
+    put32(out, 1);
+    size_t avc1 = beginBox(out, "avc1");
+    zeros(out, 6);
+    put16(out, 1);            // data_reference_index
+    zeros(out, 16);           // pre_defined, reserved
+    put16(out, static_cast<uint32_t>(config_.width));
+    put16(out, static_cast<uint32_t>(config_.height));
+    put32(out, 0x00480000);   // 72 dpi
+    put32(out, 0x00480000);
+    put32(out, 0);
+    put16(out, 1);            // frame_count
+    zeros(out, 32);           // compressorname
+    put16(out, 0x0018);       // depth
+    put16(out, 0xFFFF);       // pre_defined = -1
+    size_t avcC = beginBox(out, "avcC");
+    out += buildAvcDecoderConfig(config_);
+    endBox(out, avcC);
+    endBox(out, avc1);
+    endBox(out, stsd);
+
+    emptyTable(out, "stts");
+    emptyTable(out, "stsc");
+    size_t stsz = beginFullBox(out, "stsz", 0, 0);
+    put32(out, 0);            // sample_size
+    put32(out, 0);            // sample_count
+    endBox(out, stsz);
+    emptyTable(out, "stco");
+    endBox(out, stbl);
+    endBox(out, minf);
+    endBox(out, mdia);
+    endBox(out, trak);
+
+    size_t mvex = beginBox(out, "mvex");
+    size_t trex = beginFullBox(out, "trex", 0, 0);
+    put32(out, TRACK_ID);
+    put32(out, 1);            // default_sample_description_index
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, 0);
+    endBox(out, trex);
+    endBox(out, mvex);
+
+    endBox(out, moov);
+    return out;
+}
+
+void Fmp4Muxer::writeFragment(const uint8_t* data, size_t size, uint64_t pts90k, uint64_t dts90k, uint32_t duration90k,
+                              bool keyframe, uint32_t sequence, std::string& out) const {
+    size_t moof = beginBox(out, "moof");
+    size_t mfhd = beginFullBox(out, "mfhd", 0, 0);
+    put32(out, sequence);
+    endBox(out, mfhd);
+
+    size_t traf = beginBox(out, "traf");
+    size_t tfhd = beginFullBox(out, "tfhd", 0, 0x020000); // default-base-is-moof
+    put32(out, TRACK_ID);
+    endBox(out, tfhd);
+
+    size_t tfdt = beginFullBox(out, "tfdt", 1, 0);
+    put64(out, dts90k);
+    endBox(out, tfdt);
+
+    // data-offset, duration, size, flags and (signed) composition offset present
+    size_t trun = beginFullBox(out, "trun", 1, 0x000F01);
+    put32(out, 1);            // sample_count
+    size_t dataOffset = out.size();
+    put32(out, 0);            // Patched below
+    put32(out, duration90k);
+    size_t sampleSize = out.size();
+    put32(out, 0);            // Patched below
+    put32(out, keyframe ? SAMPLE_SYNC : SAMPLE_NON_SYNC);
+    put32(out, static_cast<uint32_t>(static_cast<int32_t>(static_cast<int64_t>(pts90k) - static_cast<int64_t>(dts90k))));
+    endBox(out, trun);
+    endBox(out, traf);
+    endBox(out, moof);
+
+    size_t mdat = beginBox(out, "mdat");
+    annexBToLengthPrefixed(data, size, out);
+    endBox(out, mdat);
+
+    // Sample data starts right after the mdat header
+    uint32_t offset = static_cast<uint32_t>(mdat + 8 - moof);
+    uint32_t bytes = static_cast<uint32_t>(out.size() - mdat - 8);
+    for (int i = 0; i < 4; ++i) {
+        out[dataOffset + i] = static_cast<char>(offset >> (24 - 8 * i));
+        out[sampleSize + i] = static_cast<char>(bytes >> (24 - 8 * i));
+    }
+}
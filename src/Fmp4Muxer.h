@@ -0,0 +1,27 @@
+#ifndef FMP4_MUXER_H
+#define FMP4_MUXER_H
+
+#include <cstdint>
+#include <string>
+#include "AnnexB.h"
+
+// Fragmented MP4 (ISO BMFF) packaging of an H.264 elementary stream, one
+// video track on the 90 kHz clock. Every frame is its own moof+mdat fragment
+// so it can go out the moment it is read.
+class Fmp4Muxer {
+public:
+    explicit Fmp4Muxer(const H264Config& config);
+
+    // ftyp + moov, sent once before any fragment
+    std::string initSegment() const;
+
+    // moof + mdat for one Annex B access unit. sequence is the fragment
+    // sequence number (mfhd) and must increase per stream.
+    void writeFragment(const uint8_t* data, size_t size, uint64_t pts90k, uint64_t dts90k, uint32_t duration90k,
+                       bool keyframe, uint32_t sequence, std::string& out) const;
+
+private:
+    H264Config config_;
+};
+
+#endif // FMP4_MUXER_H
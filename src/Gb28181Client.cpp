@@ -1,26 +1,95 @@
 #include "Gb28181Client.h"
 #include <cstring>
-#include <libxml/parser.h>
-#include <libxml/tree.h>
-#include <osip2/osip_sdp.h>
+#include "Log.h"
+#include "ManscdpParser.h"
+#include <algorithm>
+#include <limits>
 #include <random>
-#include <cstdio> // For std::system
+#include <ctime>
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 // For generating a unique SN (sequence number)
 std::atomic<int> sn_counter(0);
 
-// Starting RTP port for dynamic allocation
-const int RTP_PORT_START = 10000;
-const int RTP_PORT_END = 20000;
+namespace {
+// Resolution of the REGISTER and keepalive schedule
+const std::chrono::milliseconds SCHEDULE_TICK(10);
+
+// Holds the eXosip context lock; required around API calls made outside the
+// event loop thread
+class ExosipLock {
+public:
+    explicit ExosipLock(eXosip_t* context) : context_(context) { eXosip_lock(context_); }
+    ~ExosipLock() { eXosip_unlock(context_); }
+    ExosipLock(const ExosipLock&) = delete;
+    ExosipLock& operator=(const ExosipLock&) = delete;
+
+private:
+    eXosip_t* context_;
+};
+
+// Appends text as XML character data; file names and the IDs the platform
+// sent may carry markup characters
+void appendEscaped(std::string& xml, std::string_view text) {
+    for (char c : text) {
+        switch (c) {
+            case '&': xml += "&amp;"; break;
+            case '<': xml += "&lt;"; break;
+            case '>': xml += "&gt;"; break;
+            case '"': xml += "&quot;"; break;
+            default: xml += c; break;
+        }
+    }
+}
+
+// Appends the XML prolog and the common <Response> header fields. Answers
+// carry the ID that was queried, which may be a channel of the device.
+void beginResponse(std::string& xml, std::string_view cmdType, const ManscdpMessage& message, const VirtualDevice& device) {
+    xml += "<?xml version=\"1.0\" encoding=\"GB2312\"?>\n";
+    xml += "<Response>\n";
+    xml += "  <CmdType>";
+    xml += cmdType;
+    xml += "</CmdType>\n";
+    xml += "  <SN>";
+    appendEscaped(xml, message.sn);
+    xml += "</SN>\n";
+    xml += "  <DeviceID>";
+    appendEscaped(xml, message.deviceId.empty() ? std::string_view(device.deviceId) : message.deviceId);
+    xml += "</DeviceID>\n";
+}
+
+// Local time as MANSCDP writes it, e.g. 2024-03-01T12:00:00
+std::string deviceTime() {
+    return formatDeviceTime(std::time(nullptr));
+}
+}
+
+const ManscdpDispatcher<Gb28181Client::MessageHandler> Gb28181Client::messageHandlers_ =
+    ManscdpDispatcher<Gb28181Client::MessageHandler>(&Gb28181Client::handleUnsupportedCommand)
+        .on(ManscdpCommand::Catalog, &Gb28181Client::handleCatalogQuery)
+        .on(ManscdpCommand::DeviceInfo, &Gb28181Client::handleDeviceInfoQuery)
+        .on(ManscdpCommand::DeviceStatus, &Gb28181Client::handleDeviceStatusQuery)
+        .on(ManscdpCommand::RecordInfo, &Gb28181Client::handleRecordInfoQuery)
+        .on(ManscdpCommand::DeviceControl, &Gb28181Client::handleDeviceControl)
+        .on(ManscdpCommand::ConfigDownload, &Gb28181Client::handleConfigDownload)
+        .on(ManscdpCommand::Alarm, &Gb28181Client::handleAlarm)
+        .on(ManscdpCommand::MobilePosition, &Gb28181Client::handleMobilePositionQuery);
+
+Gb28181Client::Gb28181Client(const AppConfig& config, StreamRegistry& registry)
+    : settings_(makeSettings(config)), registry_(registry), running_(false), context_(nullptr), wakeFd_(-1), eventWorkers_(static_cast<size_t>(config.sipWorkers)),
+      scheduleRng_(std::random_device{}()),
+      rtpPorts_(config.rtpPortFirst, config.rtpPortLast, config.rtpReusePort),
+      senderPool_(static_cast<size_t>(config.senderWorkers), static_cast<uint64_t>(config.egressBudgetKbps) * 1000), recordings_(config.recordingDir),
+      ptz_(std::make_unique<LoggingPtzDriver>()) {
 
-Gb28181Client::Gb28181Client(const std::string& serverIp, int serverPort, const std::string& deviceId, const std::string& realm, const std::string& password)
-    : serverIp_(serverIp), serverPort_(serverPort), deviceId_(deviceId), realm_(realm), password_(password), 
-      running_(false), context_(nullptr), registerId_(-1), nextRtpPort_(RTP_PORT_START) {
-    
     context_ = eXosip_malloc();
     if (eXosip_init(context_) != 0) {
-        std::cerr << "Failed to initialize eXosip context" << std::endl;
+        LOG_ERROR("Failed to initialize eXosip context");
     }
+    createDevices();
 }
 
 Gb28181Client::~Gb28181Client() {
@@ -30,110 +99,579 @@ Gb28181Client::~Gb28181Client() {
     }
 }
 
+std::shared_ptr<const Gb28181Client::Settings> Gb28181Client::makeSettings(const AppConfig& config) {
+    auto settings = std::make_shared<Settings>();
+    settings->config = config;
+    if (settings->config.devices.empty()) {
+        settings->config.devices.emplace_back(); // Single default device
+    }
+    settings->serverUri = "sip:" + config.serverIp + ":" + std::to_string(config.serverPort);
+    return settings;
+}
+
+const std::string& Gb28181Client::devicePassword(const AppConfig& config, const VirtualDevice& device) {
+    const DeviceTemplate& deviceTemplate = config.devices[device.templateIndex];
+    return deviceTemplate.password.empty() ? config.password : deviceTemplate.password;
+}
+
+const std::string& Gb28181Client::deviceMediaSource(const AppConfig& config, const VirtualDevice& device) {
+    const DeviceTemplate& deviceTemplate = config.devices[device.templateIndex];
+    return deviceTemplate.mediaSource.empty() ? config.mediaSource : deviceTemplate.mediaSource;
+}
+
+void Gb28181Client::createDevices() {
+    const AppConfig& config = settings_->config;
+    for (size_t index = 0; index < config.devices.size(); ++index) {
+        const DeviceTemplate& deviceTemplate = config.devices[index];
+        for (int i = 0; i < deviceTemplate.count; ++i) {
+            auto device = std::make_unique<VirtualDevice>();
+            device->deviceId = generateDeviceId(deviceTemplate, i);
+            device->templateIndex = index;
+            device->fromUri = "sip:" + device->deviceId + "@" + config.realm;
+            device->prepareKeepAlive();
+            for (int channel = 0; channel < deviceTemplate.channels; ++channel) {
+                device->channelIds.push_back(generateChannelId(device->deviceId, channel));
+            }
+
+            if (devicesById_.count(device->deviceId)) {
+                LOG_WARN("Duplicate device ID {} in configuration, skipped.", device->deviceId);
+                continue;
+            }
+            devicesById_[device->deviceId] = device.get();
+            ptz_.addChannel(device->deviceId);
+            for (const std::string& channelId : device->channelIds) {
+                devicesById_[channelId] = device.get();
+                ptz_.addChannel(channelId);
+            }
+            devices_.push_back(std::move(device));
+        }
+    }
+    LOG_INFO("GB28181: simulating {} device(s).", devices_.size());
+}
+
 void Gb28181Client::start() {
     if (!running_ && context_) {
-        if (eXosip_listen_addr(context_, IPPROTO_UDP, nullptr, 5060, AF_INET, 0) != 0) {
-            std::cerr << "Failed to listen on port 5060" << std::endl;
+        const AppConfig& config = settings_->config;
+        if (eXosip_listen_addr(context_, IPPROTO_UDP, nullptr, config.sipPort, AF_INET, 0) != 0) {
+            LOG_ERROR("Failed to listen on port {}", config.sipPort);
             return;
         }
 
-        running_ = true;
+        // The address our SDP answers advertise for media
+        char localIp[64] = {0};
+        if (eXosip_guess_localip(context_, AF_INET, localIp, sizeof(localIp)) == 0) {
+            localIp_ = localIp;
+        }
+
+        // Before the first REGISTER, so RecordInfo and Playback never see a partial store
+        recordings_.load();
+        // Demuxing and muxing a source takes a while; done here, the first
+        // INVITE for it finds it cached
+        loadMediaSources(config);
 
-        std::string from = "sip:" + deviceId_ + "@" + realm_;
-        std::string proxy = "sip:" + serverIp_ + ":" + std::to_string(serverPort_);
-        osip_message_t *reg = nullptr;
+        running_ = true;
 
-        registerId_ = eXosip_register_build_initial_register(context_, from.c_str(), proxy.c_str(), nullptr, 3600, &reg);
-        if (registerId_ > 0) {
-            eXosip_add_authentication_info(context_, deviceId_.c_str(), deviceId_.c_str(), password_.c_str(), nullptr, realm_.c_str());
-            eXosip_register_send_register(context_, registerId_, reg);
+        // Spread the initial REGISTERs evenly (plus jitter) over the configured
+        // window so thousands of devices don't hit the server at once.
+        {
+            std::lock_guard<std::mutex> lock(scheduleMutex_);
+            scheduleStart_ = std::chrono::steady_clock::now();
+            schedule_.reset(0);
+            int64_t step = devices_.empty() ? 0 : int64_t(config.registerSpreadMs) * 1000 / int64_t(devices_.size());
+            std::uniform_int_distribution<int64_t> jitter(0, step);
+            for (size_t i = 0; i < devices_.size(); ++i) {
+                auto offset = std::chrono::microseconds(int64_t(i) * step + jitter(scheduleRng_));
+                schedule_.schedule(scheduleTick(scheduleStart_ + offset),
+                                   ScheduledTask{devices_[i].get(), DeviceTask::Register, devices_[i]->registerEpoch});
+            }
         }
 
+        senderPool_.start();
+        ptz_.start();
+        eventWorkers_.start();
+        wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
         eventThread_ = std::thread(&Gb28181Client::eventLoop, this);
-        keepAliveThread_ = std::thread(&Gb28181Client::keepAliveLoop, this);
-        std::cout << "GB28181 Client started with eXosip2." << std::endl;
+        schedulerThread_ = std::thread(&Gb28181Client::schedulerLoop, this);
+        LOG_INFO("GB28181 Client started with eXosip2.");
     }
 }
 
 void Gb28181Client::stop() {
     if (running_) {
         running_ = false;
+        scheduleCv_.notify_all();
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
         if (eventThread_.joinable()) {
             eventThread_.join();
         }
-        if (keepAliveThread_.joinable()) {
-            keepAliveThread_.join();
+        eventWorkers_.stop(); // Lets handlers already queued finish
+        ptz_.stop();
+        close(wakeFd_);
+        wakeFd_ = -1;
+        if (schedulerThread_.joinable()) {
+            schedulerThread_.join();
         }
 
         // Stop all active RTP sessions
-        std::lock_guard<std::mutex> lock(rtpSessionsMutex_);
-        for (auto const& [callId, session] : rtpSessions_) {
-            session.stop(); // This will join the thread
+        {
+            TimedLockGuard lock(rtpSessionsMutex_, Metrics::RtpSessionsLockWaits, Metrics::RtpSessionsLockWaitNs);
+            for (auto& [callId, session] : rtpSessions_) {
+                session.stop();
+                registry_.unpublish(session.streamId);
+            }
+            Metrics::instance().add(Metrics::RtpSessions, -static_cast<int64_t>(rtpSessions_.size()));
+            rtpSessions_.clear();
+        }
+        senderPool_.stop();
+
+        LOG_INFO("GB28181 Client stopped.");
+    }
+}
+
+void Gb28181Client::reload(const AppConfig& config) {
+    std::shared_ptr<const Settings> current = settings();
+    const AppConfig& running = current->config;
+    AppConfig next = config;
+    if (next.devices.empty()) {
+        next.devices.emplace_back();
+    }
+
+    // Fixed by the constructor and start(); the new value is reported and dropped
+    auto keep = [](auto& value, const auto& runningValue, const char* name) {
+        if (value != runningValue) {
+            LOG_WARN("Config reload: {} changed, restart to apply", name);
+            value = runningValue;
+        }
+    };
+    keep(next.realm, running.realm, "[server] realm");
+    keep(next.sipPort, running.sipPort, "[local] sip_port");
+    keep(next.sipWorkers, running.sipWorkers, "[local] sip_workers");
+    keep(next.rtpPortFirst, running.rtpPortFirst, "[media] rtp_port_first");
+    keep(next.rtpPortLast, running.rtpPortLast, "[media] rtp_port_last");
+    keep(next.rtpReusePort, running.rtpReusePort, "[media] rtp_reuse_port");
+    keep(next.senderWorkers, running.senderWorkers, "[media] sender_workers");
+    keep(next.recordingDir, running.recordingDir, "[recording] dir");
+
+    // Devices are looked up without a lock, so the set of them is fixed; only
+    // the passwords and media sources of the same templates can change
+    bool sameDevices = next.devices.size() == running.devices.size();
+    for (size_t i = 0; sameDevices && i < next.devices.size(); ++i) {
+        const DeviceTemplate& a = next.devices[i];
+        const DeviceTemplate& b = running.devices[i];
+        sameDevices = a.firstId == b.firstId && a.count == b.count && a.channels == b.channels;
+    }
+    if (!sameDevices) {
+        LOG_WARN("Config reload: [device] sections changed, restart to apply");
+        next.devices = running.devices;
+    }
+
+    std::shared_ptr<const Settings> updated = makeSettings(next);
+    loadMediaSources(updated->config); // Before any INVITE can ask for a new source
+    std::atomic_store(&settings_, updated);
+
+    if (next.egressBudgetKbps != running.egressBudgetKbps) {
+        senderPool_.egressBudget().setBitsPerSecond(static_cast<uint64_t>(next.egressBudgetKbps) * 1000);
+    }
+
+    // Only devices whose registrar or credentials changed register again;
+    // the others keep their registration and their RTP sessions
+    bool serverChanged = updated->serverUri != current->serverUri;
+    std::vector<VirtualDevice*> affected;
+    for (const auto& device : devices_) {
+        if (next.catalogPageSize != running.catalogPageSize) {
+            std::atomic_store(&device->catalog, std::shared_ptr<const CatalogPages>());
+        }
+        if (serverChanged || devicePassword(next, *device) != devicePassword(running, *device)) {
+            affected.push_back(device.get());
+        }
+    }
+    if (running_) {
+        // Spread like the initial REGISTERs
+        int64_t step = affected.empty() ? 0 : int64_t(next.registerSpreadMs) * 1000 / int64_t(affected.size());
+        for (size_t i = 0; i < affected.size(); ++i) {
+            reRegister(*affected[i], std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::microseconds(int64_t(i) * step)));
+        }
+    }
+    LOG_INFO("GB28181: configuration reloaded, {} device(s) re-registering", affected.size());
+}
+
+void Gb28181Client::loadMediaSources(const AppConfig& config) {
+    std::vector<std::string> sources;
+    std::vector<std::shared_ptr<const MediaClip>> clips;
+    for (const DeviceTemplate& deviceTemplate : config.devices) {
+        const std::string& source = deviceTemplate.mediaSource.empty() ? config.mediaSource : deviceTemplate.mediaSource;
+        if (std::find(sources.begin(), sources.end(), source) != sources.end()) {
+            continue;
+        }
+        sources.push_back(source);
+        // A source that fails to load is reported by the cache and retried per INVITE
+        if (std::shared_ptr<const MediaClip> clip = MediaCache::instance().acquire(source)) {
+            clips.push_back(std::move(clip));
         }
-        rtpSessions_.clear();
+    }
+    // Sources still named stay loaded throughout; dropped ones go once their last session ends
+    mediaClips_.swap(clips);
+}
 
-        std::cout << "GB28181 Client stopped." << std::endl;
+void Gb28181Client::reRegister(VirtualDevice& device, std::chrono::milliseconds delay) {
+    {
+        // Forget the old registration; the next REGISTER starts a new one with
+        // the current server and credentials
+        ExosipLock lock(context_);
+        if (device.registerId > 0) {
+            eXosip_register_remove(context_, device.registerId);
+            eXosip_remove_authentication_info(context_, device.deviceId.c_str(), settings()->config.realm.c_str());
+            std::lock_guard<std::mutex> devicesLock(devicesMutex_);
+            devicesByRegisterId_.erase(device.registerId);
+            device.registerId = -1;
+        }
     }
+    device.registered = false;
+
+    std::lock_guard<std::mutex> lock(scheduleMutex_);
+    ++device.keepAliveEpoch;
+    ++device.registerEpoch;
+    device.registerFailures = 0;
+    device.challenged = false;
+    scheduleLocked(device, DeviceTask::Register, delay);
+    scheduleCv_.notify_one();
+}
+
+VirtualDevice* Gb28181Client::findDevice(const std::string& id) const {
+    auto it = devicesById_.find(id);
+    return it != devicesById_.end() ? it->second : nullptr;
+}
+
+VirtualDevice* Gb28181Client::findTargetDevice(osip_message_t* request) const {
+    // Requests are addressed to a device or one of its channels
+    if (request && request->req_uri && request->req_uri->username) {
+        if (VirtualDevice* device = findDevice(request->req_uri->username)) {
+            return device;
+        }
+    }
+    return devices_.size() == 1 ? devices_.front().get() : nullptr;
 }
 
 void Gb28181Client::eventLoop() {
+    // eXosip signals new events on its event socket, so an idle client sleeps
+    // in poll() until either SIP traffic or stop() wakes it
+    int eventSocket = eXosip_event_geteventsocket(context_);
+    if (eventSocket < 0) {
+        LOG_WARN("GB28181: No eXosip event socket, falling back to polling.");
+        while (running_) {
+            if (eXosip_event_t *ev = eXosip_event_wait(context_, 0, 50)) {
+                dispatchEvent(ev);
+            }
+        }
+        return;
+    }
+
+    pollfd fds[2] = {{eventSocket, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
     while (running_) {
-        eXosip_event_t *ev = eXosip_event_wait(context_, 0, 50);
-        if (!ev) {
-            continue;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("GB28181: poll failed: {}", strerror(errno));
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t value;
+            ssize_t ignored = read(wakeFd_, &value, sizeof(value));
+            (void)ignored;
+        }
+        // Drain every queued event. The call that finds the queue empty also
+        // consumes the pending wakeups on the event socket.
+        while (eXosip_event_t *ev = eXosip_event_wait(context_, 0, 0)) {
+            dispatchEvent(ev);
+        }
+    }
+}
+
+void Gb28181Client::dispatchEvent(eXosip_event_t* ev) {
+    // Handlers run on eventWorkers_; the event is freed when the last task
+    // holding it is done
+    std::shared_ptr<eXosip_event_t> event(ev, eXosip_event_free);
+    Metrics::instance().add(eventMetric(ev->type));
+
+    switch (ev->type) {
+        case EXOSIP_REGISTRATION_SUCCESS:
+        case EXOSIP_REGISTRATION_FAILURE:
+            eventWorkers_.post(eventKey(ev), [this, event] {
+                handleRegistration(event.get(), event->type == EXOSIP_REGISTRATION_SUCCESS);
+            });
+            break;
+        case EXOSIP_MESSAGE_NEW:
+            LOG_DEBUG("GB28181: New MESSAGE received");
+            eventWorkers_.post(eventKey(ev), [this, event] { handleMessage(event.get()); });
+            break;
+        case EXOSIP_MESSAGE_ANSWERED:
+            handleMessageAnswer(ev);
+            break;
+        case EXOSIP_CALL_INVITE: {
+            LOG_INFO("GB28181: New INVITE received (RealPlay request)");
+            // Startup latency is measured from here, so it includes time spent queued
+            auto received = std::chrono::steady_clock::now();
+            eventWorkers_.post(eventKey(ev), [this, event, received] { handleInvite(event.get(), received); });
+            break;
         }
+        case EXOSIP_CALL_ACK:
+            LOG_INFO("GB28181: Received ACK for call ID: {}", ev->cid);
+            eventWorkers_.post(eventKey(ev), [this, event] { handleAck(event.get()); });
+            break;
+        case EXOSIP_CALL_CLOSED:
+            LOG_INFO("GB28181: Call closed for call ID: {}", ev->cid);
+            eventWorkers_.post(eventKey(ev), [this, event] { handleBye(event.get()); });
+            break;
+        default:
+            LOG_DEBUG("GB28181: Received event type: {}", ev->type);
+            break;
+    }
+}
 
-        switch (ev->type) {
-            case EXOSIP_REGISTRATION_SUCCESS:
-                std::cout << "GB28181: Registration successful for " << deviceId_ << std::endl;
-                break;
-            case EXOSIP_REGISTRATION_FAILURE:
-                std::cerr << "GB28181: Registration failed for " << deviceId_ << std::endl;
-                break;
-            case EXOSIP_MESSAGE_NEW:
-                std::cout << "GB28181: New MESSAGE received" << std::endl;
-                handleMessage(ev);
-                break;
-            case EXOSIP_MESSAGE_ANSWERED:
-                handleMessageAnswer(ev);
-                break;
-            case EXOSIP_CALL_INVITE:
-                std::cout << "GB28181: New INVITE received (RealPlay request)" << std::endl;
-                handleInvite(ev);
-                break;
-            case EXOSIP_CALL_ACK:
-                std::cout << "GB28181: Received ACK for call ID: " << ev->cid << std::endl;
-                handleAck(ev);
-                break;
-            case EXOSIP_CALL_CLOSED:
-                std::cout << "GB28181: Call closed for call ID: " << ev->cid << std::endl;
-                handleBye(ev);
-                break;
-            default:
-                std::cout << "GB28181: Received event type: " << ev->type << std::endl;
-                break;
-        }
-        eXosip_event_free(ev);
-    }
-}
-
-void Gb28181Client::keepAliveLoop() {
+Metrics::Id Gb28181Client::eventMetric(int type) {
+    switch (type) {
+        case EXOSIP_REGISTRATION_SUCCESS: return Metrics::SipRegistrationSuccess;
+        case EXOSIP_REGISTRATION_FAILURE: return Metrics::SipRegistrationFailure;
+        case EXOSIP_MESSAGE_NEW: return Metrics::SipMessageNew;
+        case EXOSIP_MESSAGE_ANSWERED: return Metrics::SipMessageAnswered;
+        case EXOSIP_CALL_INVITE: return Metrics::SipCallInvite;
+        case EXOSIP_CALL_ACK: return Metrics::SipCallAck;
+        case EXOSIP_CALL_CLOSED: return Metrics::SipCallClosed;
+        default: return Metrics::SipOther;
+    }
+}
+
+uint64_t Gb28181Client::eventKey(const eXosip_event_t* ev) const {
+    // The top bits keep the key spaces apart
+    switch (ev->type) {
+        case EXOSIP_REGISTRATION_SUCCESS:
+        case EXOSIP_REGISTRATION_FAILURE:
+            return (uint64_t(1) << 62) | uint32_t(ev->rid);
+        case EXOSIP_MESSAGE_NEW:
+            // Commands for one device (e.g. a PTZ sequence) must not overtake each other
+            return (uint64_t(2) << 62) | reinterpret_cast<uintptr_t>(findTargetDevice(ev->request));
+        default:
+            return callKey(ev->cid);
+    }
+}
+
+uint64_t Gb28181Client::callKey(int callId) {
+    // INVITE, ACK and BYE of one call stay in order
+    return (uint64_t(3) << 62) | uint32_t(callId);
+}
+
+void Gb28181Client::handleRegistration(eXosip_event_t* ev, bool success) {
+    VirtualDevice* device = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(devicesMutex_);
+        auto it = devicesByRegisterId_.find(ev->rid);
+        if (it != devicesByRegisterId_.end()) {
+            device = it->second;
+        }
+    }
+    if (!device) {
+        LOG_WARN("GB28181: Registration event for unknown registration ID {}", ev->rid);
+        return;
+    }
+
+    if (!success) {
+        int status = ev->response ? osip_message_get_status_code(ev->response) : 0;
+        bool answerChallenge = false;
+        if (status == 401 || status == 407) {
+            std::lock_guard<std::mutex> lock(scheduleMutex_);
+            answerChallenge = !device->challenged;
+            device->challenged = true;
+        }
+        // The refreshed REGISTER carries the credentials for the challenge;
+        // a second challenge in a row means they were rejected
+        if (answerChallenge && sendRegister(*device)) {
+            return;
+        }
+        device->registered = false;
+        Metrics::instance().add(Metrics::RegisterFailures);
+        LOG_WARN("GB28181: Registration failed for {} ({})", device->deviceId, status);
+        scheduleRetry(*device);
+        return;
+    }
+
+    bool wasRegistered = device->registered.exchange(true);
+    LOG_INFO("GB28181: Registration successful for {}", device->deviceId);
+    std::shared_ptr<const Settings> settings = this->settings();
+
+    std::lock_guard<std::mutex> lock(scheduleMutex_);
+    device->registerFailures = 0;
+    device->challenged = false;
+    // Refresh well before expiry, spread so devices registered together don't refresh together
+    int64_t expiresMs = int64_t(std::max(1, settings->config.registerExpires)) * 1000;
+    std::uniform_int_distribution<int64_t> refresh(expiresMs * 3 / 4, expiresMs * 9 / 10);
+    ++device->registerEpoch;
+    scheduleLocked(*device, DeviceTask::Register, std::chrono::milliseconds(refresh(scheduleRng_)));
+
+    if (!wasRegistered) {
+        // First keepalive lands at a random point of the interval, which keeps
+        // the steady-state keepalive load flat across devices.
+        std::uniform_int_distribution<int> jitter(1, std::max(1, settings->config.keepaliveInterval) * 1000);
+        ++device->keepAliveEpoch;
+        scheduleLocked(*device, DeviceTask::KeepAlive, std::chrono::milliseconds(jitter(scheduleRng_)));
+    }
+    scheduleCv_.notify_one();
+}
+
+void Gb28181Client::scheduleRetry(VirtualDevice& device) {
+    std::shared_ptr<const Settings> settings = this->settings();
+    const AppConfig& config = settings->config;
+    std::lock_guard<std::mutex> lock(scheduleMutex_);
+    // Keepalives stop until the device is registered again
+    ++device.keepAliveEpoch;
+    ++device.registerEpoch;
+    device.challenged = false;
+
+    // Exponential backoff with jitter, so a server coming back up isn't hit
+    // by every device at once
+    int64_t ceiling = std::max(1, config.registerRetryMinMs);
+    for (int i = 0; i < device.registerFailures && ceiling < config.registerRetryMaxMs; ++i) {
+        ceiling *= 2;
+    }
+    ceiling = std::min<int64_t>(ceiling, std::max(config.registerRetryMaxMs, config.registerRetryMinMs));
+    ++device.registerFailures;
+    std::uniform_int_distribution<int64_t> backoff(ceiling / 2, ceiling);
+    scheduleLocked(device, DeviceTask::Register, std::chrono::milliseconds(backoff(scheduleRng_)));
+    scheduleCv_.notify_one();
+}
+
+uint64_t Gb28181Client::scheduleTick(std::chrono::steady_clock::time_point time) const {
+    if (time <= scheduleStart_) {
+        return 0;
+    }
+    return static_cast<uint64_t>((time - scheduleStart_) / SCHEDULE_TICK);
+}
+
+void Gb28181Client::scheduleLocked(VirtualDevice& device, DeviceTask task, std::chrono::milliseconds delay) {
+    uint32_t epoch = task == DeviceTask::Register ? device.registerEpoch : device.keepAliveEpoch;
+    // Rounded up so nothing fires early
+    schedule_.schedule(scheduleTick(std::chrono::steady_clock::now() + delay + SCHEDULE_TICK - std::chrono::nanoseconds(1)),
+                       ScheduledTask{&device, task, epoch});
+}
+
+bool Gb28181Client::sendRegister(VirtualDevice& device) {
+    std::shared_ptr<const Settings> settings = this->settings();
+    const AppConfig& config = settings->config;
+    ExosipLock lock(context_);
+    osip_message_t *reg = nullptr;
+    if (device.registerId > 0) {
+        // Refreshes and retries reuse the registration, which keeps its
+        // Call-ID and answers the last challenge with the stored credentials
+        if (eXosip_register_build_register(context_, device.registerId, config.registerExpires, &reg) != 0 || !reg) {
+            LOG_ERROR("GB28181: Failed to build REGISTER refresh for {}", device.deviceId);
+            return false;
+        }
+        return eXosip_register_send_register(context_, device.registerId, reg) == 0;
+    }
+
+    int registerId = eXosip_register_build_initial_register(context_, device.fromUri.c_str(), settings->serverUri.c_str(), nullptr, config.registerExpires, &reg);
+    if (registerId <= 0) {
+        LOG_ERROR("GB28181: Failed to build REGISTER for {}", device.deviceId);
+        return false;
+    }
+
+    device.registerId = registerId;
+    {
+        std::lock_guard<std::mutex> devicesLock(devicesMutex_);
+        devicesByRegisterId_[registerId] = &device;
+    }
+    eXosip_add_authentication_info(context_, device.deviceId.c_str(), device.deviceId.c_str(), devicePassword(config, device).c_str(), nullptr, config.realm.c_str());
+    return eXosip_register_send_register(context_, registerId, reg) == 0;
+}
+
+void Gb28181Client::sendManscdpRequest(const VirtualDevice& device, const std::string& xml) {
+    std::shared_ptr<const Settings> settings = this->settings();
+    ExosipLock lock(context_);
+    osip_message_t *message = nullptr;
+    eXosip_message_build_request(context_, &message, "MESSAGE", settings->serverUri.c_str(), device.fromUri.c_str(), nullptr);
+
+    if (message) {
+        osip_message_set_content_type(message, "Application/MANSCDP+xml");
+        osip_message_set_body(message, xml.c_str(), xml.length());
+        eXosip_message_send_request(context_, message);
+    }
+}
+
+void Gb28181Client::sendKeepAlive(VirtualDevice& device) {
+    std::string xml;
+    device.renderKeepAlive(std::to_string(++sn_counter), xml);
+    sendManscdpRequest(device, xml);
+}
+
+void Gb28181Client::sendCatalogResponse(VirtualDevice& device, std::string_view sn) {
+    std::shared_ptr<const CatalogPages> catalog = std::atomic_load(&device.catalog);
+    if (!catalog) {
+        // Two threads racing here both build identical pages; either result is fine
+        catalog = std::make_shared<CatalogPages>(device, static_cast<size_t>(settings()->config.catalogPageSize));
+        std::atomic_store(&device.catalog, catalog);
+    }
+
+    // All pages go out back to back without waiting for the platform's 200 OKs
+    std::string page;
+    page.reserve(catalog->maxPageSize());
+    for (size_t i = 0; i < catalog->pageCount(); ++i) {
+        catalog->render(i, sn, page);
+        sendManscdpRequest(device, page);
+    }
+    LOG_INFO("Sent Catalog response for {} in {} page(s).", device.deviceId, catalog->pageCount());
+}
+
+void Gb28181Client::schedulerLoop() {
+    // Single thread for every device's REGISTERs and keepalives. Due tasks
+    // are collected under the lock and sent outside it, one batch per tick.
+    std::vector<ScheduledTask> due;
+    std::unique_lock<std::mutex> lock(scheduleMutex_);
     while (running_) {
-        std::this_thread::sleep_for(std::chrono::seconds(60)); // Send keep-alive every 60 seconds
-        if (!running_) break;
+        schedule_.advance(scheduleTick(std::chrono::steady_clock::now()), [&](const ScheduledTask& task) {
+            uint32_t epoch = task.task == DeviceTask::Register ? task.device->registerEpoch : task.device->keepAliveEpoch;
+            if (task.epoch == epoch) {
+                due.push_back(task);
+            }
+        });
+        if (due.empty()) {
+            uint64_t next = schedule_.nextTick();
+            if (next == std::numeric_limits<uint64_t>::max()) {
+                scheduleCv_.wait(lock);
+            } else {
+                scheduleCv_.wait_until(lock, scheduleStart_ + SCHEDULE_TICK * next);
+            }
+            continue;
+        }
 
-        std::string from = "sip:" + deviceId_ + "@" + realm_;
-        std::string to = "sip:" + serverIp_ + ":" + std::to_string(serverPort_);
-        osip_message_t *keepalive_msg = nullptr;
-        eXosip_message_build_request(context_, &keepalive_msg, "MESSAGE", to.c_str(), from.c_str(), nullptr);
+        lock.unlock();
+        for (const ScheduledTask& task : due) {
+            runTask(task);
+        }
+        std::chrono::seconds keepaliveInterval(settings()->config.keepaliveInterval);
+        lock.lock();
 
-        if (keepalive_msg) {
-            std::string keepalive_xml = buildKeepAliveMessage();
-            osip_message_set_content_type(keepalive_msg, "Application/MANSCDP+xml");
-            osip_message_set_body(keepalive_msg, keepalive_xml.c_str(), keepalive_xml.length());
-            eXosip_message_send_request(context_, keepalive_msg);
-            std::cout << "Sent Keep-alive message." << std::endl;
+        for (const ScheduledTask& task : due) {
+            if (task.task == DeviceTask::KeepAlive && task.epoch == task.device->keepAliveEpoch) {
+                scheduleLocked(*task.device, DeviceTask::KeepAlive, keepaliveInterval);
+            }
         }
+        due.clear();
+    }
+}
+
+void Gb28181Client::runTask(const ScheduledTask& task) {
+    if (task.task == DeviceTask::KeepAlive) {
+        if (task.device->registered) {
+            sendKeepAlive(*task.device);
+        }
+        return;
+    }
+    // A REGISTER that never went out gets no answer to retry from
+    if (!sendRegister(*task.device)) {
+        scheduleRetry(*task.device);
     }
 }
 
@@ -143,296 +681,382 @@ void Gb28181Client::handleMessage(eXosip_event_t* ev) {
     }
 
     osip_message_t *request = ev->request;
+    VirtualDevice* device = findTargetDevice(request);
+    if (!device) {
+        LOG_WARN("GB28181: MESSAGE for unknown device, ignored.");
+        return;
+    }
     osip_body_t *body = nullptr;
     osip_message_get_body(request, 0, &body);
+    if (!body || !body->body) {
+        return;
+    }
 
-    if (body && body->body) {
-        std::string xmlContent(body->body);
-        std::cout << "Received XML: " << xmlContent << std::endl;
-
-        xmlDocPtr doc = xmlReadMemory(xmlContent.c_str(), xmlContent.length(), "noname.xml", nullptr, 0);
-        if (doc) {
-            xmlNodePtr root_element = xmlDocGetRootElement(doc);
-            if (root_element) {
-                std::string cmdType, sn, deviceId, ptzCmd;
-                xmlNodePtr current_node = root_element->children;
-                while (current_node) {
-                    if (xmlStrcmp(current_node->name, (const xmlChar *) "CmdType") == 0) {
-                        cmdType = (char*)xmlNodeGetContent(current_node);
-                    } else if (xmlStrcmp(current_node->name, (const xmlChar *) "SN") == 0) {
-                        sn = (char*)xmlNodeGetContent(current_node);
-                    } else if (xmlStrcmp(current_node->name, (const xmlChar *) "DeviceID") == 0) {
-                        deviceId = (char*)xmlNodeGetContent(current_node);
-                    } else if (xmlStrcmp(current_node->name, (const xmlChar *) "PTZCmd") == 0) {
-                        ptzCmd = (char*)xmlNodeGetContent(current_node);
-                    }
-                    current_node = current_node->next;
-                }
-
-                if (cmdType == "Catalog") {
-                    std::cout << "Received Catalog query." << std::endl;
-                    std::string responseXml = buildCatalogResponse(sn);
-                    osip_message_t *answer = nullptr;
-                    eXosip_message_build_answer(context_, request, 200, &answer);
-                    osip_message_set_content_type(answer, "Application/MANSCDP+xml");
-                    osip_message_set_body(answer, responseXml.c_str(), responseXml.length());
-                    eXosip_message_send_answer(context_, ev->tid, answer);
-                    std::cout << "Sent Catalog response." << std::endl;
-                } else if (cmdType == "DeviceControl") {
-                    std::cout << "Received DeviceControl (PTZ) command." << std::endl;
-                    handleDeviceControl(ev, cmdType, sn, deviceId, ptzCmd);
-                }
-            }
-            xmlFreeDoc(doc);
-        }
+    std::string_view xml(body->body, body->length);
+    LOG_DEBUG("Received XML: {}", xml);
+
+    // Known, flat commands are parsed in place; only documents the pull parser
+    // cannot handle pay for a libxml2 DOM
+    ManscdpMessage message;
+    std::string fallbackStorage;
+    ManscdpParseResult result = parseManscdp(xml, message);
+    if (result == ManscdpParseResult::Unsupported) {
+        result = parseManscdpDom(xml, message, fallbackStorage);
+    }
+    if (result != ManscdpParseResult::Ok) {
+        LOG_WARN("GB28181: Malformed MANSCDP body, ignored.");
+        return;
     }
-}
 
-void Gb28181Client::handleDeviceControl(eXosip_event_t* ev, const std::string& cmdType, const std::string& sn, const std::string& deviceId, const std::string& ptzCmd) {
-    // Decode and execute the PTZ command
-    decodeAndExecutePtzCmd(ptzCmd);
+    (this->*messageHandlers_.find(message.cmdType))(ev, *device, message);
+}
 
-    // Send 200 OK response
+void Gb28181Client::answerMessage(eXosip_event_t* ev, int status) {
+    ExosipLock lock(context_);
     osip_message_t *answer = nullptr;
-    eXosip_message_build_answer(context_, ev->request, 200, &answer);
+    eXosip_message_build_answer(context_, ev->request, status, &answer);
     eXosip_message_send_answer(context_, ev->tid, answer);
-    std::cout << "Sent 200 OK for DeviceControl." << std::endl;
 }
 
-void Gb28181Client::decodeAndExecutePtzCmd(const std::string& ptzCmd) {
-    if (ptzCmd.length() != 16) {
-        std::cerr << "Invalid PTZCmd length: " << ptzCmd.length() << std::endl;
-        return;
+void Gb28181Client::handleCatalogQuery(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message) {
+    LOG_INFO("Received Catalog query.");
+    // Acknowledge the query, then answer with Catalog MESSAGEs of our own
+    answerMessage(ev, 200);
+    sendCatalogResponse(device, message.sn);
+}
+
+void Gb28181Client::handleDeviceInfoQuery(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message) {
+    answerMessage(ev, 200);
+
+    std::string xml;
+    xml.reserve(512);
+    beginResponse(xml, "DeviceInfo", message, device);
+    xml += "  <DeviceName>Virtual Camera</DeviceName>\n";
+    xml += "  <Result>OK</Result>\n";
+    xml += "  <Manufacturer>Manus</Manufacturer>\n";
+    xml += "  <Model>Model A</Model>\n";
+    xml += "  <Firmware>V1.0</Firmware>\n";
+    xml += "  <Channel>" + std::to_string(device.channelIds.size()) + "</Channel>\n";
+    xml += "</Response>";
+    sendManscdpRequest(device, xml);
+}
+
+void Gb28181Client::handleDeviceStatusQuery(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message) {
+    answerMessage(ev, 200);
+
+    std::string xml;
+    xml.reserve(512);
+    beginResponse(xml, "DeviceStatus", message, device);
+    xml += "  <Result>OK</Result>\n";
+    xml += "  <Online>ONLINE</Online>\n";
+    xml += "  <Status>OK</Status>\n";
+    xml += "  <Encode>ON</Encode>\n";
+    xml += "  <Record>OFF</Record>\n";
+    xml += "  <DeviceTime>" + deviceTime() + "</DeviceTime>\n";
+    xml += "  <Alarmstatus Num=\"0\"></Alarmstatus>\n";
+    xml += "</Response>";
+    sendManscdpRequest(device, xml);
+}
+
+void Gb28181Client::handleRecordInfoQuery(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message) {
+    answerMessage(ev, 200);
+
+    std::string channelId(message.deviceId.empty() ? std::string_view(device.deviceId) : message.deviceId);
+    time_t start = parseDeviceTime(message.startTime);
+    time_t end = parseDeviceTime(message.endTime);
+    RecordingStore::RecordingList found = recordings_.find(channelId, start < 0 ? 0 : start,
+                                                           end < 0 ? std::numeric_limits<time_t>::max() : end);
+
+    // Long lists go out in pages like the Catalog, each with the full SumNum
+    size_t pageSize = static_cast<size_t>(settings()->config.catalogPageSize);
+    size_t pageCount = found.empty() ? 1 : (found.size() + pageSize - 1) / pageSize;
+    std::string xml;
+    for (size_t page = 0; page < pageCount; ++page) {
+        size_t first = page * pageSize;
+        size_t count = std::min(pageSize, found.size() - first);
+        xml.clear();
+        beginResponse(xml, "RecordInfo", message, device);
+        xml += "  <Name>Virtual Camera</Name>\n";
+        xml += "  <SumNum>" + std::to_string(found.size()) + "</SumNum>\n";
+        if (count == 0) {
+            xml += "  <RecordList Num=\"0\"></RecordList>\n";
+        } else {
+            xml += "  <RecordList Num=\"" + std::to_string(count) + "\">\n";
+            for (size_t i = first; i < first + count; ++i) {
+                const Recording& recording = *found[i];
+                xml += "    <Item>\n";
+                xml += "      <DeviceID>";
+                appendEscaped(xml, channelId);
+                xml += "</DeviceID>\n";
+                xml += "      <Name>";
+                appendEscaped(xml, recording.fileName);
+                xml += "</Name>\n";
+                xml += "      <FilePath>";
+                appendEscaped(xml, recording.fileName);
+                xml += "</FilePath>\n";
+                xml += "      <Address>Virtual Camera</Address>\n";
+                xml += "      <StartTime>" + formatDeviceTime(recording.startTime) + "</StartTime>\n";
+                xml += "      <EndTime>" + formatDeviceTime(recording.endTime) + "</EndTime>\n";
+                xml += "      <Secrecy>0</Secrecy>\n";
+                xml += "      <Type>time</Type>\n";
+                xml += "      <FileSize>" + std::to_string(recording.sizeBytes) + "</FileSize>\n";
+                xml += "    </Item>\n";
+            }
+            xml += "  </RecordList>\n";
+        }
+        xml += "</Response>";
+        sendManscdpRequest(device, xml);
     }
+}
 
-    // Example decoding of the PTZ command string (simplified)
-    // A1 0F 01 00 00 00 00 00
-    // Byte 4: Direction
-    // Byte 5: Horizontal Speed
-    // Byte 6: Vertical Speed
-    // Byte 7: Zoom Speed
+void Gb28181Client::handleConfigDownload(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message) {
+    answerMessage(ev, 200);
 
-    int byte4 = std::stoi(ptzCmd.substr(6, 2), nullptr, 16);
-    int byte5 = std::stoi(ptzCmd.substr(8, 2), nullptr, 16);
-    int byte6 = std::stoi(ptzCmd.substr(10, 2), nullptr, 16);
-    int byte7 = std::stoi(ptzCmd.substr(12, 2), nullptr, 16);
+    std::shared_ptr<const Settings> settings = this->settings();
+    std::string xml;
+    xml.reserve(512);
+    beginResponse(xml, "ConfigDownload", message, device);
+    xml += "  <Result>OK</Result>\n";
+    xml += "  <BasicParam>\n";
+    xml += "    <Name>Virtual Camera</Name>\n";
+    xml += "    <Expiration>" + std::to_string(settings->config.registerExpires) + "</Expiration>\n";
+    xml += "    <HeartBeatInterval>" + std::to_string(settings->config.keepaliveInterval) + "</HeartBeatInterval>\n";
+    xml += "    <HeartBeatCount>3</HeartBeatCount>\n";
+    xml += "  </BasicParam>\n";
+    xml += "</Response>";
+    sendManscdpRequest(device, xml);
+}
 
-    std::cout << "--- PTZ Command Decoded ---" << std::endl;
-    if (byte4 == 0) {
-        std::cout << "Action: STOP" << std::endl;
-    } else {
-        if (byte4 & 0x01) std::cout << "Action: TILT UP, Speed: " << byte6 << std::endl;
-        if (byte4 & 0x02) std::cout << "Action: TILT DOWN, Speed: " << byte6 << std::endl;
-        if (byte4 & 0x04) std::cout << "Action: PAN LEFT, Speed: " << byte5 << std::endl;
-        if (byte4 & 0x08) std::cout << "Action: PAN RIGHT, Speed: " << byte5 << std::endl;
-        if (byte4 & 0x10) std::cout << "Action: ZOOM IN, Speed: " << byte7 << std::endl;
-        if (byte4 & 0x20) std::cout << "Action: ZOOM OUT, Speed: " << byte7 << std::endl;
+void Gb28181Client::handleAlarm(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message) {
+    answerMessage(ev, 200);
+    if (message.root != "Query") {
+        return; // The platform's Response to an alarm we raised; nothing to do
     }
-    std::cout << "---------------------------" << std::endl;
 
-    // In a real application, you would send these commands to the actual camera hardware.
+    // Simulated devices never raise alarms
+    std::string xml;
+    xml.reserve(256);
+    beginResponse(xml, "Alarm", message, device);
+    xml += "  <Result>OK</Result>\n";
+    xml += "</Response>";
+    sendManscdpRequest(device, xml);
+}
+
+void Gb28181Client::handleMobilePositionQuery(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message) {
+    answerMessage(ev, 200);
+
+    std::string xml = "<?xml version=\"1.0\" encoding=\"GB2312\"?>\n";
+    xml.reserve(512);
+    xml += "<Notify>\n";
+    xml += "  <CmdType>MobilePosition</CmdType>\n";
+    xml += "  <SN>" + std::to_string(++sn_counter) + "</SN>\n";
+    xml += "  <DeviceID>";
+    appendEscaped(xml, message.deviceId.empty() ? std::string_view(device.deviceId) : message.deviceId);
+    xml += "</DeviceID>\n";
+    xml += "  <Time>" + deviceTime() + "</Time>\n";
+    xml += "  <Longitude>113.94</Longitude>\n";
+    xml += "  <Latitude>22.55</Latitude>\n";
+    xml += "  <Speed>0.0</Speed>\n";
+    xml += "  <Direction>0.0</Direction>\n";
+    xml += "  <Altitude>0</Altitude>\n";
+    xml += "</Notify>";
+    sendManscdpRequest(device, xml);
+}
+
+void Gb28181Client::handleUnsupportedCommand(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message) {
+    // Accept it so the platform stops retransmitting, but there is no answer to give
+    LOG_WARN("GB28181: Unsupported MANSCDP command {}/{} for {}", message.root, message.cmdType, device.deviceId);
+    answerMessage(ev, 200);
+}
+
+void Gb28181Client::handleDeviceControl(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message) {
+    // Other controls (TeleBoot, RecordCmd, GuardCmd, ...) are accepted without effect
+    if (!message.ptzCmd.empty()) {
+        PtzCommand command;
+        PtzDecodeResult result = decodePtzCmd(message.ptzCmd, command);
+        if (result != PtzDecodeResult::Ok) {
+            LOG_WARN("Invalid PTZCmd {} for {}: {}", message.ptzCmd, device.deviceId, toString(result));
+        } else {
+            // Handlers for one device run on one worker, so each channel's queue has a single producer
+            std::string_view channelId = message.deviceId.empty() ? std::string_view(device.deviceId) : message.deviceId;
+            if (!ptz_.submit(channelId, command)) {
+                LOG_WARN("PTZ command for {} dropped.", channelId);
+            }
+        }
+    }
+    answerMessage(ev, 200);
 }
 
 void Gb28181Client::handleMessageAnswer(eXosip_event_t* ev) {
     if (ev && ev->ack) {
         if (osip_message_get_status_code(ev->ack) == 200) {
-            std::cout << "Received 200 OK for MESSAGE (e.g., Keep-alive)." << std::endl;
+            LOG_DEBUG("Received 200 OK for MESSAGE (e.g., Keep-alive).");
         }
     }
 }
 
-void Gb28181Client::handleInvite(eXosip_event_t* ev) {
+void Gb28181Client::handleInvite(eXosip_event_t* ev, std::chrono::steady_clock::time_point received) {
     if (!ev || !ev->request) {
         return;
     }
 
     osip_message_t *request = ev->request;
+    VirtualDevice* device = findTargetDevice(request);
+    if (!device) {
+        LOG_WARN("INVITE for unknown device or channel.");
+        answerMessage(ev, 404); // Not Found
+        return;
+    }
+
     osip_body_t *body = nullptr;
     osip_message_get_body(request, 0, &body);
 
-    std::string remoteIp;
-    int remotePort = 0;
-    int localRtpPort = 0;
+    SdpOffer offer;
+    if (!body || !body->body || !parseSdpOffer(std::string_view(body->body, body->length), offer)) {
+        LOG_WARN("Failed to parse remote SDP.");
+        // Send error response
+        answerMessage(ev, 400); // Bad Request
+        return;
+    }
+    MediaTransport transport = offer.transport();
+    const std::string& remoteIp = offer.connectionIp;
+    int remotePort = offer.port;
+    LOG_DEBUG("Parsed SDP: {}, Remote IP = {}, Remote Port = {}, {}{}{}",
+              offer.sessionName.empty() ? "Play" : offer.sessionName.c_str(), remoteIp, remotePort, offer.proto,
+              offer.setup.empty() ? "" : " setup:", offer.setup);
+
+    // The stream is named after the channel asked for
+    const char* target = request->req_uri && request->req_uri->username ? request->req_uri->username : nullptr;
+    std::string channelId = target ? target : device->deviceId;
 
-    if (body && body->body) {
-        std::cout << "Received SDP: " << body->body << std::endl;
-        parseSdp(request, remoteIp, remotePort);
+    // Playback and Download name a time range in t=; serve the first recording in it
+    std::shared_ptr<const Recording> recording;
+    if (offer.sessionName == "Playback" || offer.sessionName == "Download") {
+        time_t start = static_cast<time_t>(offer.startTime);
+        time_t stop = offer.stopTime > offer.startTime ? static_cast<time_t>(offer.stopTime) : start + 1;
+        RecordingStore::RecordingList found = recordings_.find(channelId, start, stop);
+        if (found.empty()) {
+            LOG_WARN("No recording of {} between {} and {}", channelId, formatDeviceTime(start), formatDeviceTime(stop));
+            answerMessage(ev, 404); // Not Found
+            return;
+        }
+        recording = found.front();
     }
 
-    if (remotePort == 0) {
-        std::cerr << "Failed to parse remote SDP for RealPlay." << std::endl;
-        // Send error response
-        osip_message_t *answer = nullptr;
-        eXosip_message_build_answer(context_, request, 400, &answer); // Bad Request
-        eXosip_message_send_answer(context_, ev->tid, answer);
+    // RealPlay loops the device's media source, normally loaded already by
+    // start() or reload(); if not, this SIP worker loads it rather than a
+    // sender worker with other streams to send
+    std::shared_ptr<const MediaClip> clip =
+        recording ? recording->clip : MediaCache::instance().acquire(deviceMediaSource(settings()->config, *device));
+    if (!clip) {
+        LOG_ERROR("No media to send for {}", channelId);
+        answerMessage(ev, 500); // Server Internal Error
         return;
     }
 
-    localRtpPort = getAvailableRtpPort();
-    if (localRtpPort == 0) {
-        std::cerr << "Failed to get an available RTP port." << std::endl;
-        osip_message_t *answer = nullptr;
-        eXosip_message_build_answer(context_, request, 503, &answer); // Service Unavailable
-        eXosip_message_send_answer(context_, ev->tid, answer);
+    // Leased and bound before the answer advertises it
+    PortLease ports = rtpPorts_.acquire(offer.tcp());
+    if (!ports.valid()) {
+        LOG_ERROR("Failed to get an available RTP port.");
+        answerMessage(ev, 503); // Service Unavailable
         return;
     }
+    int localRtpPort = ports.rtpPort();
 
     // Build 200 OK with local SDP
-    osip_message_t *answer = nullptr;
-    eXosip_message_build_answer(context_, request, 200, &answer);
-    osip_message_set_content_type(answer, "Application/sdp");
+    std::string localSdp = buildSdpAnswer(offer, device->deviceId, localIp_.empty() ? offer.connectionIp : localIp_, transport,
+                                          localRtpPort, recording ? recording->clip->sizeBytes() : 0);
+    {
+        ExosipLock lock(context_);
+        osip_message_t *answer = nullptr;
+        eXosip_message_build_answer(context_, request, 200, &answer);
+        osip_message_set_content_type(answer, "Application/sdp");
+        osip_message_set_body(answer, localSdp.c_str(), localSdp.length());
+        eXosip_message_send_answer(context_, ev->tid, answer);
+    }
+    auto timeline = std::make_shared<SessionTimeline>(received);
+    timeline->mark(SessionTimeline::OkSent);
+    LOG_INFO("Sent 200 OK for {} INVITE. Local RTP Port: {}", recording ? offer.sessionName.c_str() : "RealPlay",
+             localRtpPort);
 
-    std::string localSdp = buildSdpAnswer(remoteIp, remotePort, localRtpPort); 
-    osip_message_set_body(answer, localSdp.c_str(), localSdp.length());
-    eXosip_message_send_answer(context_, ev->tid, answer);
-    std::cout << "Sent 200 OK for RealPlay INVITE. Local RTP Port: " << localRtpPort << std::endl;
+    // Publish the session; the stream ID names the channel asked for and the call
+    StreamInfo info;
+    info.deviceId = device->deviceId;
+    info.streamId = channelId + "_" + std::to_string(ev->cid);
+    std::shared_ptr<StreamStats> stats = registry_.publish(info, remoteIp + ":" + std::to_string(remotePort));
+    stats->viewers.store(1, std::memory_order_relaxed); // The platform that sent the INVITE
 
     // Create and store RtpSession
-    std::lock_guard<std::mutex> lock(rtpSessionsMutex_);
-    rtpSessions_.emplace(ev->cid, RtpSession(remoteIp, remotePort, localRtpPort, ev->cid));
-    RtpSession& currentSession = rtpSessions_.at(ev->cid);
-    currentSession.rtpThread = std::thread(&Gb28181Client::startRtpStream, this, ev->cid, remoteIp, remotePort, localRtpPort, std::ref(currentSession.running));
+    RtpSession session(remoteIp, remotePort, localRtpPort, ev->cid);
+    session.timeline = timeline;
+    session.streamId = info.streamId;
+    session.stream = startRtpStream(*device, channelId, ev->cid, offer, std::move(ports), std::move(clip), recording.get(), timeline,
+                                    std::move(stats));
+    TimedLockGuard lock(rtpSessionsMutex_, Metrics::RtpSessionsLockWaits, Metrics::RtpSessionsLockWaitNs);
+    if (rtpSessions_.insert_or_assign(ev->cid, std::move(session)).second) {
+        Metrics::instance().add(Metrics::RtpSessions);
+    }
 }
 
 void Gb28181Client::handleAck(eXosip_event_t* ev) {
-    std::cout << "ACK received for call ID: " << ev->cid << ". RTP stream should be active." << std::endl;
+    LOG_INFO("ACK received for call ID: {}. RTP stream should be active.", ev->cid);
+    TimedLockGuard lock(rtpSessionsMutex_, Metrics::RtpSessionsLockWaits, Metrics::RtpSessionsLockWaitNs);
+    auto it = rtpSessions_.find(ev->cid);
+    if (it != rtpSessions_.end() && it->second.timeline) {
+        it->second.timeline->mark(SessionTimeline::AckReceived);
+    }
 }
 
 void Gb28181Client::handleBye(eXosip_event_t* ev) {
-    std::lock_guard<std::mutex> lock(rtpSessionsMutex_);
+    TimedLockGuard lock(rtpSessionsMutex_, Metrics::RtpSessionsLockWaits, Metrics::RtpSessionsLockWaitNs);
     auto it = rtpSessions_.find(ev->cid);
     if (it != rtpSessions_.end()) {
-        it->second.stop(); // Stop the RTP thread and join it
+        it->second.stop(); // The sender pool releases the stream on its next tick
+        registry_.unpublish(it->second.streamId);
         rtpSessions_.erase(it);
-        std::cout << "RTP session for call ID " << ev->cid << " terminated." << std::endl;
+        Metrics::instance().add(Metrics::RtpSessions, -1);
+        LOG_INFO("RTP session for call ID {} terminated.", ev->cid);
     } else {
-        std::cerr << "Error: BYE received for unknown call ID: " << ev->cid << std::endl;
-    }
-}
-
-std::string Gb28181Client::buildCatalogResponse(const std::string& sn) {
-    std::string response = "<?xml version=\"1.0\" encoding=\"GB2312\"?>\n";
-    response += "<Response>\n";
-    response += "  <CmdType>Catalog</CmdType>\n";
-    response += "  <SN>" + sn + "</SN>\n";
-    response += "  <DeviceID>" + deviceId_ + "</DeviceID>\n";
-    response += "  <SumNum>1</SumNum>\n";
-    response += "  <DeviceList Num=\'1\'>\n";
-    response += "    <Item>\n";
-    response += "      <DeviceID>" + deviceId_ + "01</DeviceID>\n"; // Example channel ID
-    response += "      <Name>Camera 01</Name>\n";
-    response += "      <Manufacturer>Manus</Manufacturer>\n";
-    response += "      <Model>Model A</Model>\n";
-    response += "      <Owner>Owner A</Owner>\n";
-    response += "      <CivilCode>440300</CivilCode>\n";
-    response += "      <Block>Block A</Block>\n";
-    response += "      <Address>Address A</Address>\n";
-    response += "      <Parental>1</Parental>\n";
-    response += "      <ParentID>" + deviceId_ + "</ParentID>\n";
-    response += "      <RegisterWay>1</RegisterWay>\n";
-    response += "      <Secrecy>0</Secrecy>\n";
-    response += "      <Status>ON</Status>\n";
-    response += "      <Longitude>113.94</Longitude>\n";
-    response += "      <Latitude>22.55</Latitude>\n";
-    response += "      <StreamStatus>ON</StreamStatus>\n";
-    response += "    </Item>\n";
-    response += "  </DeviceList>\n";
-    response += "</Response>";
-    return response;
-}
-
-std::string Gb28181Client::buildKeepAliveMessage() {
-    int current_sn = ++sn_counter;
-    std::string xml = "<?xml version=\"1.0\"?>\n";
+        LOG_WARN("BYE received for unknown call ID: {}", ev->cid);
+    }
+}
+
+void Gb28181Client::sendMediaStatus(const VirtualDevice& device, const std::string& channelId) {
+    // NotifyType 121: the end of a Playback or Download file
+    std::string xml = "<?xml version=\"1.0\" encoding=\"GB2312\"?>\n";
     xml += "<Notify>\n";
-    xml += "  <CmdType>Keepalive</CmdType>\n";
-    xml += "  <SN>" + std::to_string(current_sn) + "</SN>\n";
-    xml += "  <DeviceID>" + deviceId_ + "</DeviceID>\n";
-    xml += "  <Status>OK</Status>\n";
+    xml += "  <CmdType>MediaStatus</CmdType>\n";
+    xml += "  <SN>" + std::to_string(++sn_counter) + "</SN>\n";
+    xml += "  <DeviceID>" + channelId + "</DeviceID>\n";
+    xml += "  <NotifyType>121</NotifyType>\n";
     xml += "</Notify>";
-    return xml;
+    sendManscdpRequest(device, xml);
 }
 
-void Gb28181Client::parseSdp(osip_message_t* sdpMessage, std::string& remoteIp, int& remotePort) {
-    osip_sdp_message_t *sdp = nullptr;
-    osip_message_get_sdp(sdpMessage, &sdp);
-
-    if (sdp) {
-        if (sdp->c_list.nb_elt > 0) {
-            osip_sdp_connection_t *c = (osip_sdp_connection_t*)osip_list_get_get(sdp->c_list, 0);
-            if (c && c->connection_address) {
-                remoteIp = c->connection_address;
-            }
-        }
-
-        if (sdp->m_list.nb_elt > 0) {
-            osip_sdp_media_t *m = (osip_sdp_media_t*)osip_list_get_get(sdp->m_list, 0);
-            if (m && m->port) {
-                remotePort = std::stoi(m->port);
-            }
-        }
-        osip_sdp_message_free(sdp);
-    }
-    std::cout << "Parsed SDP: Remote IP = " << remoteIp << ", Remote Port = " << remotePort << std::endl;
-}
-
-std::string Gb28181Client::buildSdpAnswer(const std::string& remoteIp, int remotePort, int localRtpPort) {
-    std::string sdp = "v=0\r\n";
-    sdp += "o-" + deviceId_ + " 0 0 IN IP4 " + remoteIp + "\r\n"; 
-    sdp += "s=Play\r\n";
-    sdp += "c=IN IP4 " + remoteIp + "\r\n"; 
-    sdp += "t=0 0\r\n";
-    sdp += "m=video " + std::to_string(localRtpPort) + " RTP/AVP 96\r\n"; // Use dynamic localRtpPort
-    sdp += "a=recvonly\r\n";
-    sdp += "a=rtpmap:96 PS/90000\r\n"; 
-    return sdp;
-}
-
-void Gb28181Client::startRtpStream(int callId, const std::string& remoteIp, int remotePort, int localRtpPort, std::atomic<bool>& runningFlag) {
-    std::cout << "RTP Stream (Call ID: " << callId << ") starting to " << remoteIp << ":" << remotePort 
-              << " from local port " << localRtpPort << std::endl;
-    
-    // This is a placeholder for actual RTP streaming logic.
-    // In a real implementation, you would open a UDP socket on localRtpPort,
-    // read video data, encapsulate it into RTP/PS packets, and send to remoteIp:remotePort.
-    // For demonstration, we simulate pushing a dummy stream using FFmpeg to ZLMediaKit.
-    
-    // Construct FFmpeg command to push a test stream to ZLMediaKit
-    // Note: ZLMediaKit should be running and configured to accept RTMP streams.
-    // The stream_id should be unique for each concurrent stream.
-    std::string streamId = deviceId_ + "_channel" + std::to_string(callId);
-    std::string rtmpUrl = zlMediaKitPushUrl_ + streamId;
-
-    // Example FFmpeg command: generate a test source and push as RTMP
-    // This command will run in a separate process and push a dummy video stream.
-    std::string ffmpegCmd = "ffmpeg -re -f lavfi -i testsrc=size=640x480:rate=30 -f lavfi -i sine=frequency=1000 -c:v libx264 -preset veryfast -tune zerolatency -c:a aac -ar 44100 -f flv " + rtmpUrl + " > /dev/null 2>&1";
-    
-    std::cout << "Executing FFmpeg command: " << ffmpegCmd << std::endl;
-
-    // Use a pipe to manage the FFmpeg process
-    FILE* pipe = popen(ffmpegCmd.c_str(), "w");
-    if (!pipe) {
-        std::cerr << "Failed to open pipe for FFmpeg command." << std::endl;
-        return;
-    }
-
-    while (runningFlag) {
-        // Keep the thread alive while FFmpeg is pushing. 
-        // In a real scenario, this loop would manage reading from camera and sending RTP.
-        std::this_thread::sleep_for(std::chrono::seconds(1)); 
-    }
-
-    // When streaming stops, close the FFmpeg process
-    pclose(pipe);
-    std::cout << "RTP Stream (Call ID: " << callId << ") stopped. FFmpeg process terminated." << std::endl;
-}
+std::shared_ptr<RtpStream> Gb28181Client::startRtpStream(const VirtualDevice& device, const std::string& channelId, int callId,
+                                                         const SdpOffer& offer, PortLease ports,
+                                                         std::shared_ptr<const MediaClip> clip, const Recording* recording,
+                                                         std::shared_ptr<SessionTimeline> timeline, std::shared_ptr<StreamStats> stats) {
+    auto stream = std::make_shared<RtpStream>(callId, offer.connectionIp, offer.port, std::move(ports), std::move(clip),
+                                              offer.transport(), offer.ssrcValue());
+    stream->setTimeline(std::move(timeline));
+    stream->setStats(std::move(stats));
+    stream->setCname(device.deviceId);
+    if (recording) {
+        PlaybackRange range;
+        range.begin90k = recording->toClip90k(static_cast<time_t>(offer.startTime));
+        range.end90k = offer.stopTime > offer.startTime ? recording->toClip90k(static_cast<time_t>(offer.stopTime))
+                                                        : recording->clip->duration90k();
+        range.download = offer.sessionName == "Download";
+        range.speed = range.download && offer.downloadSpeed > 0 ? offer.downloadSpeed : 1;
+        stream->setPlayback(range);
 
-int Gb28181Client::getAvailableRtpPort() {
-    int port = nextRtpPort_.fetch_add(2); 
-    if (port > RTP_PORT_END) {
-        nextRtpPort_ = RTP_PORT_START; 
-        port = nextRtpPort_.fetch_add(2);
-        if (port > RTP_PORT_END) return 0; 
+        // Runs on a sender worker; the notification goes out in order with the call's SIP events
+        const VirtualDevice* source = &device;
+        stream->setFinishedHandler([this, source, channelId, callId] {
+            eventWorkers_.post(callKey(callId), [this, source, channelId] { sendMediaStatus(*source, channelId); });
+        });
     }
-    return port;
+    senderPool_.add(stream);
+    return stream;
 }
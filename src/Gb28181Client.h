@@ -2,14 +2,31 @@
 #define GB28181_CLIENT_H
 
 #include <string>
+#include <string_view>
 #include <thread>
-#include <iostream>
 #include <chrono>
 #include <vector>
 #include <map>
 #include <mutex>
 #include <atomic>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <condition_variable>
 #include <eXosip2/eXosip2.h>
+#include "Config.h"
+#include "VirtualDevice.h"
+#include "ManscdpParser.h"
+#include "ManscdpDispatcher.h"
+#include "RtpSenderPool.h"
+#include "KeyedExecutor.h"
+#include "Metrics.h"
+#include "PortAllocator.h"
+#include "PtzController.h"
+#include "StreamRegistry.h"
+#include "RecordingStore.h"
+#include "Sdp.h"
+#include "TimerWheel.h"
 
 // Forward declaration for osip_message_t
 struct osip_message;
@@ -20,68 +37,143 @@ struct RtpSession {
     std::string remoteIp;
     int remotePort;
     int localRtpPort; // The local port this device will send RTP from
-    std::thread rtpThread; // Thread for actual RTP streaming
-    bool running; // Flag to control the RTP streaming thread
+    std::shared_ptr<RtpStream> stream; // Media side, driven by the shared RtpSenderPool
     int callId; // eXosip call ID for this session
+    std::string streamId; // Key in the StreamRegistry
+    std::shared_ptr<SessionTimeline> timeline; // Startup latency milestones
 
     RtpSession(std::string ip, int r_port, int l_port, int c_id) 
-        : remoteIp(std::move(ip)), remotePort(r_port), localRtpPort(l_port), running(true), callId(c_id) {}
+        : remoteIp(std::move(ip)), remotePort(r_port), localRtpPort(l_port), callId(c_id) {}
 
-    // Stop the RTP thread gracefully
+    // Ask the sender pool to drop the stream. Does not block.
     void stop() {
-        running = false;
-        if (rtpThread.joinable()) {
-            rtpThread.join();
+        if (stream) {
+            stream->stop();
         }
     }
 };
 
 class Gb28181Client {
 public:
-    Gb28181Client(const std::string& serverIp, int serverPort, const std::string& deviceId, const std::string& realm, const std::string& password);
+    // Simulates every device described by config over one SIP transport and
+    // publishes each RealPlay session to registry
+    Gb28181Client(const AppConfig& config, StreamRegistry& registry);
     ~Gb28181Client();
 
     void start();
     void stop();
+    // Applies a re-read configuration without dropping calls. REGISTER and
+    // keepalive timing, Catalog paging, media sources and the egress budget
+    // apply from the next REGISTER, query or INVITE; devices whose server or
+    // password changed register again. Settings only the constructor or
+    // start() can apply (ports, worker count, realm, the device list) are
+    // reported and keep their running values.
+    void reload(const AppConfig& config);
+
+    size_t deviceCount() const { return devices_.size(); }
+    const PortAllocator& rtpPorts() const { return rtpPorts_; }
 
 private:
+    // Work items for schedulerLoop
+    enum class DeviceTask {
+        Register, // Initial REGISTER, refresh or retry
+        KeepAlive
+    };
+    struct ScheduledTask {
+        VirtualDevice* device;
+        DeviceTask task;
+        uint32_t epoch; // Stale once the device's epoch for task has moved on
+    };
+
+    // The configuration in effect, replaced as a whole by reload(). Readers
+    // take it with settings() and keep the snapshot for the whole operation.
+    struct Settings {
+        AppConfig config; // devices is never empty
+        std::string serverUri; // sip:<serverIp>:<serverPort>
+    };
+    std::shared_ptr<const Settings> settings() const { return std::atomic_load(&settings_); }
+    static std::shared_ptr<const Settings> makeSettings(const AppConfig& config);
+    static const std::string& devicePassword(const AppConfig& config, const VirtualDevice& device);
+    static const std::string& deviceMediaSource(const AppConfig& config, const VirtualDevice& device);
+    void reRegister(VirtualDevice& device, std::chrono::milliseconds delay);
+
+    void createDevices();
     void eventLoop();
-    void keepAliveLoop();
+    void dispatchEvent(eXosip_event_t* ev);
+    static Metrics::Id eventMetric(int type);
+    uint64_t eventKey(const eXosip_event_t* ev) const;
+    static uint64_t callKey(int callId);
+    void schedulerLoop();
+    void runTask(const ScheduledTask& task);
+    uint64_t scheduleTick(std::chrono::steady_clock::time_point time) const;
+    void scheduleLocked(VirtualDevice& device, DeviceTask task, std::chrono::milliseconds delay);
+    void scheduleRetry(VirtualDevice& device);
+    void handleRegistration(eXosip_event_t* ev, bool success);
     void handleMessage(eXosip_event_t* ev);
-    void handleInvite(eXosip_event_t* ev);
+    void handleInvite(eXosip_event_t* ev, std::chrono::steady_clock::time_point received);
     void handleAck(eXosip_event_t* ev);
     void handleBye(eXosip_event_t* ev);
     void handleMessageAnswer(eXosip_event_t* ev);
 
-    std::string buildCatalogResponse(const std::string& sn);
-    std::string buildSdpAnswer(const std::string& remoteIp, int remotePort, int localRtpPort);
-    std::string buildKeepAliveMessage();
-    void parseSdp(osip_message_t* sdpMessage, std::string& remoteIp, int& remotePort);
-    void startRtpStream(int callId, const std::string& remoteIp, int remotePort, int localRtpPort, std::atomic<bool>& runningFlag);
-    int getAvailableRtpPort();
-
-    // PTZ control functions
-    void handleDeviceControl(eXosip_event_t* ev, const std::string& cmdType, const std::string& sn, const std::string& deviceId, const std::string& ptzCmd);
-    void decodeAndExecutePtzCmd(const std::string& ptzCmd);
-
-    std::string serverIp_;
-    int serverPort_;
-    std::string deviceId_;
-    std::string realm_;
-    std::string password_;
-    
-    bool running_;
+    VirtualDevice* findDevice(const std::string& id) const;
+    VirtualDevice* findTargetDevice(osip_message_t* request) const;
+    bool sendRegister(VirtualDevice& device);
+    void sendKeepAlive(VirtualDevice& device);
+    void sendManscdpRequest(const VirtualDevice& device, const std::string& xml);
+    void sendCatalogResponse(VirtualDevice& device, std::string_view sn);
+    void sendMediaStatus(const VirtualDevice& device, const std::string& channelId);
+    // Loops clip, or sends the offer's range of recording (whose clip it is)
+    std::shared_ptr<RtpStream> startRtpStream(const VirtualDevice& device, const std::string& channelId, int callId,
+                                              const SdpOffer& offer, PortLease ports, std::shared_ptr<const MediaClip> clip,
+                                              const Recording* recording, std::shared_ptr<SessionTimeline> timeline,
+                                              std::shared_ptr<StreamStats> stats);
+    // Loads every media source config names and keeps them cached until the next call
+    void loadMediaSources(const AppConfig& config);
+
+    // MANSCDP command handlers, one per CmdType
+    using MessageHandler = void (Gb28181Client::*)(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message);
+    static const ManscdpDispatcher<MessageHandler> messageHandlers_;
+
+    void answerMessage(eXosip_event_t* ev, int status);
+    void handleCatalogQuery(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message);
+    void handleDeviceInfoQuery(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message);
+    void handleDeviceStatusQuery(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message);
+    void handleRecordInfoQuery(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message);
+    void handleConfigDownload(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message);
+    void handleAlarm(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message);
+    void handleMobilePositionQuery(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message);
+    void handleUnsupportedCommand(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message);
+    void handleDeviceControl(eXosip_event_t* ev, VirtualDevice& device, const ManscdpMessage& message);
+
+    std::shared_ptr<const Settings> settings_; // Access with std::atomic_load/store
+    StreamRegistry& registry_;
+    std::string localIp_;   // Advertised in SDP answers; guessed on start()
+
+    std::atomic<bool> running_;
     eXosip_t* context_;
-    int registerId_;
-    std::thread eventThread_;
-    std::thread keepAliveThread_;
+    int wakeFd_; // eventfd that interrupts the event loop's poll() on stop()
+    std::thread eventThread_; // Receives and classifies SIP events only
+    KeyedExecutor eventWorkers_; // Runs the handlers, ordered per call / device
+    std::thread schedulerThread_; // REGISTERs and keepalives of every device
+
+    std::vector<std::unique_ptr<VirtualDevice>> devices_;
+    std::unordered_map<std::string, VirtualDevice*> devicesById_; // Device and channel IDs; fixed after construction
+    std::unordered_map<int, VirtualDevice*> devicesByRegisterId_;
+    std::mutex devicesMutex_; // Guards devicesByRegisterId_, filled in as REGISTERs go out
 
+    HierarchicalTimerWheel<ScheduledTask> schedule_; // SCHEDULE_TICK ticks since scheduleStart_
+    std::chrono::steady_clock::time_point scheduleStart_;
+    std::mt19937 scheduleRng_; // Jitter and backoff
+    std::mutex scheduleMutex_; // Guards schedule_, scheduleRng_ and the devices' scheduling state
+    std::condition_variable scheduleCv_;
+
+    PortAllocator rtpPorts_; // RTP/RTCP pairs; each RtpStream holds its lease, so declared first
     std::map<int, RtpSession> rtpSessions_; // Map callId to RtpSession
     std::mutex rtpSessionsMutex_; // Mutex for protecting rtpSessions_
-    std::atomic<int> nextRtpPort_; // For dynamic RTP port allocation
-
-    // Placeholder for ZLMediaKit push URL
-    std::string zlMediaKitPushUrl_ = "rtmp://127.0.0.1/live/stream_id"; // Example URL
+    RtpSenderPool senderPool_; // Sends RTP for all sessions
+    RecordingStore recordings_; // Loaded on start(), read-only afterwards
+    PtzController ptz_; // Runs DeviceControl PTZ commands off the SIP workers
+    std::vector<std::shared_ptr<const MediaClip>> mediaClips_; // Held so the MediaCache keeps them; start() and reload() only
 };
 
 #endif // GB28181_CLIENT_H
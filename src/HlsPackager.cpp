@@ -0,0 +1,167 @@
+#include "HlsPackager.h"
+
+namespace {
+const size_t MAX_SEGMENTS = 6;      // Complete segments kept in the ring
+const size_t SEGMENTS_WITH_PARTS = 2; // Complete segments that still list their parts
+
+// Seconds with millisecond precision, e.g. "0.480"
+void appendSeconds(std::string& out, uint64_t duration90k) {
+    uint64_t ms = (duration90k + 45) / 90;
+    out += std::to_string(ms / 1000);
+    out += '.';
+    uint64_t fraction = ms % 1000;
+    out += static_cast<char>('0' + fraction / 100);
+    out += static_cast<char>('0' + fraction / 10 % 10);
+    out += static_cast<char>('0' + fraction % 10);
+}
+}
+
+HlsPackager::HlsPackager(const std::string& uriPrefix, Buffer initSegment, uint32_t segmentTargetMs,
+                         uint32_t partTargetMs)
+    : uriPrefix_(uriPrefix), init_(std::move(initSegment)),
+      segmentTarget90k_(static_cast<uint64_t>(segmentTargetMs) * 90),
+      partTarget90k_(static_cast<uint64_t>(partTargetMs) * 90),
+      targetDuration_((segmentTargetMs + 999) / 1000) {
+    segments_.emplace_back();
+    renderPlaylist();
+}
+
+bool HlsPackager::addFrame(Buffer fragment, uint32_t duration90k, bool keyframe) {
+    bool changed = false;
+
+    Segment& open = segments_.back();
+    if (keyframe && open.duration90k + building_.duration90k >= segmentTarget90k_) {
+        if (!building_.fragments.empty()) {
+            finishPart();
+        }
+        finishSegment();
+        changed = true;
+    }
+
+    if (building_.fragments.empty()) {
+        building_.independent = keyframe;
+    }
+    building_.fragments.push_back(std::move(fragment));
+    building_.duration90k += duration90k;
+
+    // Publish as soon as one more frame would not fit, rather than a frame late
+    if (building_.duration90k + duration90k > partTarget90k_) {
+        finishPart();
+        changed = true;
+    }
+
+    if (changed) {
+        renderPlaylist();
+    }
+    return changed;
+}
+
+bool HlsPackager::hasPart(uint64_t sequence, int64_t part) const {
+    if (sequence < segments_.front().sequence) {
+        return true; // Already behind the live edge
+    }
+    const Segment* segment = findSegment(sequence);
+    if (!segment) {
+        return false;
+    }
+    return segment->complete || (part >= 0 && segment->parts.size() > static_cast<size_t>(part));
+}
+
+bool HlsPackager::isUpcomingPart(uint64_t sequence, size_t part) const {
+    const Segment& open = segments_.back();
+    return (sequence == open.sequence && part == open.parts.size()) || (sequence == open.sequence + 1 && part == 0);
+}
+
+bool HlsPackager::segment(uint64_t sequence, std::vector<Buffer>& out) const {
+    const Segment* segment = findSegment(sequence);
+    if (!segment || !segment->complete) {
+        return false;
+    }
+    for (const auto& part : segment->parts) {
+        out.insert(out.end(), part->fragments.begin(), part->fragments.end());
+    }
+    return true;
+}
+
+bool HlsPackager::part(uint64_t sequence, size_t part, std::vector<Buffer>& out) const {
+    const Segment* segment = findSegment(sequence);
+    if (!segment || part >= segment->parts.size()) {
+        return false;
+    }
+    const auto& fragments = segment->parts[part]->fragments;
+    out.insert(out.end(), fragments.begin(), fragments.end());
+    return true;
+}
+
+const HlsPackager::Segment* HlsPackager::findSegment(uint64_t sequence) const {
+    uint64_t first = segments_.front().sequence;
+    if (sequence < first || sequence - first >= segments_.size()) {
+        return nullptr;
+    }
+    return &segments_[static_cast<size_t>(sequence - first)];
+}
+
+void HlsPackager::finishPart() {
+    Segment& open = segments_.back();
+    open.duration90k += building_.duration90k;
+    open.parts.push_back(std::make_shared<const Part>(std::move(building_)));
+    building_ = Part();
+}
+
+void HlsPackager::finishSegment() {
+    Segment& open = segments_.back();
+    open.complete = true;
+    // Long GOPs make segments longer than the target; the tag has to cover them
+    uint32_t seconds = static_cast<uint32_t>((open.duration90k + 45000) / 90000);
+    if (seconds > targetDuration_) {
+        targetDuration_ = seconds;
+    }
+
+    uint64_t next = open.sequence + 1;
+    segments_.emplace_back();
+    segments_.back().sequence = next;
+    while (segments_.size() > MAX_SEGMENTS + 1) {
+        segments_.pop_front();
+    }
+}
+
+void HlsPackager::renderPlaylist() {
+    auto playlist = std::make_shared<std::string>();
+    playlist->reserve(256 + segments_.size() * 64 + (SEGMENTS_WITH_PARTS + 1) * 8 * 80);
+
+    *playlist += "#EXTM3U\n#EXT-X-VERSION:9\n#EXT-X-INDEPENDENT-SEGMENTS\n#EXT-X-TARGETDURATION:";
+    *playlist += std::to_string(targetDuration_);
+    *playlist += "\n#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=";
+    appendSeconds(*playlist, partTarget90k_ * 3);
+    *playlist += "\n#EXT-X-PART-INF:PART-TARGET=";
+    appendSeconds(*playlist, partTarget90k_);
+    *playlist += "\n#EXT-X-MEDIA-SEQUENCE:";
+    *playlist += std::to_string(segments_.front().sequence);
+    *playlist += "\n#EXT-X-MAP:URI=\"" + uriPrefix_ + "init.mp4\"\n";
+
+    size_t partsFrom = segments_.size() > SEGMENTS_WITH_PARTS + 1 ? segments_.size() - SEGMENTS_WITH_PARTS - 1 : 0;
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        const Segment& segment = segments_[i];
+        std::string sequence = std::to_string(segment.sequence);
+        if (i >= partsFrom) {
+            for (size_t p = 0; p < segment.parts.size(); ++p) {
+                *playlist += "#EXT-X-PART:DURATION=";
+                appendSeconds(*playlist, segment.parts[p]->duration90k);
+                *playlist += ",URI=\"" + uriPrefix_ + sequence + "." + std::to_string(p) + ".m4s\"";
+                if (segment.parts[p]->independent) {
+                    *playlist += ",INDEPENDENT=YES";
+                }
+                *playlist += '\n';
+            }
+        }
+        if (segment.complete) {
+            *playlist += "#EXTINF:";
+            appendSeconds(*playlist, segment.duration90k);
+            *playlist += ",\n" + uriPrefix_ + sequence + ".m4s\n";
+        } else {
+            *playlist += "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"" + uriPrefix_ + sequence + "." +
+                         std::to_string(segment.parts.size()) + ".m4s\"\n";
+        }
+    }
+    playlist_ = std::move(playlist);
+}
@@ -0,0 +1,85 @@
+#ifndef HLS_PACKAGER_H
+#define HLS_PACKAGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// LL-HLS (RFC 8216bis) packaging in memory. Input is the stream's per-frame
+// fMP4 fragments; CMAF parts and segments are just runs of those fragments, so
+// nothing is copied and a segment is served with one writev of shared
+// buffers. Segments are cut at keyframes once the target duration is reached,
+// parts whenever the next frame would overrun the part target. A bounded ring
+// of segments is kept and the playlist is re-rendered once per new part, so
+// every client is answered from the same immutable string.
+//
+// URIs in the playlist are relative to it: "<prefix>init.mp4",
+// "<prefix><msn>.m4s" and "<prefix><msn>.<part>.m4s".
+//
+// Not thread-safe; driven by the WebServer thread through LiveStream.
+class HlsPackager {
+public:
+    using Buffer = std::shared_ptr<const std::string>;
+
+    HlsPackager(const std::string& uriPrefix, Buffer initSegment, uint32_t segmentTargetMs = 2000,
+                uint32_t partTargetMs = 500);
+
+    // Adds one frame's moof+mdat. Returns true if a part was completed, i.e.
+    // the playlist changed.
+    bool addFrame(Buffer fragment, uint32_t duration90k, bool keyframe);
+
+    Buffer playlist() const { return playlist_; }
+    const Buffer& initSegment() const { return init_; }
+
+    // Media sequence number of the segment being built
+    uint64_t openSequence() const { return segments_.back().sequence; }
+
+    // True once the playlist lists segment "sequence" complete or, with
+    // part >= 0, that part of it; the condition of a blocking reload
+    bool hasPart(uint64_t sequence, int64_t part) const;
+
+    // True if the part is the next one to be produced (the preload hint or the
+    // first part of the following segment)
+    bool isUpcomingPart(uint64_t sequence, size_t part) const;
+
+    // Append the buffers of a complete segment / published part to out; false
+    // if it is not (or no longer) in the ring
+    bool segment(uint64_t sequence, std::vector<Buffer>& out) const;
+    bool part(uint64_t sequence, size_t part, std::vector<Buffer>& out) const;
+
+    uint32_t targetDurationSeconds() const { return targetDuration_; }
+
+private:
+    struct Part {
+        std::vector<Buffer> fragments;
+        uint64_t duration90k = 0;
+        bool independent = false; // Starts with a keyframe
+    };
+
+    struct Segment {
+        uint64_t sequence = 0;
+        uint64_t duration90k = 0;
+        std::vector<std::shared_ptr<const Part>> parts;
+        bool complete = false;
+    };
+
+    const Segment* findSegment(uint64_t sequence) const;
+    void finishPart();
+    void finishSegment();
+    void renderPlaylist();
+
+    std::string uriPrefix_;
+    Buffer init_;
+    uint64_t segmentTarget90k_;
+    uint64_t partTarget90k_;
+    uint32_t targetDuration_; // EXT-X-TARGETDURATION; only grows
+
+    std::deque<Segment> segments_; // Complete segments, then the open one
+    Part building_;                // Part being filled, not yet published
+    Buffer playlist_;
+};
+
+#endif // HLS_PACKAGER_H
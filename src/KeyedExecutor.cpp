@@ -0,0 +1,90 @@
+#include "KeyedExecutor.h"
+#include "Log.h"
+
+KeyedExecutor::KeyedExecutor(size_t workerCount)
+    : running_(false) {
+    if (workerCount == 0) {
+        workerCount = std::thread::hardware_concurrency();
+        if (workerCount == 0) {
+            workerCount = 1;
+        }
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+}
+
+KeyedExecutor::~KeyedExecutor() {
+    stop();
+}
+
+void KeyedExecutor::start() {
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    for (auto& worker : workers_) {
+        worker->thread = std::thread(&KeyedExecutor::workerLoop, this, std::ref(*worker));
+    }
+}
+
+void KeyedExecutor::stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+    for (auto& worker : workers_) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+        }
+        worker->cv.notify_all();
+    }
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void KeyedExecutor::post(uint64_t key, std::function<void()> task) {
+    // Spread sequential keys (call IDs, registration IDs) evenly
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+
+    Worker& worker = *workers_[key % workers_.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push_back(std::move(task));
+    }
+    worker.cv.notify_one();
+}
+
+size_t KeyedExecutor::pending() const {
+    size_t total = 0;
+    for (const auto& worker : workers_) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        total += worker->queue.size();
+    }
+    return total;
+}
+
+void KeyedExecutor::workerLoop(Worker& worker) {
+    std::unique_lock<std::mutex> lock(worker.mutex);
+    while (true) {
+        worker.cv.wait(lock, [&] { return !worker.queue.empty() || !running_; });
+        if (worker.queue.empty()) {
+            return; // Stopped and drained
+        }
+
+        std::function<void()> task = std::move(worker.queue.front());
+        worker.queue.pop_front();
+        lock.unlock();
+        try {
+            task();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Task failed: {}", e.what());
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef KEYED_EXECUTOR_H
+#define KEYED_EXECUTOR_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+
+// Fixed pool of worker threads where every task carries a key. Tasks with the
+// same key always run on the same worker, in the order they were posted; tasks
+// with different keys run in parallel. A slow task only delays work that
+// shares its worker.
+class KeyedExecutor {
+public:
+    explicit KeyedExecutor(size_t workerCount = 0);
+    ~KeyedExecutor();
+
+    void start();
+    // Finishes the tasks already queued, then joins the workers
+    void stop();
+
+    void post(uint64_t key, std::function<void()> task);
+
+    size_t workerCount() const { return workers_.size(); }
+    size_t pending() const;
+
+private:
+    struct Worker {
+        std::thread thread;
+        mutable std::mutex mutex; // Guards queue
+        std::condition_variable cv;
+        std::deque<std::function<void()>> queue;
+    };
+
+    void workerLoop(Worker& worker);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<bool> running_;
+};
+
+#endif // KEYED_EXECUTOR_H
@@ -0,0 +1,85 @@
+#include "LatencyHistogram.h"
+#include <iomanip>
+#include <sstream>
+
+LatencyHistogram::LatencyHistogram()
+    : total_(0), sum_(0), max_(0) {
+    for (auto& count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t LatencyHistogram::indexOf(uint64_t value) {
+    // Values below SUB_BUCKET_COUNT map 1:1; above that the top 7 bits select
+    // the sub-bucket and the shift selects the power-of-two bucket
+    int msb = 63 - __builtin_clzll(value | (SUB_BUCKET_COUNT - 1));
+    int shift = msb - (SUB_BUCKET_BITS - 1);
+    uint64_t subBucket = value >> shift;
+    return static_cast<size_t>((shift + 1) * SUB_BUCKET_HALF + (subBucket - SUB_BUCKET_HALF));
+}
+
+uint64_t LatencyHistogram::highestValueAt(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    int shift = static_cast<int>(index / SUB_BUCKET_HALF) - 1;
+    uint64_t subBucket = index % SUB_BUCKET_HALF + SUB_BUCKET_HALF;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+    if (micros > MAX_VALUE) {
+        micros = MAX_VALUE;
+    }
+    counts_[indexOf(micros)].fetch_add(1, std::memory_order_relaxed);
+    total_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(micros, std::memory_order_relaxed);
+
+    uint64_t previous = max_.load(std::memory_order_relaxed);
+    while (micros > previous && !max_.compare_exchange_weak(previous, micros, std::memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t total = count();
+    return total ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / total : 0.0;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(q * total + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts_[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            uint64_t value = highestValueAt(i);
+            return value < max() ? value : max();
+        }
+    }
+    return max();
+}
+
+void LatencyHistogram::dump(std::ostream& out, const std::string& name) const {
+    static const double PERCENTILES[] = {0.5, 0.75, 0.9, 0.95, 0.99, 0.999, 1.0};
+
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << name << ": count=" << count() << " mean=" << mean() / 1000.0 << "ms max=" << max() / 1000.0 << "ms" << std::endl;
+    if (count() > 0) {
+        for (double q : PERCENTILES) {
+            std::ostringstream label;
+            label << "p" << q * 100;
+            out << "  " << std::setw(8) << std::left << label.str() << std::right
+                << std::setw(12) << percentile(q) / 1000.0 << " ms" << std::endl;
+        }
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
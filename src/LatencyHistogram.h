@@ -0,0 +1,47 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// HDR-style histogram of microsecond latencies. Buckets are log-linear: each
+// power of two is split into 64 linear sub-buckets, so any recorded value is
+// reported within 1.6% over the whole 1 us .. 1 h range. Recording is a
+// couple of relaxed atomic adds and may happen on any thread.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t micros);
+
+    uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const;
+    // Smallest recorded bucket value v such that the fraction q of samples is <= v
+    uint64_t percentile(double q) const;
+
+    // Summary line plus the value at a fixed set of percentiles, in milliseconds
+    void dump(std::ostream& out, const std::string& name) const;
+
+private:
+    static const int SUB_BUCKET_BITS = 7;
+    static const uint64_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const uint64_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+    static const uint64_t MAX_VALUE = 3600ULL * 1000 * 1000; // Larger values are clamped to 1 h
+    static const size_t BUCKET_COUNT = (32 - SUB_BUCKET_BITS + 2) * SUB_BUCKET_HALF;
+
+    static size_t indexOf(uint64_t value);
+    static uint64_t highestValueAt(size_t index);
+
+    std::atomic<uint64_t> counts_[BUCKET_COUNT];
+    std::atomic<uint64_t> total_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+#endif // LATENCY_HISTOGRAM_H
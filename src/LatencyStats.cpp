@@ -0,0 +1,48 @@
+#include "LatencyStats.h"
+#include <fstream>
+
+LatencyStats& LatencyStats::instance() {
+    static LatencyStats stats;
+    return stats;
+}
+
+void LatencyStats::dump(std::ostream& out) const {
+    out << "RealPlay startup latency (from INVITE received)" << std::endl;
+    inviteToOk.dump(out, "invite_to_200ok");
+    inviteToAck.dump(out, "invite_to_ack");
+    inviteToFirstPacket.dump(out, "invite_to_first_rtp");
+    inviteToFirstKeyframe.dump(out, "invite_to_first_keyframe");
+}
+
+bool LatencyStats::writeFile(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+    dump(file);
+    return static_cast<bool>(file);
+}
+
+SessionTimeline::SessionTimeline(Clock::time_point inviteReceived)
+    : inviteReceived_(inviteReceived) {
+    for (auto& marked : marked_) {
+        marked.store(false, std::memory_order_relaxed);
+    }
+}
+
+void SessionTimeline::mark(Stage stage) {
+    if (marked_[stage].exchange(true, std::memory_order_relaxed)) {
+        return;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - inviteReceived_).count();
+    uint64_t micros = elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0;
+    LatencyStats& stats = LatencyStats::instance();
+    switch (stage) {
+        case OkSent: stats.inviteToOk.record(micros); break;
+        case AckReceived: stats.inviteToAck.record(micros); break;
+        case FirstPacketSent: stats.inviteToFirstPacket.record(micros); break;
+        case FirstKeyframeSent: stats.inviteToFirstKeyframe.record(micros); break;
+        default: break;
+    }
+}
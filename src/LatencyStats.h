@@ -0,0 +1,52 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include "LatencyHistogram.h"
+
+// Process-wide RealPlay startup latencies, each measured from the moment the
+// INVITE was taken off the SIP socket
+class LatencyStats {
+public:
+    static LatencyStats& instance();
+
+    LatencyHistogram inviteToOk;            // 200 OK with our SDP sent
+    LatencyHistogram inviteToAck;           // Platform's ACK received
+    LatencyHistogram inviteToFirstPacket;   // First RTP packet sent
+    LatencyHistogram inviteToFirstKeyframe; // First complete keyframe sent
+
+    void dump(std::ostream& out) const;
+    bool writeFile(const std::string& path) const;
+
+private:
+    LatencyStats() = default;
+};
+
+// Startup milestones of one RealPlay session. Shared by the SIP side
+// (RtpSession) and the media side (RtpStream); each stage is recorded into
+// LatencyStats the first time it is marked, from whichever thread gets there.
+class SessionTimeline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum Stage {
+        OkSent,
+        AckReceived,
+        FirstPacketSent,
+        FirstKeyframeSent,
+        StageCount
+    };
+
+    explicit SessionTimeline(Clock::time_point inviteReceived);
+
+    void mark(Stage stage);
+
+private:
+    Clock::time_point inviteReceived_;
+    std::atomic<bool> marked_[StageCount];
+};
+
+#endif // LATENCY_STATS_H
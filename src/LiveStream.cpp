@@ -0,0 +1,115 @@
+#include "LiveStream.h"
+#include "Log.h"
+
+namespace {
+const size_t MAX_GOP_FRAMES = 600;
+// If the server falls further behind than this, skip ahead instead of bursting
+const std::chrono::seconds MAX_LAG(1);
+}
+
+LiveStream::LiveStream(const std::string& streamId, const std::string& sourcePath)
+    : streamId_(streamId), source_(sourcePath, true), closed_(false), fragmentSequence_(0),
+      gopOverflow_(false), started_(false), startDts90k_(0) {
+}
+
+bool LiveStream::open() {
+    if (!source_.open()) {
+        return false;
+    }
+    if (source_.codec() != VideoCodec::H264) {
+        LOG_ERROR("LiveStream {}: only H.264 sources can be served as FLV/fMP4.", streamId_);
+        return false;
+    }
+
+    // Skip to the first keyframe that carries the parameter sets
+    for (int i = 0; i < 1000; ++i) {
+        if (!source_.readFrame(next_)) {
+            break;
+        }
+        if (next_.keyframe && parseH264Config(next_.data.data(), next_.data.size(), config_)) {
+            flv_ = std::make_unique<FlvMuxer>(config_);
+            fmp4_ = std::make_unique<Fmp4Muxer>(config_);
+            flvHeader_ = std::make_shared<const std::string>(flv_->header());
+            fmp4Init_ = std::make_shared<const std::string>(fmp4_->initSegment());
+            hls_ = std::make_unique<HlsPackager>(streamId_ + "/", fmp4Init_);
+            return true;
+        }
+    }
+    LOG_ERROR("LiveStream {}: no H.264 keyframe with SPS/PPS in {}", streamId_, source_.path());
+    return false;
+}
+
+void LiveStream::pump(Clock::time_point now, std::vector<LiveChunk>& out) {
+    if (closed_) {
+        return;
+    }
+    if (!started_) {
+        started_ = true;
+        startTime_ = now;
+        startDts90k_ = next_.dts90k;
+    }
+
+    while (true) {
+        auto due = startTime_ + std::chrono::microseconds((next_.dts90k - startDts90k_) * 1000 / 90);
+        if (due > now) {
+            return;
+        }
+        if (now - due > MAX_LAG) {
+            // Rebase rather than flooding viewers with a backlog
+            startTime_ = now;
+            startDts90k_ = next_.dts90k;
+        }
+
+        LiveChunk chunk = package(next_);
+        if (chunk.keyframe) {
+            gop_.clear();
+            gopOverflow_ = false;
+        }
+        if (!gopOverflow_) {
+            if (gop_.size() < MAX_GOP_FRAMES) {
+                gop_.push_back(chunk);
+            } else {
+                gop_.clear();
+                gopOverflow_ = true;
+            }
+        }
+        out.push_back(std::move(chunk));
+
+        if (!readNext()) {
+            return;
+        }
+    }
+}
+
+void LiveStream::joinData(LiveFormat format, std::vector<std::shared_ptr<const std::string>>& out) const {
+    out.push_back(format == LiveFormat::Flv ? flvHeader_ : fmp4Init_);
+    for (const LiveChunk& chunk : gop_) {
+        out.push_back(format == LiveFormat::Flv ? chunk.flv : chunk.fmp4);
+    }
+}
+
+bool LiveStream::readNext() {
+    if (source_.readFrame(next_)) {
+        return true;
+    }
+    LOG_INFO("LiveStream {}: source ended.", streamId_);
+    closed_ = true;
+    return false;
+}
+
+LiveChunk LiveStream::package(const MediaFrame& frame) {
+    LiveChunk chunk;
+    chunk.keyframe = frame.keyframe;
+
+    auto flv = std::make_shared<std::string>();
+    flv_->writeFrame(frame.data.data(), frame.data.size(), frame.pts90k, frame.dts90k, frame.keyframe, *flv);
+    chunk.flv = std::move(flv);
+
+    uint32_t duration90k = static_cast<uint32_t>(source_.frameDuration90k());
+    auto fmp4 = std::make_shared<std::string>();
+    fmp4_->writeFragment(frame.data.data(), frame.data.size(), frame.pts90k, frame.dts90k,
+                         duration90k, frame.keyframe, ++fragmentSequence_, *fmp4);
+    chunk.fmp4 = std::move(fmp4);
+    hls_->addFrame(chunk.fmp4, duration90k, frame.keyframe);
+    return chunk;
+}
@@ -0,0 +1,93 @@
+#ifndef LIVE_STREAM_H
+#define LIVE_STREAM_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AnnexB.h"
+#include "FlvMuxer.h"
+#include "Fmp4Muxer.h"
+#include "HlsPackager.h"
+#include "MediaSource.h"
+#include "StreamRegistry.h"
+
+enum class LiveFormat {
+    Flv,
+    Fmp4
+};
+
+// One frame packaged for every egress format. Buffers are immutable and shared
+// by all viewers, so fan-out only copies pointers.
+struct LiveChunk {
+    std::shared_ptr<const std::string> flv;
+    std::shared_ptr<const std::string> fmp4;
+    bool keyframe = false;
+};
+
+// A stream served over HTTP: demuxes its source in real time, packages each
+// frame once per format and keeps the current GOP so a new viewer starts at
+// the latest keyframe instead of waiting for the next one. The fMP4 fragments
+// also feed an in-memory LL-HLS packager. Not thread-safe;
+// driven by the WebServer thread after open().
+class LiveStream {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    LiveStream(const std::string& streamId, const std::string& sourcePath);
+
+    LiveStream(const LiveStream&) = delete;
+    LiveStream& operator=(const LiveStream&) = delete;
+
+    // Opens the source and reads up to the first keyframe. H.264 only.
+    bool open();
+
+    // Packages every frame due by now and appends it to out
+    void pump(Clock::time_point now, std::vector<LiveChunk>& out);
+
+    // What a new viewer is sent before live chunks: the format header and the
+    // cached GOP
+    void joinData(LiveFormat format, std::vector<std::shared_ptr<const std::string>>& out) const;
+
+    const std::string& streamId() const { return streamId_; }
+    const HlsPackager& hls() const { return *hls_; }
+
+    // Registry counters for egress to viewers; set before the stream is served
+    void setStats(std::shared_ptr<StreamStats> stats) { stats_ = std::move(stats); }
+    StreamStats* stats() const { return stats_.get(); }
+
+    // Set by WebServer::removeStream; the server thread then drops the viewers
+    void close() { closed_ = true; }
+    bool closed() const { return closed_; }
+
+    std::vector<int> viewers;     // Connection fds, server thread only
+    std::vector<int> hlsWaiters;  // Connections in a blocking playlist/part request; same
+
+private:
+    bool readNext();
+    LiveChunk package(const MediaFrame& frame);
+
+    std::string streamId_;
+    MediaSource source_;
+    std::atomic<bool> closed_;
+    std::shared_ptr<StreamStats> stats_;
+
+    H264Config config_;
+    std::unique_ptr<FlvMuxer> flv_;
+    std::unique_ptr<Fmp4Muxer> fmp4_;
+    std::shared_ptr<const std::string> flvHeader_;
+    std::shared_ptr<const std::string> fmp4Init_;
+    std::unique_ptr<HlsPackager> hls_;
+    uint32_t fragmentSequence_;
+
+    std::vector<LiveChunk> gop_; // From the latest keyframe up to now
+    bool gopOverflow_;           // GOP too long to cache; wait for the next keyframe
+
+    MediaFrame next_;            // Read ahead, sent when due
+    bool started_;
+    Clock::time_point startTime_;
+    uint64_t startDts90k_;
+};
+
+#endif // LIVE_STREAM_H
@@ -0,0 +1,243 @@
+#include "Log.h"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <thread>
+
+namespace {
+const size_t RING_SIZE = 4096; // Slots, a power of two
+const size_t WRITE_BATCH = 64 * 1024;
+// The writer polls; it backs off to this while there is nothing to write
+const std::chrono::microseconds IDLE_SLEEP_MIN(500);
+const std::chrono::microseconds IDLE_SLEEP_MAX(20000);
+
+const char* levelName(int level) {
+    switch (level) {
+        case Log::Debug: return "DEBUG";
+        case Log::Info: return "INFO ";
+        case Log::Warn: return "WARN ";
+        default: return "ERROR";
+    }
+}
+
+// Bounded MPSC ring in the style of Vyukov's queue: a slot's sequence says
+// whose turn it is, so producers only contend on tail_ and the writer never
+// takes a lock
+class LogWriter {
+public:
+    LogWriter() : ring_(new LogRecord[RING_SIZE]), tail_(0), head_(0), written_(0), dropped_(0), running_(true) {
+        for (size_t i = 0; i < RING_SIZE; ++i) {
+            ring_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        thread_ = std::thread(&LogWriter::run, this);
+    }
+
+    ~LogWriter() {
+        running_.store(false, std::memory_order_release);
+        thread_.join();
+    }
+
+    LogRecord* claim(uint64_t& position) {
+        position = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            LogRecord& record = ring_[position & (RING_SIZE - 1)];
+            int64_t lag = int64_t(record.sequence.load(std::memory_order_acquire) - position);
+            if (lag == 0) {
+                if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    return &record;
+                }
+            } else if (lag < 0) {
+                // The writer hasn't freed the slot a lap ago: full
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            } else {
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void flush() {
+        uint64_t target = tail_.load(std::memory_order_acquire);
+        while (written_.load(std::memory_order_acquire) < target && running_.load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(IDLE_SLEEP_MIN);
+        }
+    }
+
+private:
+    void run() {
+        std::chrono::microseconds sleep = IDLE_SLEEP_MIN;
+        while (running_.load(std::memory_order_acquire)) {
+            sleep = drain() ? IDLE_SLEEP_MIN : std::min(sleep * 2, IDLE_SLEEP_MAX);
+            std::this_thread::sleep_for(sleep);
+        }
+        drain();
+    }
+
+    bool drain() {
+        bool any = false;
+        while (true) {
+            LogRecord& record = ring_[head_ & (RING_SIZE - 1)];
+            if (record.sequence.load(std::memory_order_acquire) != head_ + 1) {
+                break;
+            }
+            render(record, record.level >= Log::Warn ? err_ : out_);
+            record.sequence.store(head_ + RING_SIZE, std::memory_order_release);
+            ++head_;
+            any = true;
+            if (out_.size() + err_.size() >= WRITE_BATCH) {
+                output();
+            }
+        }
+        if (uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed)) {
+            err_ += std::to_string(dropped) + " log lines dropped, the log ring was full\n";
+        }
+        output();
+        written_.store(head_, std::memory_order_release);
+        return any;
+    }
+
+    void output() {
+        if (!out_.empty()) {
+            fwrite(out_.data(), 1, out_.size(), stdout);
+            fflush(stdout);
+            out_.clear();
+        }
+        if (!err_.empty()) {
+            fwrite(err_.data(), 1, err_.size(), stderr);
+            fflush(stderr);
+            err_.clear();
+        }
+    }
+
+    static void render(const LogRecord& record, std::string& line) {
+        char prefix[48];
+        time_t seconds = static_cast<time_t>(record.timeUs / 1000000);
+        tm local{};
+        localtime_r(&seconds, &local);
+        size_t length = strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &local);
+        snprintf(prefix + length, sizeof(prefix) - length, ".%03d %s ", int(record.timeUs / 1000 % 1000),
+                 levelName(record.level));
+        line += prefix;
+
+        const char* args = record.args;
+        const char* argsEnd = record.args + record.argsSize;
+        for (const char* p = record.format; *p; ++p) {
+            if (p[0] == '{' && p[1] == '}' && args < argsEnd) {
+                args = renderArg(args, line);
+                ++p;
+            } else {
+                line += *p;
+            }
+        }
+        if (record.suppressed) {
+            line += " (" + std::to_string(record.suppressed) + " similar lines suppressed)";
+        }
+        line += '\n';
+    }
+
+    // Appends the argument at data and returns the next one
+    static const char* renderArg(const char* data, std::string& line) {
+        auto type = static_cast<LogRecord::ArgType>(*data++);
+        switch (type) {
+            case LogRecord::Signed: {
+                int64_t value;
+                memcpy(&value, data, sizeof(value));
+                line += std::to_string(value);
+                return data + sizeof(value);
+            }
+            case LogRecord::Unsigned: {
+                uint64_t value;
+                memcpy(&value, data, sizeof(value));
+                line += std::to_string(value);
+                return data + sizeof(value);
+            }
+            case LogRecord::Double: {
+                double value;
+                memcpy(&value, data, sizeof(value));
+                char text[32];
+                snprintf(text, sizeof(text), "%g", value);
+                line += text;
+                return data + sizeof(value);
+            }
+            case LogRecord::Char:
+                line += *data;
+                return data + 1;
+            case LogRecord::Bool:
+                line += *data ? "true" : "false";
+                return data + 1;
+            case LogRecord::String:
+            case LogRecord::TruncatedString: {
+                uint16_t length;
+                memcpy(&length, data, sizeof(length));
+                data += sizeof(length);
+                line.append(data, length);
+                if (type == LogRecord::TruncatedString) {
+                    line += "...";
+                }
+                return data + length;
+            }
+        }
+        return data;
+    }
+
+    std::unique_ptr<LogRecord[]> ring_;
+    alignas(64) std::atomic<uint64_t> tail_; // Next position to claim
+    alignas(64) uint64_t head_;              // Next position to write; writer thread only
+    std::atomic<uint64_t> written_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<bool> running_;
+    std::string out_;
+    std::string err_;
+    std::thread thread_;
+};
+
+LogWriter& writer() {
+    static LogWriter instance;
+    return instance;
+}
+}
+
+std::atomic<int> Log::level_(LOG_LEVEL_DEBUG);
+
+bool LogSite::admit(int64_t nowSecond, uint32_t& heldBack) {
+    int64_t current = second.load(std::memory_order_relaxed);
+    if (current != nowSecond && second.compare_exchange_strong(current, nowSecond, std::memory_order_relaxed)) {
+        lines.store(0, std::memory_order_relaxed);
+    }
+    if (lines.fetch_add(1, std::memory_order_relaxed) >= LOG_RATE_LIMIT) {
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    heldBack = suppressed.load(std::memory_order_relaxed) ? suppressed.exchange(0, std::memory_order_relaxed) : 0;
+    return true;
+}
+
+void LogArgs::addString(std::string_view text) {
+    const size_t header = 1 + sizeof(uint16_t);
+    if (size_ + header > capacity_) {
+        return;
+    }
+    size_t room = capacity_ - size_ - header;
+    bool truncated = text.size() > room;
+    uint16_t length = static_cast<uint16_t>(truncated ? room : text.size());
+    data_[size_++] = char(truncated ? LogRecord::TruncatedString : LogRecord::String);
+    memcpy(data_ + size_, &length, sizeof(length));
+    size_ += sizeof(length);
+    memcpy(data_ + size_, text.data(), length);
+    size_ += length;
+}
+
+bool Log::begin(LogSite& site, int64_t& timeUs, uint32_t& heldBack) {
+    timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                 std::chrono::system_clock::now().time_since_epoch()).count();
+    return site.admit(timeUs / 1000000, heldBack);
+}
+
+LogRecord* Log::claim(uint64_t& position) {
+    return writer().claim(position);
+}
+
+void Log::flush() {
+    writer().flush();
+}
@@ -0,0 +1,168 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Asynchronous logging for the hot paths:
+//
+//   LOG_INFO("Registration successful for {}", device->deviceId);
+//
+// copies the format pointer and the arguments, in binary, into a slot of a
+// lock-free multi-producer ring and returns; a background thread renders the
+// "{}" placeholders and writes the lines, INFO and below to stdout, WARN and
+// ERROR to stderr. The format must be a string literal. Levels below
+// LOG_LEVEL are compiled out. Each call site lets through at most
+// LOG_RATE_LIMIT lines per second; the ones held back are counted and the
+// count is appended to the next line from that site. When the ring is full
+// the line is dropped and the writer reports how many were.
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_RATE_LIMIT
+#define LOG_RATE_LIMIT 100
+#endif
+
+#define LOG_AT(severity, ...)                                                \
+    do {                                                                     \
+        if constexpr (severity >= LOG_LEVEL) {                               \
+            if (Log::enabled(severity)) {                                    \
+                static LogSite logSite(severity);                            \
+                Log::write(logSite, __VA_ARGS__);                            \
+            }                                                                \
+        }                                                                    \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// Rate limit state of one LOG_* call site
+struct LogSite {
+    explicit LogSite(int siteLevel) : level(siteLevel), second(0), lines(0), suppressed(0) {}
+
+    // False when the site is over its limit for the current second; on true,
+    // heldBack is the number of lines dropped since the last one let through
+    bool admit(int64_t nowSecond, uint32_t& heldBack);
+
+    const int level;
+    std::atomic<int64_t> second;
+    std::atomic<uint32_t> lines;
+    std::atomic<uint32_t> suppressed;
+};
+
+// One ring slot. Arguments follow each other as a type tag and the value;
+// strings are a 16-bit length and the bytes, cut short if the slot is full.
+struct alignas(64) LogRecord {
+    static const size_t SIZE = 512;
+
+    enum ArgType : uint8_t { Signed, Unsigned, Double, Char, Bool, String, TruncatedString };
+
+    std::atomic<uint64_t> sequence;
+    const char* format;
+    int64_t timeUs; // Wall clock
+    uint32_t suppressed;
+    uint16_t argsSize;
+    uint8_t level;
+    char args[SIZE - 32];
+};
+
+class LogArgs {
+public:
+    LogArgs(char* data, size_t capacity) : data_(data), size_(0), capacity_(capacity) {}
+
+    template <typename T>
+    void add(const T& value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            put(LogRecord::Bool, uint8_t(value));
+        } else if constexpr (std::is_same_v<T, char>) {
+            put(LogRecord::Char, value);
+        } else if constexpr (std::is_enum_v<T>) {
+            put(LogRecord::Signed, int64_t(value));
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            put(LogRecord::Signed, int64_t(value));
+        } else if constexpr (std::is_integral_v<T>) {
+            put(LogRecord::Unsigned, uint64_t(value));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            put(LogRecord::Double, double(value));
+        } else if constexpr (std::is_convertible_v<const T&, const char*>) {
+            const char* text = value;
+            addString(text ? std::string_view(text) : std::string_view("(null)"));
+        } else {
+            addString(std::string_view(value));
+        }
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    template <typename V>
+    void put(LogRecord::ArgType type, V value) {
+        if (size_ + 1 + sizeof(V) > capacity_) {
+            return;
+        }
+        data_[size_++] = char(type);
+        memcpy(data_ + size_, &value, sizeof(V));
+        size_ += sizeof(V);
+    }
+
+    void addString(std::string_view text);
+
+    char* data_;
+    size_t size_;
+    size_t capacity_;
+};
+
+class Log {
+public:
+    enum Level { Debug = LOG_LEVEL_DEBUG, Info = LOG_LEVEL_INFO, Warn = LOG_LEVEL_WARN, Error = LOG_LEVEL_ERROR };
+
+    // Runtime threshold on top of LOG_LEVEL
+    static void setLevel(Level level) { level_.store(level, std::memory_order_relaxed); }
+    static bool enabled(int level) { return level >= level_.load(std::memory_order_relaxed); }
+
+    template <typename... Args>
+    static void write(LogSite& site, const char* format, const Args&... args) {
+        int64_t timeUs = 0;
+        uint32_t heldBack = 0;
+        if (!begin(site, timeUs, heldBack)) {
+            return;
+        }
+        uint64_t position = 0;
+        LogRecord* record = claim(position);
+        if (!record) {
+            return;
+        }
+        LogArgs encoder(record->args, sizeof(record->args));
+        (encoder.add(args), ...);
+        record->format = format;
+        record->timeUs = timeUs;
+        record->suppressed = heldBack;
+        record->argsSize = static_cast<uint16_t>(encoder.size());
+        record->level = static_cast<uint8_t>(site.level);
+        record->sequence.store(position + 1, std::memory_order_release);
+    }
+
+    // Blocks until everything logged so far is written
+    static void flush();
+
+private:
+    static bool begin(LogSite& site, int64_t& timeUs, uint32_t& heldBack);
+    static LogRecord* claim(uint64_t& position);
+
+    static std::atomic<int> level_;
+};
+
+#endif // LOG_H
@@ -0,0 +1,134 @@
+#ifndef MANSCDP_DISPATCHER_H
+#define MANSCDP_DISPATCHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// MANSCDP CmdTypes the client answers. Values index handler tables; keep
+// MANSCDP_COMMAND_NAMES in the same order.
+enum class ManscdpCommand : uint8_t {
+    Unknown,
+    Catalog,
+    DeviceInfo,
+    DeviceStatus,
+    RecordInfo,
+    DeviceControl,
+    ConfigDownload,
+    Alarm,
+    MobilePosition,
+    Count
+};
+
+constexpr std::string_view MANSCDP_COMMAND_NAMES[] = {
+    "",
+    "Catalog",
+    "DeviceInfo",
+    "DeviceStatus",
+    "RecordInfo",
+    "DeviceControl",
+    "ConfigDownload",
+    "Alarm",
+    "MobilePosition",
+};
+
+constexpr size_t MANSCDP_COMMAND_COUNT = static_cast<size_t>(ManscdpCommand::Count);
+static_assert(sizeof(MANSCDP_COMMAND_NAMES) / sizeof(MANSCDP_COMMAND_NAMES[0]) == MANSCDP_COMMAND_COUNT,
+              "MANSCDP_COMMAND_NAMES out of sync with ManscdpCommand");
+
+// CmdType lookup is a perfect hash built at compile time: a seeded FNV-1a over
+// the name picks one slot, and a single compare confirms the match. Adding a
+// command costs nothing at run time; if no seed separates the names the build
+// fails below.
+namespace manscdp_detail {
+constexpr size_t TABLE_SIZE = 32; // Power of two, larger than the command count
+constexpr uint32_t NO_SEED = 0xFFFFFFFFu;
+
+constexpr uint32_t hash(uint32_t seed, std::string_view text) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : text) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+constexpr size_t slot(uint32_t seed, std::string_view text) {
+    return hash(seed, text) & (TABLE_SIZE - 1);
+}
+
+constexpr bool isPerfect(uint32_t seed) {
+    bool used[TABLE_SIZE] = {};
+    for (size_t i = 1; i < MANSCDP_COMMAND_COUNT; ++i) {
+        size_t s = slot(seed, MANSCDP_COMMAND_NAMES[i]);
+        if (used[s]) {
+            return false;
+        }
+        used[s] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t findSeed() {
+    for (uint32_t seed = 0; seed < 4096; ++seed) {
+        if (isPerfect(seed)) {
+            return seed;
+        }
+    }
+    return NO_SEED;
+}
+
+struct Table {
+    uint8_t commands[TABLE_SIZE]; // ManscdpCommand per slot, Unknown if empty
+};
+
+constexpr uint32_t SEED = findSeed();
+static_assert(SEED != NO_SEED, "No perfect hash seed for the MANSCDP command names; grow TABLE_SIZE");
+
+constexpr Table buildTable() {
+    Table table = {};
+    for (size_t i = 1; i < MANSCDP_COMMAND_COUNT; ++i) {
+        table.commands[slot(SEED, MANSCDP_COMMAND_NAMES[i])] = static_cast<uint8_t>(i);
+    }
+    return table;
+}
+
+constexpr Table TABLE = buildTable();
+}
+
+constexpr ManscdpCommand lookupManscdpCommand(std::string_view cmdType) {
+    uint8_t index = manscdp_detail::TABLE.commands[manscdp_detail::slot(manscdp_detail::SEED, cmdType)];
+    return index != 0 && MANSCDP_COMMAND_NAMES[index] == cmdType ? static_cast<ManscdpCommand>(index) : ManscdpCommand::Unknown;
+}
+
+static_assert(lookupManscdpCommand("Catalog") == ManscdpCommand::Catalog, "MANSCDP lookup broken");
+static_assert(lookupManscdpCommand("MobilePosition") == ManscdpCommand::MobilePosition, "MANSCDP lookup broken");
+static_assert(lookupManscdpCommand("Keepalive") == ManscdpCommand::Unknown, "MANSCDP lookup broken");
+static_assert(lookupManscdpCommand("") == ManscdpCommand::Unknown, "MANSCDP lookup broken");
+
+// Fixed table of handlers indexed by ManscdpCommand. Handler is any callable
+// pointer type, e.g. a member function pointer of the owning class; the
+// Unknown slot receives everything unrecognised.
+template <typename Handler>
+class ManscdpDispatcher {
+public:
+    constexpr explicit ManscdpDispatcher(Handler unknown) : handlers_() {
+        for (size_t i = 0; i < MANSCDP_COMMAND_COUNT; ++i) {
+            handlers_[i] = unknown;
+        }
+    }
+
+    constexpr ManscdpDispatcher& on(ManscdpCommand command, Handler handler) {
+        handlers_[static_cast<size_t>(command)] = handler;
+        return *this;
+    }
+
+    constexpr Handler find(std::string_view cmdType) const {
+        return handlers_[static_cast<size_t>(lookupManscdpCommand(cmdType))];
+    }
+
+private:
+    Handler handlers_[MANSCDP_COMMAND_COUNT];
+};
+
+#endif // MANSCDP_DISPATCHER_H
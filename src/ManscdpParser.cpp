@@ -0,0 +1,217 @@
+#include "ManscdpParser.h"
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <vector>
+
+namespace {
+const size_t MAX_DEPTH = 16;
+const std::string_view::size_type npos = std::string_view::npos;
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool isNameEnd(char c) {
+    return isSpace(c) || c == '>' || c == '/';
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && isSpace(text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && isSpace(text.back())) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// Position of the '>' closing the tag that starts at "from", skipping quoted
+// attribute values
+size_t findTagEnd(std::string_view xml, size_t from) {
+    char quote = 0;
+    for (size_t i = from; i < xml.size(); ++i) {
+        char c = xml[i];
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '>') {
+            return i;
+        }
+    }
+    return npos;
+}
+
+std::string_view tagName(std::string_view xml, size_t begin, size_t end) {
+    size_t i = begin;
+    while (i < end && !isNameEnd(xml[i])) {
+        ++i;
+    }
+    return xml.substr(begin, i - begin);
+}
+
+// Returns the member of message that element "name" is stored in, or nullptr
+std::string_view* field(ManscdpMessage& message, std::string_view name) {
+    if (name == "CmdType") return &message.cmdType;
+    if (name == "SN") return &message.sn;
+    if (name == "DeviceID") return &message.deviceId;
+    if (name == "PTZCmd") return &message.ptzCmd;
+    if (name == "StartTime") return &message.startTime;
+    if (name == "EndTime") return &message.endTime;
+    return nullptr;
+}
+}
+
+ManscdpParseResult parseManscdp(std::string_view xml, ManscdpMessage& out) {
+    out = ManscdpMessage();
+
+    std::string_view open[MAX_DEPTH]; // Names of the currently open elements
+    size_t depth = 0;
+    bool leaf = false;       // The open child of the root has no element children so far
+    size_t textBegin = 0;
+    size_t pos = 0;
+
+    while (true) {
+        size_t lt = xml.find('<', pos);
+        if (lt == npos || lt + 1 >= xml.size()) {
+            return ManscdpParseResult::Malformed; // Ran out before the root closed
+        }
+
+        char next = xml[lt + 1];
+        if (next == '?') {
+            size_t end = xml.find("?>", lt + 2);
+            if (end == npos) {
+                return ManscdpParseResult::Malformed;
+            }
+            pos = end + 2;
+            continue;
+        }
+        if (next == '!') {
+            if (xml.compare(lt, 4, "<!--") != 0) {
+                return ManscdpParseResult::Unsupported; // CDATA or DOCTYPE
+            }
+            size_t end = xml.find("-->", lt + 4);
+            if (end == npos) {
+                return ManscdpParseResult::Malformed;
+            }
+            pos = end + 3;
+            continue;
+        }
+
+        size_t gt = findTagEnd(xml, lt + 1);
+        if (gt == npos) {
+            return ManscdpParseResult::Malformed;
+        }
+
+        if (next == '/') {
+            std::string_view name = tagName(xml, lt + 2, gt);
+            if (depth == 0 || name != open[depth - 1]) {
+                return ManscdpParseResult::Malformed;
+            }
+            if (depth == 2 && leaf) {
+                std::string_view text = xml.substr(textBegin, lt - textBegin);
+                if (text.find('&') != npos) {
+                    return ManscdpParseResult::Unsupported; // Entity references need unescaping
+                }
+                if (std::string_view* value = field(out, name)) {
+                    *value = trim(text);
+                }
+            }
+            leaf = false;
+            if (--depth == 0) {
+                return out.cmdType.empty() ? ManscdpParseResult::Malformed : ManscdpParseResult::Ok;
+            }
+            pos = gt + 1;
+            continue;
+        }
+
+        std::string_view name = tagName(xml, lt + 1, gt);
+        if (name.empty()) {
+            return ManscdpParseResult::Malformed;
+        }
+        if (depth == 0) {
+            if (!out.root.empty()) {
+                return ManscdpParseResult::Malformed; // Second root element
+            }
+            out.root = name;
+        }
+        leaf = false;
+        pos = gt + 1;
+
+        if (xml[gt - 1] == '/') {
+            // <Tag/> is an empty value
+            if (depth == 1) {
+                if (std::string_view* value = field(out, name)) {
+                    *value = std::string_view();
+                }
+            } else if (depth == 0) {
+                return ManscdpParseResult::Malformed; // Empty root has no CmdType
+            }
+            continue;
+        }
+
+        if (depth == MAX_DEPTH) {
+            return ManscdpParseResult::Unsupported;
+        }
+        open[depth++] = name;
+        if (depth == 2) {
+            leaf = true;
+            textBegin = gt + 1;
+        }
+    }
+}
+
+ManscdpParseResult parseManscdpDom(std::string_view xml, ManscdpMessage& out, std::string& storage) {
+    out = ManscdpMessage();
+    storage.clear();
+
+    xmlDocPtr doc = xmlReadMemory(xml.data(), static_cast<int>(xml.size()), "manscdp.xml", nullptr, XML_PARSE_NONET);
+    if (!doc) {
+        return ManscdpParseResult::Malformed;
+    }
+    xmlNodePtr root = xmlDocGetRootElement(doc);
+    if (!root) {
+        xmlFreeDoc(doc);
+        return ManscdpParseResult::Malformed;
+    }
+
+    // Copy everything into storage first and take views afterwards, since
+    // appending may reallocate
+    struct Span {
+        std::string_view* target;
+        size_t offset;
+        size_t length;
+    };
+    std::vector<Span> spans;
+
+    std::string_view rootName = reinterpret_cast<const char*>(root->name);
+    spans.push_back(Span{&out.root, storage.size(), rootName.size()});
+    storage.append(rootName);
+
+    for (xmlNodePtr node = root->children; node; node = node->next) {
+        if (node->type != XML_ELEMENT_NODE) {
+            continue;
+        }
+        std::string_view* value = field(out, reinterpret_cast<const char*>(node->name));
+        if (!value) {
+            continue;
+        }
+        xmlChar* content = xmlNodeGetContent(node);
+        if (!content) {
+            continue;
+        }
+        std::string_view text = trim(reinterpret_cast<const char*>(content));
+        // A repeated element overwrites the earlier one, like the fast path
+        spans.push_back(Span{value, storage.size(), text.size()});
+        storage.append(text);
+        xmlFree(content);
+    }
+    xmlFreeDoc(doc);
+
+    for (const Span& span : spans) {
+        *span.target = std::string_view(storage).substr(span.offset, span.length);
+    }
+    return out.cmdType.empty() ? ManscdpParseResult::Malformed : ManscdpParseResult::Ok;
+}
@@ -0,0 +1,35 @@
+#ifndef MANSCDP_PARSER_H
+#define MANSCDP_PARSER_H
+
+#include <string>
+#include <string_view>
+
+// The MANSCDP fields the client acts on. Views point into the parsed body (or
+// into the fallback's storage) and are only valid while that buffer lives.
+struct ManscdpMessage {
+    std::string_view root;     // Query, Control, Notify or Response
+    std::string_view cmdType;
+    std::string_view sn;
+    std::string_view deviceId;
+    std::string_view ptzCmd;
+    std::string_view startTime; // RecordInfo range, e.g. 2024-03-01T12:00:00
+    std::string_view endTime;
+};
+
+enum class ManscdpParseResult {
+    Ok,
+    Unsupported, // Well-formed as far as we got, but needs a real XML parser
+    Malformed
+};
+
+// Pull parser for the flat documents MANSCDP uses: an optional prolog, one root
+// element and leaf children of that root. Skips comments, attributes and nested
+// subtrees; gives up with Unsupported on entities, CDATA or DOCTYPE. Never
+// allocates.
+ManscdpParseResult parseManscdp(std::string_view xml, ManscdpMessage& out);
+
+// libxml2 DOM parser for documents the fast path cannot handle. Unescaped values
+// are copied into storage, which the views in out then refer to.
+ManscdpParseResult parseManscdpDom(std::string_view xml, ManscdpMessage& out, std::string& storage);
+
+#endif // MANSCDP_PARSER_H
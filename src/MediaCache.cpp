@@ -0,0 +1,136 @@
+#include "MediaCache.h"
+#include "PsMuxer.h"
+#include "AnnexB.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+
+namespace {
+// Upper bound on one cached clip; longer sources are truncated
+const size_t MAX_CLIP_BYTES = 512 * 1024 * 1024;
+}
+
+MediaClip::MediaClip(const std::string& source, VideoCodec codec)
+    : source_(source), codec_(codec), frames_(nullptr), frameCount_(0), keyframes_(nullptr), keyframeCount_(0),
+      base_(nullptr), size_(0), mapping_(nullptr), mappingSize_(0), duration90k_(0) {
+}
+
+MediaClip::~MediaClip() {
+    if (mapping_) {
+        munmap(mapping_, mappingSize_);
+    }
+    LOG_INFO("MediaCache: released {}", source_);
+}
+
+size_t MediaClip::keyframeAtOrBefore(uint64_t dts90k) const {
+    if (keyframeCount_ == 0) {
+        return 0;
+    }
+    const uint32_t* end = keyframes_ + keyframeCount_;
+    const uint32_t* next = std::upper_bound(keyframes_, end, dts90k, [this](uint64_t dts, uint32_t index) {
+        return dts < frames_[index].dts90k;
+    });
+    return next == keyframes_ ? *keyframes_ : *(next - 1);
+}
+
+MediaCache& MediaCache::instance() {
+    static MediaCache cache;
+    return cache;
+}
+
+std::shared_ptr<const MediaClip> MediaCache::acquire(const std::string& path) {
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<Entry>& slot = entries_[path];
+        if (!slot) {
+            slot = std::make_shared<Entry>();
+        }
+        entry = slot;
+    }
+
+    std::lock_guard<std::mutex> loadLock(entry->loadMutex);
+    std::shared_ptr<const MediaClip> clip = entry->clip.lock();
+    if (!clip) {
+        clip = load(path);
+        entry->clip = clip;
+    }
+    return clip;
+}
+
+size_t MediaCache::clipCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (const auto& pair : entries_) {
+        if (!pair.second->clip.expired()) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+std::shared_ptr<MediaClip> MediaCache::load(const std::string& path) {
+    MediaSource source(path, false);
+    if (!source.open()) {
+        return nullptr;
+    }
+
+    auto clip = std::make_shared<MediaClip>(path, source.codec());
+    PsMuxer muxer(source.codec());
+    std::vector<uint8_t> packed;
+    MediaFrame frame;
+    uint64_t firstDts = 0;
+    uint64_t lastDts = 0;
+
+    while (source.readFrame(frame) && packed.size() < MAX_CLIP_BYTES) {
+        if (clip->ownedFrames_.empty()) {
+            if (!frame.keyframe) {
+                continue; // Every loop has to start decodable
+            }
+            firstDts = frame.dts90k;
+        }
+        // Rebase so the ring starts at 0. PS timestamps restart on every loop;
+        // the RTP timestamps written per session stay continuous.
+        uint64_t pts = frame.pts90k >= firstDts ? frame.pts90k - firstDts : 0;
+        uint64_t dts = frame.dts90k >= firstDts ? frame.dts90k - firstDts : 0;
+
+        bool reference = frame.keyframe ||
+                         isReferenceAccessUnit(frame.data.data(), frame.data.size(), source.codec() == VideoCodec::H265);
+        ClipFrame entry{packed.size(), 0, pts, dts, frame.keyframe, reference};
+        muxer.mux(frame.data.data(), frame.data.size(), pts, dts, frame.keyframe, packed);
+        entry.size = packed.size() - entry.offset;
+        if (entry.keyframe) {
+            clip->ownedKeyframes_.push_back(static_cast<uint32_t>(clip->ownedFrames_.size()));
+        }
+        clip->ownedFrames_.push_back(entry);
+        lastDts = dts;
+    }
+
+    if (clip->ownedFrames_.empty()) {
+        LOG_ERROR("MediaCache: no decodable frames in {}", path);
+        return nullptr;
+    }
+    clip->duration90k_ = lastDts + source.frameDuration90k();
+
+    // Copy into a private anonymous mapping and seal it read-only: every
+    // session reads the same pages and nothing can scribble on them.
+    void* region = mmap(nullptr, packed.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        LOG_ERROR("MediaCache: failed to map {} bytes for {}", packed.size(), path);
+        return nullptr;
+    }
+    memcpy(region, packed.data(), packed.size());
+    mprotect(region, packed.size(), PROT_READ);
+    clip->base_ = static_cast<uint8_t*>(region);
+    clip->size_ = packed.size();
+    clip->mapping_ = region;
+    clip->mappingSize_ = packed.size();
+    clip->frames_ = clip->ownedFrames_.data();
+    clip->frameCount_ = clip->ownedFrames_.size();
+    clip->keyframes_ = clip->ownedKeyframes_.data();
+    clip->keyframeCount_ = clip->ownedKeyframes_.size();
+
+    LOG_INFO("MediaCache: loaded {} ({} frames, {} bytes)", path, clip->frameCount_, clip->size_);
+    return clip;
+}
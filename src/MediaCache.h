@@ -0,0 +1,107 @@
+#ifndef MEDIA_CACHE_H
+#define MEDIA_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include "MediaSource.h"
+
+// One frame of a cached clip, already wrapped in a PS pack
+struct ClipFrame {
+    size_t offset;      // Into the clip's mapped region
+    size_t size;
+    uint64_t pts90k;    // Relative to the start of the clip
+    uint64_t dts90k;
+    bool keyframe;
+    bool reference;     // Other frames predict from it; false frames may be thinned out
+};
+
+// Read-only view of a clip's frame table
+class ClipFrames {
+public:
+    ClipFrames(const ClipFrame* data, size_t count) : data_(data), count_(count) {}
+
+    const ClipFrame& operator[](size_t index) const { return data_[index]; }
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    const ClipFrame* begin() const { return data_; }
+    const ClipFrame* end() const { return data_ + count_; }
+
+private:
+    const ClipFrame* data_;
+    size_t count_;
+};
+
+// A source demuxed and PS-muxed once, stored read-only in a mapping: an
+// anonymous one for cached live sources, or a recording's sidecar file.
+// Sessions walk it and only write their own RTP headers.
+class MediaClip {
+public:
+    MediaClip(const std::string& source, VideoCodec codec);
+    ~MediaClip();
+
+    MediaClip(const MediaClip&) = delete;
+    MediaClip& operator=(const MediaClip&) = delete;
+
+    const std::string& source() const { return source_; }
+    VideoCodec codec() const { return codec_; }
+    ClipFrames frames() const { return ClipFrames(frames_, frameCount_); }
+    const uint8_t* data(const ClipFrame& frame) const { return base_ + frame.offset; }
+    uint64_t duration90k() const { return duration90k_; } // Timestamp advance per loop
+    size_t sizeBytes() const { return size_; }
+
+    // Index of the last keyframe at or before dts90k, or of the first
+    // keyframe if there is none. Binary search over the keyframe index.
+    size_t keyframeAtOrBefore(uint64_t dts90k) const;
+
+private:
+    friend class MediaCache;
+    friend class RecordingStore;
+
+    std::string source_;
+    VideoCodec codec_;
+    std::vector<ClipFrame> ownedFrames_;     // Cached sources; recordings map theirs
+    std::vector<uint32_t> ownedKeyframes_;
+    const ClipFrame* frames_;
+    size_t frameCount_;
+    const uint32_t* keyframes_;              // Indices into frames_, ascending
+    size_t keyframeCount_;
+    uint8_t* base_;                          // PS data
+    size_t size_;
+    void* mapping_;                          // Unmapped on destruction
+    size_t mappingSize_;
+    uint64_t duration90k_;
+};
+
+// Process-wide cache of MediaClips keyed by source path. A clip lives as long
+// as some session holds it, so N viewers of one source cost one read and one
+// mux, and memory stays roughly constant in the number of viewers.
+class MediaCache {
+public:
+    static MediaCache& instance();
+
+    // Returns the cached clip for path, loading it on first use. Concurrent
+    // callers for the same path wait for a single load.
+    std::shared_ptr<const MediaClip> acquire(const std::string& path);
+
+    size_t clipCount();
+
+private:
+    MediaCache() = default;
+
+    struct Entry {
+        std::mutex loadMutex;
+        std::weak_ptr<const MediaClip> clip;
+    };
+
+    std::shared_ptr<MediaClip> load(const std::string& path);
+
+    std::mutex mutex_; // Guards entries_ only, never held while loading
+    std::unordered_map<std::string, std::shared_ptr<Entry>> entries_;
+};
+
+#endif // MEDIA_CACHE_H
@@ -0,0 +1,165 @@
+#include "MediaSource.h"
+#include "Log.h"
+#include <algorithm>
+#include <cerrno>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
+}
+
+namespace {
+const AVRational RTP_TIME_BASE = {1, 90000};
+const uint64_t DEFAULT_FRAME_DURATION_90K = 90000 / 25;
+}
+
+MediaSource::MediaSource(const std::string& path, bool loop)
+    : path_(path), loop_(loop), formatContext_(nullptr), bsfContext_(nullptr), packet_(nullptr), videoStreamIndex_(-1),
+      codec_(VideoCodec::H264), frameDuration90k_(DEFAULT_FRAME_DURATION_90K), frameIndex_(0),
+      loopOffset90k_(0), lastPts90k_(0), firstPts_(AV_NOPTS_VALUE) {
+}
+
+MediaSource::~MediaSource() {
+    if (bsfContext_) {
+        av_bsf_free(&bsfContext_);
+    }
+    if (packet_) {
+        av_packet_free(&packet_);
+    }
+    if (formatContext_) {
+        avformat_close_input(&formatContext_);
+    }
+}
+
+bool MediaSource::open() {
+    if (avformat_open_input(&formatContext_, path_.c_str(), nullptr, nullptr) != 0) {
+        LOG_ERROR("MediaSource: failed to open {}", path_);
+        return false;
+    }
+    if (avformat_find_stream_info(formatContext_, nullptr) < 0) {
+        LOG_ERROR("MediaSource: no stream info in {}", path_);
+        return false;
+    }
+
+    videoStreamIndex_ = av_find_best_stream(formatContext_, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (videoStreamIndex_ < 0) {
+        LOG_ERROR("MediaSource: no video stream in {}", path_);
+        return false;
+    }
+
+    AVStream* stream = formatContext_->streams[videoStreamIndex_];
+    const char* bsfName = nullptr;
+    if (stream->codecpar->codec_id == AV_CODEC_ID_H264) {
+        codec_ = VideoCodec::H264;
+        bsfName = "h264_mp4toannexb";
+    } else if (stream->codecpar->codec_id == AV_CODEC_ID_HEVC) {
+        codec_ = VideoCodec::H265;
+        bsfName = "hevc_mp4toannexb";
+    } else {
+        LOG_ERROR("MediaSource: {} is neither H.264 nor H.265", path_);
+        return false;
+    }
+
+    AVRational rate = stream->avg_frame_rate.num > 0 ? stream->avg_frame_rate : stream->r_frame_rate;
+    if (rate.num > 0 && rate.den > 0) {
+        frameDuration90k_ = av_rescale_q(1, AVRational{rate.den, rate.num}, RTP_TIME_BASE);
+    }
+
+    // Sources stored as avcC/hvcC (mp4, flv, mkv) need converting to Annex B.
+    // The filter passes data through unchanged when it is Annex B already.
+    const AVBitStreamFilter* filter = av_bsf_get_by_name(bsfName);
+    if (filter && av_bsf_alloc(filter, &bsfContext_) == 0) {
+        avcodec_parameters_copy(bsfContext_->par_in, stream->codecpar);
+        bsfContext_->time_base_in = stream->time_base;
+        if (av_bsf_init(bsfContext_) < 0) {
+            av_bsf_free(&bsfContext_);
+        }
+    }
+
+    packet_ = av_packet_alloc();
+    return packet_ != nullptr;
+}
+
+bool MediaSource::readPacket(AVPacket* packet) {
+    while (true) {
+        if (bsfContext_) {
+            int ret = av_bsf_receive_packet(bsfContext_, packet);
+            if (ret == 0) {
+                return true;
+            }
+            if (ret != AVERROR(EAGAIN)) {
+                return false;
+            }
+        }
+
+        if (av_read_frame(formatContext_, packet) < 0) {
+            return false;
+        }
+        if (packet->stream_index != videoStreamIndex_) {
+            av_packet_unref(packet);
+            continue;
+        }
+        if (!bsfContext_) {
+            return true;
+        }
+        if (av_bsf_send_packet(bsfContext_, packet) < 0) {
+            av_packet_unref(packet);
+            return false;
+        }
+    }
+}
+
+bool MediaSource::rewind() {
+    AVStream* stream = formatContext_->streams[videoStreamIndex_];
+    int64_t start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    if (av_seek_frame(formatContext_, videoStreamIndex_, start, AVSEEK_FLAG_BACKWARD) < 0) {
+        return false;
+    }
+
+    loopOffset90k_ += lastPts90k_ + frameDuration90k_;
+    lastPts90k_ = 0;
+    firstPts_ = AV_NOPTS_VALUE;
+    frameIndex_ = 0;
+    return true;
+}
+
+bool MediaSource::readFrame(MediaFrame& frame) {
+    if (!formatContext_ || !packet_) {
+        return false;
+    }
+
+    if (!readPacket(packet_)) {
+        // End of file (or a read error): start over so a clip can be streamed indefinitely
+        if (!loop_ || !rewind() || !readPacket(packet_)) {
+            return false;
+        }
+    }
+
+    AVStream* stream = formatContext_->streams[videoStreamIndex_];
+    int64_t pts = packet_->pts != AV_NOPTS_VALUE ? packet_->pts : packet_->dts;
+    uint64_t pts90k;
+    uint64_t dts90k;
+    if (pts == AV_NOPTS_VALUE) {
+        // Raw elementary streams often carry no timestamps at all
+        pts90k = frameIndex_ * frameDuration90k_;
+        dts90k = pts90k;
+    } else {
+        if (firstPts_ == AV_NOPTS_VALUE) {
+            firstPts_ = pts;
+        }
+        pts90k = pts > firstPts_ ? av_rescale_q(pts - firstPts_, stream->time_base, RTP_TIME_BASE) : 0;
+        int64_t dts = packet_->dts != AV_NOPTS_VALUE ? packet_->dts : pts;
+        dts90k = dts > firstPts_ ? av_rescale_q(dts - firstPts_, stream->time_base, RTP_TIME_BASE) : 0;
+    }
+
+    frame.data.assign(packet_->data, packet_->data + packet_->size);
+    frame.pts90k = pts90k + loopOffset90k_;
+    frame.dts90k = dts90k + loopOffset90k_;
+    frame.keyframe = (packet_->flags & AV_PKT_FLAG_KEY) != 0;
+    lastPts90k_ = std::max(lastPts90k_, pts90k);
+    ++frameIndex_;
+
+    av_packet_unref(packet_);
+    return true;
+}
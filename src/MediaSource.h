@@ -0,0 +1,63 @@
+#ifndef MEDIA_SOURCE_H
+#define MEDIA_SOURCE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct AVFormatContext;
+struct AVBSFContext;
+struct AVPacket;
+
+enum class VideoCodec {
+    H264,
+    H265
+};
+
+// One access unit of Annex B elementary stream data
+struct MediaFrame {
+    std::vector<uint8_t> data;
+    uint64_t pts90k = 0; // Presentation timestamp on the 90 kHz RTP clock
+    uint64_t dts90k = 0;
+    bool keyframe = false;
+};
+
+// Demuxes pre-encoded H.264/H.265 video from a file (raw .h264/.h265, mp4, flv, ...)
+// using libavformat. No decoding or encoding is done; frames are handed out as
+// Annex B access units. When looping, the source rewinds at end of file and
+// keeps timestamps continuous; otherwise readFrame() returns false there.
+class MediaSource {
+public:
+    explicit MediaSource(const std::string& path, bool loop = true);
+    ~MediaSource();
+
+    MediaSource(const MediaSource&) = delete;
+    MediaSource& operator=(const MediaSource&) = delete;
+
+    bool open();
+    bool readFrame(MediaFrame& frame);
+
+    VideoCodec codec() const { return codec_; }
+    uint64_t frameDuration90k() const { return frameDuration90k_; }
+    const std::string& path() const { return path_; }
+
+private:
+    bool readPacket(AVPacket* packet);
+    bool rewind();
+
+    std::string path_;
+    bool loop_;
+    AVFormatContext* formatContext_;
+    AVBSFContext* bsfContext_;
+    AVPacket* packet_;
+    int videoStreamIndex_;
+    VideoCodec codec_;
+
+    uint64_t frameDuration90k_; // Used when the container carries no timestamps
+    uint64_t frameIndex_;
+    uint64_t loopOffset90k_;    // Added to timestamps after each rewind
+    uint64_t lastPts90k_;
+    int64_t firstPts_;
+};
+
+#endif // MEDIA_SOURCE_H
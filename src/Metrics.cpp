@@ -0,0 +1,88 @@
+#include "Metrics.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+struct MetricInfo {
+    const char* name;
+    const char* labels; // Without braces; empty for none
+    const char* type;
+    const char* help;   // Once per family, on its first entry
+    double scale;       // Stored value to exported unit
+};
+
+const MetricInfo METRIC_INFO[Metrics::MetricCount] = {
+    {"gb_sip_events_total", "type=\"registration_success\"", "counter", "SIP events received, by eXosip event type", 1},
+    {"gb_sip_events_total", "type=\"registration_failure\"", "counter", "", 1},
+    {"gb_sip_events_total", "type=\"message_new\"", "counter", "", 1},
+    {"gb_sip_events_total", "type=\"message_answered\"", "counter", "", 1},
+    {"gb_sip_events_total", "type=\"call_invite\"", "counter", "", 1},
+    {"gb_sip_events_total", "type=\"call_ack\"", "counter", "", 1},
+    {"gb_sip_events_total", "type=\"call_closed\"", "counter", "", 1},
+    {"gb_sip_events_total", "type=\"other\"", "counter", "", 1},
+    {"gb_register_failures_total", "", "counter", "REGISTER transactions that failed, challenges answered excluded", 1},
+    {"gb_rtp_sessions", "", "gauge", "RTP sessions in progress", 1},
+    {"gb_rtp_packets_sent_total", "", "counter", "RTP packets sent", 1},
+    {"gb_rtp_bytes_sent_total", "", "counter", "RTP bytes sent, headers included", 1},
+    {"gb_rtp_sessions_lock_waits_total", "", "counter", "Contended acquisitions of the RTP session table lock", 1},
+    {"gb_rtp_sessions_lock_wait_seconds_total", "", "counter", "Time spent waiting for the RTP session table lock",
+     1e-9},
+};
+}
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Metrics() : nextShard_(0) {
+    for (Shard& shard : shards_) {
+        for (auto& value : shard.values) {
+            value.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+Metrics::Shard& Metrics::shard() {
+    // There is only the one instance, so the thread's pick can be global
+    thread_local Shard& shard = shards_[nextShard_.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT];
+    return shard;
+}
+
+int64_t Metrics::value(Id id) const {
+    int64_t sum = 0;
+    for (const Shard& shard : shards_) {
+        sum += shard.values[id].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+void Metrics::render(std::string& out) const {
+    char line[256];
+    const char* family = "";
+    for (int id = 0; id < MetricCount; ++id) {
+        const MetricInfo& info = METRIC_INFO[id];
+        if (strcmp(info.name, family) != 0) {
+            family = info.name;
+            out += "# HELP ";
+            out += info.name;
+            out += ' ';
+            out += info.help;
+            out += "\n# TYPE ";
+            out += info.name;
+            out += ' ';
+            out += info.type;
+            out += '\n';
+        }
+        int64_t sum = value(static_cast<Id>(id));
+        const char* open = *info.labels ? "{" : "";
+        const char* close = *info.labels ? "}" : "";
+        if (info.scale == 1) {
+            snprintf(line, sizeof(line), "%s%s%s%s %lld\n", info.name, open, info.labels, close,
+                     static_cast<long long>(sum));
+        } else {
+            snprintf(line, sizeof(line), "%s%s%s%s %.9g\n", info.name, open, info.labels, close, sum * info.scale);
+        }
+        out += line;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Process-wide counters and gauges, served in the Prometheus text format on
+// the web server's /metrics. Each thread adds into its own cache-line-aligned
+// shard (threads are spread round robin over SHARD_COUNT of them), so the hot
+// paths never write a line another core is writing; a scrape sums the shards.
+class Metrics {
+public:
+    enum Id {
+        // SIP events taken off the eXosip context, by eXosip_event_type
+        SipRegistrationSuccess,
+        SipRegistrationFailure,
+        SipMessageNew,
+        SipMessageAnswered,
+        SipCallInvite,
+        SipCallAck,
+        SipCallClosed,
+        SipOther,
+
+        RegisterFailures,
+        RtpSessions,          // Gauge: entries in Gb28181Client::rtpSessions_
+        RtpPackets,
+        RtpBytes,
+        RtpSessionsLockWaits, // Contended acquisitions of rtpSessionsMutex_
+        RtpSessionsLockWaitNs,
+        MetricCount
+    };
+
+    static Metrics& instance();
+
+    void add(Id id, int64_t delta = 1) { shard().values[id].fetch_add(delta, std::memory_order_relaxed); }
+
+    int64_t value(Id id) const;
+    void render(std::string& out) const;
+
+private:
+    static const size_t SHARD_COUNT = 16;
+
+    struct alignas(64) Shard {
+        std::atomic<int64_t> values[MetricCount];
+    };
+
+    Metrics();
+
+    Shard& shard();
+
+    Shard shards_[SHARD_COUNT];
+    std::atomic<size_t> nextShard_;
+};
+
+// lock_guard that accounts for contention on the mutex: the uncontended path
+// is a plain try_lock, only a thread that has to wait reads the clock
+class TimedLockGuard {
+public:
+    TimedLockGuard(std::mutex& mutex, Metrics::Id waits, Metrics::Id waitNs) : mutex_(mutex) {
+        if (mutex_.try_lock()) {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        mutex_.lock();
+        auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        Metrics& metrics = Metrics::instance();
+        metrics.add(waits);
+        metrics.add(waitNs, waited.count());
+    }
+    ~TimedLockGuard() { mutex_.unlock(); }
+
+    TimedLockGuard(const TimedLockGuard&) = delete;
+    TimedLockGuard& operator=(const TimedLockGuard&) = delete;
+
+private:
+    std::mutex& mutex_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,177 @@
+#include "PortAllocator.h"
+#include "Log.h"
+#include <cerrno>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+PortLease::~PortLease() {
+    release();
+}
+
+PortLease::PortLease(PortLease&& other) noexcept
+    : allocator_(other.allocator_), rtpPort_(other.rtpPort_), rtpSocket_(other.rtpSocket_), rtcpSocket_(other.rtcpSocket_),
+      tcpSocket_(other.tcpSocket_) {
+    other.allocator_ = nullptr;
+    other.rtpSocket_ = -1;
+    other.rtcpSocket_ = -1;
+    other.tcpSocket_ = -1;
+}
+
+PortLease& PortLease::operator=(PortLease&& other) noexcept {
+    if (this != &other) {
+        release();
+        allocator_ = other.allocator_;
+        rtpPort_ = other.rtpPort_;
+        rtpSocket_ = other.rtpSocket_;
+        rtcpSocket_ = other.rtcpSocket_;
+        tcpSocket_ = other.tcpSocket_;
+        other.allocator_ = nullptr;
+        other.rtpSocket_ = -1;
+        other.rtcpSocket_ = -1;
+        other.tcpSocket_ = -1;
+    }
+    return *this;
+}
+
+void PortLease::release() {
+    if (rtpSocket_ >= 0) {
+        close(rtpSocket_);
+        rtpSocket_ = -1;
+    }
+    if (rtcpSocket_ >= 0) {
+        close(rtcpSocket_);
+        rtcpSocket_ = -1;
+    }
+    if (tcpSocket_ >= 0) {
+        close(tcpSocket_);
+        tcpSocket_ = -1;
+    }
+    if (allocator_) {
+        allocator_->release(rtpPort_);
+        allocator_ = nullptr;
+    }
+}
+
+PortAllocator::PortAllocator(int firstPort, int lastPort, bool reusePort)
+    : firstPort_(firstPort + (firstPort & 1)), pairCount_(0), reusePort_(reusePort), head_(0), freeCount_(0),
+      inUse_(0), bindFailures_(0) {
+    // RTP takes the even port of each pair
+    if (lastPort > firstPort_) {
+        pairCount_ = static_cast<size_t>(lastPort - firstPort_ + 1) / 2;
+    }
+    ring_.resize(pairCount_);
+    for (size_t i = 0; i < pairCount_; ++i) {
+        ring_[i] = static_cast<uint32_t>(i);
+    }
+    freeCount_ = pairCount_;
+    leased_.assign((pairCount_ + 63) / 64, 0);
+}
+
+PortLease PortAllocator::acquire(bool tcp) {
+    // A pair that fails to bind goes back to the end of the queue, so one
+    // pass over the free pairs is enough
+    size_t attempts;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        attempts = freeCount_;
+    }
+
+    for (size_t attempt = 0; attempt < attempts; ++attempt) {
+        uint32_t index;
+        if (!pop(index)) {
+            break;
+        }
+        int port = firstPort_ + static_cast<int>(index) * 2;
+        bool portTaken = false;
+        int rtpSocket = bindSocket(SOCK_DGRAM, port, portTaken);
+        int rtcpSocket = rtpSocket >= 0 ? bindSocket(SOCK_DGRAM, port + 1, portTaken) : -1;
+        int tcpSocket = rtcpSocket >= 0 && tcp ? bindSocket(SOCK_STREAM, port, portTaken) : -1;
+        if (rtcpSocket >= 0 && (!tcp || tcpSocket >= 0)) {
+            return PortLease(this, port, rtpSocket, rtcpSocket, tcpSocket);
+        }
+
+        if (rtpSocket >= 0) {
+            close(rtpSocket);
+        }
+        if (rtcpSocket >= 0) {
+            close(rtcpSocket);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            leased_[index / 64] &= ~(uint64_t(1) << (index % 64));
+            inUse_.fetch_sub(1, std::memory_order_relaxed);
+            push(index);
+        }
+        if (!portTaken) {
+            return PortLease(); // Out of descriptors; other pairs would fail the same way
+        }
+        bindFailures_.fetch_add(1, std::memory_order_relaxed);
+        LOG_WARN("RTP port pair {}/{} is taken outside this process, skipped.", port, port + 1);
+    }
+    LOG_WARN("No free RTP port pair ({} of {} in use).", inUse(), pairCount_);
+    return PortLease();
+}
+
+void PortAllocator::release(int rtpPort) {
+    uint32_t index = static_cast<uint32_t>((rtpPort - firstPort_) / 2);
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t bit = uint64_t(1) << (index % 64);
+    if (!(leased_[index / 64] & bit)) {
+        LOG_ERROR("RTP port {} released twice.", rtpPort);
+        return;
+    }
+    leased_[index / 64] &= ~bit;
+    inUse_.fetch_sub(1, std::memory_order_relaxed);
+    push(index);
+}
+
+bool PortAllocator::pop(uint32_t& index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (freeCount_ == 0) {
+        return false;
+    }
+    index = ring_[head_];
+    head_ = (head_ + 1) % pairCount_;
+    --freeCount_;
+    leased_[index / 64] |= uint64_t(1) << (index % 64);
+    inUse_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void PortAllocator::push(uint32_t index) {
+    ring_[(head_ + freeCount_) % pairCount_] = index;
+    ++freeCount_;
+}
+
+int PortAllocator::bindSocket(int type, int port, bool& portTaken) const {
+    int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create media socket: {}", strerror(errno));
+        return -1;
+    }
+    if (type == SOCK_STREAM) {
+        // The previous call on this port may still be in TIME_WAIT
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if (reusePort_) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        portTaken = errno == EADDRINUSE || errno == EACCES;
+        if (!portTaken) {
+            LOG_ERROR("Failed to bind media port {}: {}", port, strerror(errno));
+        }
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,92 @@
+#ifndef PORT_ALLOCATOR_H
+#define PORT_ALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class PortAllocator;
+
+// An RTP/RTCP port pair (even RTP port, RTCP on the next one) with both UDP
+// sockets already bound, plus a TCP socket bound to the RTP port when media
+// goes over TCP. Move-only; closing the sockets and returning the
+// pair to the allocator happen together on destruction, so a port is never
+// handed out while its old socket is still open.
+class PortLease {
+public:
+    PortLease() = default;
+    ~PortLease();
+
+    PortLease(PortLease&& other) noexcept;
+    PortLease& operator=(PortLease&& other) noexcept;
+    PortLease(const PortLease&) = delete;
+    PortLease& operator=(const PortLease&) = delete;
+
+    bool valid() const { return allocator_ != nullptr; }
+    int rtpPort() const { return rtpPort_; }
+    int rtcpPort() const { return rtpPort_ + 1; }
+    int rtpSocket() const { return rtpSocket_; }
+    int rtcpSocket() const { return rtcpSocket_; }
+    int tcpSocket() const { return tcpSocket_; } // -1 unless acquired with tcp
+
+    void release();
+
+private:
+    friend class PortAllocator;
+    PortLease(PortAllocator* allocator, int rtpPort, int rtpSocket, int rtcpSocket, int tcpSocket)
+        : allocator_(allocator), rtpPort_(rtpPort), rtpSocket_(rtpSocket), rtcpSocket_(rtcpSocket), tcpSocket_(tcpSocket) {}
+
+    PortAllocator* allocator_ = nullptr;
+    int rtpPort_ = 0;
+    int rtpSocket_ = -1;
+    int rtcpSocket_ = -1;
+    int tcpSocket_ = -1;
+};
+
+// Hands out RTP/RTCP port pairs from [firstPort, lastPort]. Free pairs sit in a
+// FIFO ring, so acquire and release are O(1) and a released pair goes to the
+// back of the queue: stray packets for an ended call are unlikely to reach the
+// next one. A bitmap tracks which pairs are leased. Every pair is bound before
+// it is handed out; pairs taken by another process are skipped and retried
+// when they come round again. Thread-safe; must outlive its leases.
+class PortAllocator {
+public:
+    PortAllocator(int firstPort, int lastPort, bool reusePort = false);
+
+    PortAllocator(const PortAllocator&) = delete;
+    PortAllocator& operator=(const PortAllocator&) = delete;
+
+    // Returns an invalid lease when every pair is in use or fails to bind.
+    // With tcp, a TCP socket is bound to the RTP port as well (not yet
+    // listening or connected).
+    PortLease acquire(bool tcp = false);
+
+    size_t capacity() const { return pairCount_; }
+    size_t inUse() const { return inUse_.load(std::memory_order_relaxed); }
+    double utilization() const { return pairCount_ ? static_cast<double>(inUse()) / pairCount_ : 0.0; }
+    uint64_t bindFailures() const { return bindFailures_.load(std::memory_order_relaxed); }
+
+private:
+    friend class PortLease;
+    void release(int rtpPort);
+    bool pop(uint32_t& index);
+    void push(uint32_t index); // Called with mutex_ held
+    int bindSocket(int type, int port, bool& portTaken) const;
+
+    int firstPort_;
+    size_t pairCount_;
+    bool reusePort_;
+
+    std::mutex mutex_;
+    std::vector<uint32_t> ring_; // Free pair indexes, FIFO
+    size_t head_;
+    size_t freeCount_;
+    std::vector<uint64_t> leased_; // One bit per pair
+
+    std::atomic<size_t> inUse_;
+    std::atomic<uint64_t> bindFailures_;
+};
+
+#endif // PORT_ALLOCATOR_H
@@ -0,0 +1,130 @@
+#include "PsMuxer.h"
+
+namespace {
+const uint8_t VIDEO_STREAM_ID = 0xE0;
+const uint8_t STREAM_TYPE_H264 = 0x1B;
+const uint8_t STREAM_TYPE_H265 = 0x24;
+const uint32_t MUX_RATE = 50000;      // In units of 50 bytes/s (20 Mbit/s)
+const size_t MAX_PES_PAYLOAD = 0xFFFF - 3 - 10; // PES_packet_length limit minus PTS+DTS header
+
+// CRC-32/MPEG-2 as required at the end of the program stream map
+uint32_t crc32Mpeg2(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+void writeTimestamp(std::vector<uint8_t>& out, uint8_t prefix, uint64_t ts) {
+    out.push_back(static_cast<uint8_t>((prefix << 4) | (((ts >> 30) & 0x07) << 1) | 0x01));
+    out.push_back(static_cast<uint8_t>((ts >> 22) & 0xFF));
+    out.push_back(static_cast<uint8_t>((((ts >> 15) & 0x7F) << 1) | 0x01));
+    out.push_back(static_cast<uint8_t>((ts >> 7) & 0xFF));
+    out.push_back(static_cast<uint8_t>(((ts & 0x7F) << 1) | 0x01));
+}
+}
+
+PsMuxer::PsMuxer(VideoCodec codec)
+    : streamType_(codec == VideoCodec::H265 ? STREAM_TYPE_H265 : STREAM_TYPE_H264) {
+}
+
+void PsMuxer::mux(const uint8_t* data, size_t size, uint64_t pts90k, uint64_t dts90k, bool keyframe, std::vector<uint8_t>& out) {
+    // Timestamps are 33 bits on the wire
+    uint64_t pts = pts90k & 0x1FFFFFFFFULL;
+    uint64_t dts = dts90k & 0x1FFFFFFFFULL;
+
+    out.reserve(out.size() + size + 64 + (size / MAX_PES_PAYLOAD + 1) * 19);
+    writePackHeader(out, dts);
+    if (keyframe) {
+        writeSystemHeader(out);
+        writeProgramStreamMap(out);
+    }
+
+    bool first = true;
+    while (size > 0) {
+        size_t chunk = size < MAX_PES_PAYLOAD ? size : MAX_PES_PAYLOAD;
+        writePes(out, data, chunk, pts, dts, first);
+        data += chunk;
+        size -= chunk;
+        first = false;
+    }
+}
+
+void PsMuxer::writePackHeader(std::vector<uint8_t>& out, uint64_t scr) {
+    const uint8_t header[] = {
+        0x00, 0x00, 0x01, 0xBA,
+        static_cast<uint8_t>(0x44 | ((scr >> 27) & 0x38) | ((scr >> 28) & 0x03)),
+        static_cast<uint8_t>((scr >> 20) & 0xFF),
+        static_cast<uint8_t>(0x04 | ((scr >> 12) & 0xF8) | ((scr >> 13) & 0x03)),
+        static_cast<uint8_t>((scr >> 5) & 0xFF),
+        static_cast<uint8_t>(0x04 | ((scr << 3) & 0xF8)), // SCR extension is always 0
+        0x01,
+        static_cast<uint8_t>((MUX_RATE >> 14) & 0xFF),
+        static_cast<uint8_t>((MUX_RATE >> 6) & 0xFF),
+        static_cast<uint8_t>(((MUX_RATE << 2) & 0xFC) | 0x03),
+        0xF8 // No pack stuffing
+    };
+    out.insert(out.end(), header, header + sizeof(header));
+}
+
+void PsMuxer::writeSystemHeader(std::vector<uint8_t>& out) {
+    const uint8_t header[] = {
+        0x00, 0x00, 0x01, 0xBB,
+        0x00, 0x09, // header_length: 6 fixed bytes + one stream entry
+        static_cast<uint8_t>(0x80 | ((MUX_RATE >> 15) & 0x7F)),
+        static_cast<uint8_t>((MUX_RATE >> 7) & 0xFF),
+        static_cast<uint8_t>(((MUX_RATE << 1) & 0xFE) | 0x01),
+        0x00, // audio_bound 0, fixed_flag 0, CSPS_flag 0
+        0xE1, // audio/video lock, marker, video_bound 1
+        0x7F, // packet_rate_restriction_flag 0, reserved
+        VIDEO_STREAM_ID, 0xE0 | 0x04, 0x00 // P-STD buffer: scale 1, 1024 x 1 KiB
+    };
+    out.insert(out.end(), header, header + sizeof(header));
+}
+
+void PsMuxer::writeProgramStreamMap(std::vector<uint8_t>& out) {
+    size_t start = out.size();
+    const uint8_t map[] = {
+        0x00, 0x00, 0x01, 0xBC,
+        0x00, 0x0E, // program_stream_map_length
+        0xE0,       // current_next_indicator, version 0
+        0xFF,
+        0x00, 0x00, // program_stream_info_length
+        0x00, 0x04, // elementary_stream_map_length
+        streamType_, VIDEO_STREAM_ID, 0x00, 0x00
+    };
+    out.insert(out.end(), map, map + sizeof(map));
+
+    uint32_t crc = crc32Mpeg2(out.data() + start, sizeof(map));
+    out.push_back(static_cast<uint8_t>(crc >> 24));
+    out.push_back(static_cast<uint8_t>(crc >> 16));
+    out.push_back(static_cast<uint8_t>(crc >> 8));
+    out.push_back(static_cast<uint8_t>(crc));
+}
+
+void PsMuxer::writePes(std::vector<uint8_t>& out, const uint8_t* data, size_t size, uint64_t pts, uint64_t dts, bool withTimestamps) {
+    bool withDts = withTimestamps && dts != pts;
+    uint8_t headerDataLength = withTimestamps ? (withDts ? 10 : 5) : 0;
+    size_t packetLength = 3 + headerDataLength + size;
+
+    out.push_back(0x00);
+    out.push_back(0x00);
+    out.push_back(0x01);
+    out.push_back(VIDEO_STREAM_ID);
+    out.push_back(static_cast<uint8_t>(packetLength >> 8));
+    out.push_back(static_cast<uint8_t>(packetLength & 0xFF));
+    out.push_back(withTimestamps ? 0x84 : 0x80); // data_alignment_indicator on the first PES of a frame
+    out.push_back(withTimestamps ? (withDts ? 0xC0 : 0x80) : 0x00);
+    out.push_back(headerDataLength);
+    if (withTimestamps) {
+        writeTimestamp(out, withDts ? 0x03 : 0x02, pts);
+        if (withDts) {
+            writeTimestamp(out, 0x01, dts);
+        }
+    }
+    out.insert(out.end(), data, data + size);
+}
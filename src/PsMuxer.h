@@ -0,0 +1,28 @@
+#ifndef PS_MUXER_H
+#define PS_MUXER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "MediaSource.h"
+
+// Minimal MPEG-2 Program Stream muxer for GB28181 (ISO/IEC 13818-1).
+// Each access unit becomes one pack: pack header, system header and PSM on
+// keyframes, then the frame split over as many video PES packets as needed.
+class PsMuxer {
+public:
+    explicit PsMuxer(VideoCodec codec);
+
+    // Appends the PS pack for one Annex B access unit to out
+    void mux(const uint8_t* data, size_t size, uint64_t pts90k, uint64_t dts90k, bool keyframe, std::vector<uint8_t>& out);
+
+private:
+    void writePackHeader(std::vector<uint8_t>& out, uint64_t scr);
+    void writeSystemHeader(std::vector<uint8_t>& out);
+    void writeProgramStreamMap(std::vector<uint8_t>& out);
+    void writePes(std::vector<uint8_t>& out, const uint8_t* data, size_t size, uint64_t pts, uint64_t dts, bool withTimestamps);
+
+    uint8_t streamType_;
+};
+
+#endif // PS_MUXER_H
@@ -0,0 +1,146 @@
+#include "PtzCommand.h"
+#include <array>
+
+namespace {
+// Where an instruction keeps its operands (bytes 5, 6 and the high nibble of 7)
+enum class Operands : uint8_t {
+    None,     // Not an instruction
+    Move,     // Direction bits in the code; pan, tilt, zoom speeds
+    Lens,     // Focus/iris bits in the code; focus, iris speeds
+    Preset,   // Preset number in byte 6
+    Cruise,   // Group in byte 5, preset in byte 6
+    Group12,  // Group in byte 5, 12-bit value in byte 6 and the high nibble of byte 7
+    Group,    // Group in byte 5
+    Scan,     // Group in byte 5, byte 6 picks start / left edge / right edge
+    Aux       // Switch number in byte 5
+};
+
+struct Opcode {
+    Operands operands = Operands::None;
+    PtzAction action = PtzAction::Move;
+};
+
+constexpr std::array<Opcode, 256> buildOpcodes() {
+    std::array<Opcode, 256> table{};
+    for (int code = 0x00; code <= 0x3F; ++code) {
+        table[code] = Opcode{Operands::Move, PtzAction::Move};
+    }
+    for (int code = 0x40; code <= 0x4F; ++code) {
+        table[code] = Opcode{Operands::Lens, PtzAction::Lens};
+    }
+    table[0x81] = Opcode{Operands::Preset, PtzAction::SetPreset};
+    table[0x82] = Opcode{Operands::Preset, PtzAction::CallPreset};
+    table[0x83] = Opcode{Operands::Preset, PtzAction::DeletePreset};
+    table[0x84] = Opcode{Operands::Cruise, PtzAction::AddCruisePoint};
+    table[0x85] = Opcode{Operands::Cruise, PtzAction::DeleteCruisePoint};
+    table[0x86] = Opcode{Operands::Group12, PtzAction::SetCruiseSpeed};
+    table[0x87] = Opcode{Operands::Group12, PtzAction::SetCruiseDwell};
+    table[0x88] = Opcode{Operands::Group, PtzAction::StartCruise};
+    table[0x89] = Opcode{Operands::Scan, PtzAction::StartScan};
+    table[0x8A] = Opcode{Operands::Group12, PtzAction::SetScanSpeed};
+    table[0x8C] = Opcode{Operands::Aux, PtzAction::AuxOn};
+    table[0x8D] = Opcode{Operands::Aux, PtzAction::AuxOff};
+    return table;
+}
+
+constexpr std::array<Opcode, 256> OPCODES = buildOpcodes();
+
+// Value of a hex digit, or -1
+int nibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+}
+
+const char* toString(PtzDecodeResult result) {
+    switch (result) {
+        case PtzDecodeResult::Ok: return "ok";
+        case PtzDecodeResult::BadLength: return "not 16 hex digits";
+        case PtzDecodeResult::BadHex: return "not hex";
+        case PtzDecodeResult::BadHeader: return "bad header";
+        case PtzDecodeResult::BadChecksum: return "bad checksum";
+        case PtzDecodeResult::Unknown: return "unknown instruction";
+    }
+    return "?";
+}
+
+PtzDecodeResult decodePtzCmd(std::string_view hex, PtzCommand& out) {
+    if (hex.size() != 16) {
+        return PtzDecodeResult::BadLength;
+    }
+    uint8_t bytes[8];
+    for (size_t i = 0; i < 8; ++i) {
+        int high = nibble(hex[i * 2]);
+        int low = nibble(hex[i * 2 + 1]);
+        if (high < 0 || low < 0) {
+            return PtzDecodeResult::BadHex;
+        }
+        bytes[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+
+    // Byte 2: version in the high nibble, then (A + 5 + version) mod 16
+    if (bytes[0] != 0xA5 || (bytes[1] & 0x0F) != ((0xA + 0x5 + (bytes[1] >> 4)) & 0x0F)) {
+        return PtzDecodeResult::BadHeader;
+    }
+    unsigned sum = 0;
+    for (size_t i = 0; i < 7; ++i) {
+        sum += bytes[i];
+    }
+    if ((sum & 0xFF) != bytes[7]) {
+        return PtzDecodeResult::BadChecksum;
+    }
+
+    const Opcode& opcode = OPCODES[bytes[3]];
+    if (opcode.operands == Operands::None) {
+        return PtzDecodeResult::Unknown;
+    }
+
+    uint8_t data1 = bytes[4];
+    uint8_t data2 = bytes[5];
+    uint8_t data3 = bytes[6] >> 4;
+    out = PtzCommand();
+    out.action = opcode.action;
+    out.address = static_cast<uint16_t>(bytes[2] | (bytes[6] & 0x0F) << 8);
+    switch (opcode.operands) {
+        case Operands::Move:
+            out.flags = bytes[3] & 0x3F;
+            out.panSpeed = data1;
+            out.tiltSpeed = data2;
+            out.zoomSpeed = data3;
+            break;
+        case Operands::Lens:
+            out.flags = bytes[3] & 0x0F;
+            out.focusSpeed = data1;
+            out.irisSpeed = data2;
+            break;
+        case Operands::Preset:
+            out.value = data2;
+            break;
+        case Operands::Cruise:
+            out.group = data1;
+            out.value = data2;
+            break;
+        case Operands::Group12:
+            out.group = data1;
+            out.value = static_cast<uint16_t>(data2 | data3 << 8);
+            break;
+        case Operands::Group:
+            out.group = data1;
+            break;
+        case Operands::Scan:
+            out.group = data1;
+            if (data2 == 0) out.action = PtzAction::StartScan;
+            else if (data2 == 1) out.action = PtzAction::SetScanLeft;
+            else if (data2 == 2) out.action = PtzAction::SetScanRight;
+            else return PtzDecodeResult::Unknown;
+            break;
+        case Operands::Aux:
+            out.value = data1;
+            break;
+        case Operands::None:
+            break;
+    }
+    return PtzDecodeResult::Ok;
+}
@@ -0,0 +1,73 @@
+#ifndef PTZ_COMMAND_H
+#define PTZ_COMMAND_H
+
+#include <cstdint>
+#include <string_view>
+
+// GB/T 28181 front-end control instructions (annex A.3)
+enum class PtzAction : uint8_t {
+    Move,              // Pan/tilt/zoom; no direction bits means stop
+    Lens,              // Focus/iris; no bits means stop
+    SetPreset,
+    CallPreset,
+    DeletePreset,
+    AddCruisePoint,
+    DeleteCruisePoint,
+    SetCruiseSpeed,
+    SetCruiseDwell,
+    StartCruise,
+    StartScan,
+    SetScanLeft,
+    SetScanRight,
+    SetScanSpeed,
+    AuxOn,
+    AuxOff
+};
+
+// Bits of a Move
+const uint8_t PTZ_RIGHT = 0x01;
+const uint8_t PTZ_LEFT = 0x02;
+const uint8_t PTZ_DOWN = 0x04;
+const uint8_t PTZ_UP = 0x08;
+const uint8_t PTZ_ZOOM_IN = 0x10;
+const uint8_t PTZ_ZOOM_OUT = 0x20;
+
+// Bits of a Lens command
+const uint8_t PTZ_FOCUS_FAR = 0x01;
+const uint8_t PTZ_FOCUS_NEAR = 0x02;
+const uint8_t PTZ_IRIS_OPEN = 0x04;
+const uint8_t PTZ_IRIS_CLOSE = 0x08;
+
+struct PtzCommand {
+    PtzAction action = PtzAction::Move;
+    uint8_t flags = 0;      // PTZ_* bits of a Move or Lens command
+    uint8_t panSpeed = 0;   // Move
+    uint8_t tiltSpeed = 0;
+    uint8_t zoomSpeed = 0;  // 0-15
+    uint8_t focusSpeed = 0; // Lens
+    uint8_t irisSpeed = 0;
+    uint8_t group = 0;      // Cruise or scan group
+    uint16_t value = 0;     // Preset number, cruise speed or dwell, scan speed or aux switch
+    uint16_t address = 0;   // 12-bit device address
+
+    // Holds until the next command of the same action replaces it
+    bool continuous() const { return action == PtzAction::Move || action == PtzAction::Lens; }
+};
+
+enum class PtzDecodeResult {
+    Ok,
+    BadLength, // Not 16 hex digits
+    BadHex,
+    BadHeader, // First byte not A5, or its check nibble wrong
+    BadChecksum,
+    Unknown    // Instruction code we don't recognise
+};
+
+const char* toString(PtzDecodeResult result);
+
+// Decodes the 8 bytes of a PTZCmd. Validates the A5 header, the header check
+// nibble and the byte 8 checksum, then maps the instruction code through a
+// static table. Never allocates.
+PtzDecodeResult decodePtzCmd(std::string_view hex, PtzCommand& out);
+
+#endif // PTZ_COMMAND_H
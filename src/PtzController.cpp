@@ -0,0 +1,163 @@
+#include "PtzController.h"
+#include "Log.h"
+
+namespace {
+const char* actionName(PtzAction action) {
+    switch (action) {
+        case PtzAction::Move: return "move";
+        case PtzAction::Lens: return "lens";
+        case PtzAction::SetPreset: return "set preset";
+        case PtzAction::CallPreset: return "call preset";
+        case PtzAction::DeletePreset: return "delete preset";
+        case PtzAction::AddCruisePoint: return "add cruise point";
+        case PtzAction::DeleteCruisePoint: return "delete cruise point";
+        case PtzAction::SetCruiseSpeed: return "set cruise speed";
+        case PtzAction::SetCruiseDwell: return "set cruise dwell";
+        case PtzAction::StartCruise: return "start cruise";
+        case PtzAction::StartScan: return "start scan";
+        case PtzAction::SetScanLeft: return "set scan left edge";
+        case PtzAction::SetScanRight: return "set scan right edge";
+        case PtzAction::SetScanSpeed: return "set scan speed";
+        case PtzAction::AuxOn: return "aux on";
+        case PtzAction::AuxOff: return "aux off";
+    }
+    return "?";
+}
+}
+
+void LoggingPtzDriver::execute(const std::string& channelId, const PtzCommand& command) {
+    std::string detail;
+    switch (command.action) {
+        case PtzAction::Move:
+            if (command.flags == 0) {
+                detail = " stop";
+                break;
+            }
+            if (command.flags & PTZ_UP) detail += " up";
+            if (command.flags & PTZ_DOWN) detail += " down";
+            if (command.flags & PTZ_LEFT) detail += " left";
+            if (command.flags & PTZ_RIGHT) detail += " right";
+            if (command.flags & PTZ_ZOOM_IN) detail += " zoom-in";
+            if (command.flags & PTZ_ZOOM_OUT) detail += " zoom-out";
+            detail += " (pan " + std::to_string(command.panSpeed) + ", tilt " + std::to_string(command.tiltSpeed) +
+                      ", zoom " + std::to_string(command.zoomSpeed) + ")";
+            break;
+        case PtzAction::Lens:
+            if (command.flags == 0) {
+                detail = " stop";
+                break;
+            }
+            if (command.flags & PTZ_FOCUS_NEAR) detail += " focus-near";
+            if (command.flags & PTZ_FOCUS_FAR) detail += " focus-far";
+            if (command.flags & PTZ_IRIS_OPEN) detail += " iris-open";
+            if (command.flags & PTZ_IRIS_CLOSE) detail += " iris-close";
+            detail += " (focus " + std::to_string(command.focusSpeed) + ", iris " + std::to_string(command.irisSpeed) +
+                      ")";
+            break;
+        case PtzAction::SetPreset:
+        case PtzAction::CallPreset:
+        case PtzAction::DeletePreset:
+        case PtzAction::AuxOn:
+        case PtzAction::AuxOff:
+            detail = " " + std::to_string(command.value);
+            break;
+        case PtzAction::StartCruise:
+        case PtzAction::StartScan:
+        case PtzAction::SetScanLeft:
+        case PtzAction::SetScanRight:
+            detail = " group " + std::to_string(command.group);
+            break;
+        default:
+            detail = " group " + std::to_string(command.group) + ", " + std::to_string(command.value);
+            break;
+    }
+    LOG_INFO("PTZ {}: {}{}", channelId, actionName(command.action), detail);
+}
+
+PtzController::PtzController(std::unique_ptr<PtzDriver> driver, size_t queueCapacity)
+    : driver_(std::move(driver)), queueCapacity_(queueCapacity), running_(false), executed_(0), coalesced_(0),
+      dropped_(0) {}
+
+PtzController::~PtzController() {
+    stop();
+}
+
+void PtzController::addChannel(const std::string& channelId) {
+    if (!channels_.count(channelId)) {
+        channels_.emplace(channelId, std::make_unique<Channel>(channelId, queueCapacity_));
+    }
+}
+
+void PtzController::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    thread_ = std::thread(&PtzController::run, this);
+}
+
+void PtzController::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool PtzController::submit(std::string_view channelId, const PtzCommand& command) {
+    auto it = channels_.find(channelId);
+    if (it == channels_.end()) {
+        return false;
+    }
+    Channel& channel = *it->second;
+    if (!channel.queue.push(command)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // Only the push that finds the channel idle lists it
+    if (!channel.ready.exchange(true, std::memory_order_acq_rel)) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_.push_back(&channel);
+        }
+        cv_.notify_one();
+    }
+    return true;
+}
+
+void PtzController::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return !ready_.empty() || !running_; });
+        if (ready_.empty()) {
+            break;
+        }
+        Channel* channel = ready_.front();
+        ready_.pop_front();
+        lock.unlock();
+        drain(*channel);
+        lock.lock();
+    }
+}
+
+void PtzController::drain(Channel& channel) {
+    // Cleared first: a push racing with the drain below lists the channel
+    // again, at worst for an empty pass
+    channel.ready.store(false, std::memory_order_release);
+    PtzCommand command;
+    while (channel.queue.pop(command)) {
+        if (command.continuous()) {
+            const PtzCommand* next = channel.queue.peek();
+            if (next && next->action == command.action) {
+                coalesced_.fetch_add(1, std::memory_order_relaxed);
+                continue; // Superseded before it ran
+            }
+        }
+        driver_->execute(channel.id, command);
+        executed_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
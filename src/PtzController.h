@@ -0,0 +1,88 @@
+#ifndef PTZ_CONTROLLER_H
+#define PTZ_CONTROLLER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "PtzCommand.h"
+#include "SpscQueue.h"
+
+// Executes decoded PTZ commands for a channel: a camera's motor control, or
+// in this simulator a log line
+class PtzDriver {
+public:
+    virtual ~PtzDriver() = default;
+
+    // Called on the controller's thread only; may be slow
+    virtual void execute(const std::string& channelId, const PtzCommand& command) = 0;
+};
+
+// Prints each command
+class LoggingPtzDriver : public PtzDriver {
+public:
+    void execute(const std::string& channelId, const PtzCommand& command) override;
+};
+
+// Hands PTZ commands from the SIP handlers to a PtzDriver on its own thread.
+// Every channel has an SPSC queue, so submitting is a lock-free push; the
+// controller's mutex is only taken when an idle channel becomes ready. A run
+// of continuous moves (or focus/iris commands) waiting in one queue collapses
+// into the newest, so a joystick's bursts never pile up behind a slow driver.
+class PtzController {
+public:
+    explicit PtzController(std::unique_ptr<PtzDriver> driver, size_t queueCapacity = 64);
+    ~PtzController();
+
+    PtzController(const PtzController&) = delete;
+    PtzController& operator=(const PtzController&) = delete;
+
+    // Before start()
+    void addChannel(const std::string& channelId);
+
+    void start();
+    // Finishes the commands already queued, then joins the thread
+    void stop();
+
+    // Never blocks. Commands for one channel must come from one thread at a
+    // time. Returns false for an unknown channel or a full queue.
+    bool submit(std::string_view channelId, const PtzCommand& command);
+
+    uint64_t executed() const { return executed_.load(std::memory_order_relaxed); }
+    uint64_t coalesced() const { return coalesced_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Channel {
+        Channel(const std::string& channelId, size_t capacity) : id(channelId), queue(capacity) {}
+
+        std::string id;
+        SpscQueue<PtzCommand> queue;
+        std::atomic<bool> ready{false}; // Listed in ready_ or being drained
+    };
+
+    void run();
+    void drain(Channel& channel);
+
+    std::unique_ptr<PtzDriver> driver_;
+    size_t queueCapacity_;
+    std::map<std::string, std::unique_ptr<Channel>, std::less<>> channels_; // Fixed after start()
+
+    std::thread thread_;
+    std::mutex mutex_; // Guards ready_ and running_
+    std::condition_variable cv_;
+    std::deque<Channel*> ready_;
+    bool running_;
+
+    std::atomic<uint64_t> executed_;
+    std::atomic<uint64_t> coalesced_;
+    std::atomic<uint64_t> dropped_;
+};
+
+#endif // PTZ_CONTROLLER_H
@@ -0,0 +1,335 @@
+#include "RecordingStore.h"
+#include "AnnexB.h"
+#include "Log.h"
+#include "MediaSource.h"
+#include "PsMuxer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+const char SIDECAR_SUFFIX[] = ".gbrec";
+const char SIDECAR_MAGIC[8] = {'G', 'B', 'R', 'E', 'C', 0, 0, 0};
+const uint32_t SIDECAR_VERSION = 1;
+const uint64_t DATA_OFFSET = 4096; // PS data starts on its own page
+
+// First page of a sidecar. The frame table is ClipFrame as laid out by this
+// build; frameSize guards against reading one written by another ABI.
+struct SidecarHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t frameSize;
+    uint32_t codec;
+    uint32_t reserved;
+    uint64_t sourceSize;  // The recording the sidecar was built from
+    int64_t sourceMtime;
+    uint64_t duration90k;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    uint64_t framesOffset;
+    uint64_t frameCount;
+    uint64_t keyframesOffset;
+    uint64_t keyframeCount;
+};
+
+// [offset, offset + length) lies within size bytes, without overflowing
+bool fits(uint64_t offset, uint64_t length, uint64_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+// Every frame lies inside the PS data and every keyframe index names a frame
+bool tablesValid(const ClipFrame* frames, uint64_t frameCount, const uint32_t* keyframes, uint64_t keyframeCount,
+                 uint64_t dataSize) {
+    for (uint64_t i = 0; i < frameCount; ++i) {
+        if (!fits(frames[i].offset, frames[i].size, dataSize)) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < keyframeCount; ++i) {
+        if (keyframes[i] >= frameCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool endsWith(const std::string& text, const char* suffix) {
+    size_t length = strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+// 20240301120000.mp4 -> local time; -1 if the name does not start with one
+time_t parseFileTime(const std::string& name) {
+    std::tm local{};
+    if (name.size() < 14 || !strptime(name.substr(0, 14).c_str(), "%Y%m%d%H%M%S", &local)) {
+        return -1;
+    }
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+bool writeAll(FILE* file, const void* data, size_t size) {
+    return size == 0 || fwrite(data, 1, size, file) == size;
+}
+
+bool pad(FILE* file, uint64_t& offset, uint64_t alignment) {
+    static const uint8_t zeros[DATA_OFFSET] = {0};
+    uint64_t padding = (alignment - offset % alignment) % alignment;
+    offset += padding;
+    return writeAll(file, zeros, padding);
+}
+}
+
+uint64_t Recording::toClip90k(time_t time) const {
+    if (time <= startTime) {
+        return 0;
+    }
+    uint64_t offset = static_cast<uint64_t>(time - startTime) * 90000;
+    return std::min(offset, clip->duration90k());
+}
+
+RecordingStore::RecordingStore(const std::string& directory) : directory_(directory), recordingCount_(0) {
+}
+
+void RecordingStore::load() {
+    channels_.clear();
+    recordingCount_ = 0;
+    if (directory_.empty()) {
+        return;
+    }
+    DIR* dir = opendir(directory_.c_str());
+    if (!dir) {
+        LOG_INFO("RecordingStore: no recording directory {}, Playback and Download disabled.", directory_);
+        return;
+    }
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        struct stat info;
+        std::string path = directory_ + "/" + name;
+        if (name[0] != '.' && stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+            loadChannel(name, path);
+        }
+    }
+    closedir(dir);
+    LOG_INFO("RecordingStore: {} recording(s) for {} channel(s) in {}", recordingCount_, channels_.size(), directory_);
+}
+
+void RecordingStore::loadChannel(const std::string& channelId, const std::string& path) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return;
+    }
+    RecordingList& list = channels_[channelId];
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name[0] == '.' || endsWith(name, SIDECAR_SUFFIX) || endsWith(name, ".tmp")) {
+            continue;
+        }
+        time_t start = parseFileTime(name);
+        std::string source = path + "/" + name;
+        struct stat info;
+        if (start < 0 || stat(source.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+
+        std::shared_ptr<const MediaClip> clip = openSidecar(source, info);
+        if (!clip && buildSidecar(source, info)) {
+            clip = openSidecar(source, info);
+        }
+        if (!clip) {
+            LOG_WARN("RecordingStore: skipping {}", source);
+            continue;
+        }
+
+        auto recording = std::make_shared<Recording>();
+        recording->fileName = name;
+        recording->startTime = start;
+        recording->endTime = start + static_cast<time_t>((clip->duration90k() + 89999) / 90000);
+        recording->sizeBytes = static_cast<uint64_t>(info.st_size);
+        recording->clip = std::move(clip);
+        list.push_back(std::move(recording));
+        ++recordingCount_;
+    }
+    closedir(dir);
+
+    std::sort(list.begin(), list.end(), [](const std::shared_ptr<const Recording>& a, const std::shared_ptr<const Recording>& b) {
+        return a->startTime < b->startTime;
+    });
+}
+
+RecordingStore::RecordingList RecordingStore::find(const std::string& channelId, time_t start, time_t end) const {
+    auto it = channels_.find(channelId);
+    if (it == channels_.end()) {
+        it = channels_.find("default");
+    }
+    RecordingList found;
+    if (it == channels_.end()) {
+        return found;
+    }
+    // A camera records one file at a time, so end times are sorted as well
+    const RecordingList& list = it->second;
+    auto first = std::upper_bound(list.begin(), list.end(), start, [](time_t time, const std::shared_ptr<const Recording>& recording) {
+        return time < recording->endTime;
+    });
+    for (; first != list.end() && (*first)->startTime < end; ++first) {
+        found.push_back(*first);
+    }
+    return found;
+}
+
+std::shared_ptr<const MediaClip> RecordingStore::openSidecar(const std::string& source, const struct stat& info) const {
+    std::string path = source + SIDECAR_SUFFIX;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat sidecar;
+    if (fstat(fd, &sidecar) != 0 || static_cast<uint64_t>(sidecar.st_size) < DATA_OFFSET) {
+        close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(sidecar.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    const SidecarHeader& header = *static_cast<const SidecarHeader*>(mapping);
+    bool valid = memcmp(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) == 0 && header.version == SIDECAR_VERSION &&
+                 header.frameSize == sizeof(ClipFrame) && header.sourceSize == static_cast<uint64_t>(info.st_size) &&
+                 header.sourceMtime == static_cast<int64_t>(info.st_mtime) && header.frameCount > 0 &&
+                 fits(header.dataOffset, header.dataSize, size) &&
+                 header.frameCount <= size / sizeof(ClipFrame) &&
+                 fits(header.framesOffset, header.frameCount * sizeof(ClipFrame), size) &&
+                 header.framesOffset % alignof(ClipFrame) == 0 &&
+                 header.keyframeCount <= size / sizeof(uint32_t) &&
+                 fits(header.keyframesOffset, header.keyframeCount * sizeof(uint32_t), size) &&
+                 header.keyframesOffset % alignof(uint32_t) == 0;
+    const uint8_t* bytes = static_cast<const uint8_t*>(mapping);
+    // The tables are trusted from here on, down to every frame the streams send
+    valid = valid && tablesValid(reinterpret_cast<const ClipFrame*>(bytes + header.framesOffset), header.frameCount,
+                                 reinterpret_cast<const uint32_t*>(bytes + header.keyframesOffset), header.keyframeCount,
+                                 header.dataSize);
+    if (!valid) {
+        munmap(mapping, size);
+        return nullptr; // Stale, foreign or corrupt; rebuilt by the caller
+    }
+
+    auto clip = std::make_shared<MediaClip>(source, header.codec == 1 ? VideoCodec::H265 : VideoCodec::H264);
+    clip->frames_ = reinterpret_cast<const ClipFrame*>(bytes + header.framesOffset);
+    clip->frameCount_ = header.frameCount;
+    clip->keyframes_ = reinterpret_cast<const uint32_t*>(bytes + header.keyframesOffset);
+    clip->keyframeCount_ = header.keyframeCount;
+    clip->base_ = const_cast<uint8_t*>(bytes + header.dataOffset);
+    clip->size_ = header.dataSize;
+    clip->mapping_ = mapping;
+    clip->mappingSize_ = size;
+    clip->duration90k_ = header.duration90k;
+    return clip;
+}
+
+bool RecordingStore::buildSidecar(const std::string& source, const struct stat& info) const {
+    MediaSource media(source, false);
+    if (!media.open()) {
+        return false;
+    }
+    LOG_INFO("RecordingStore: indexing {}", source);
+
+    std::string temporary = source + SIDECAR_SUFFIX + ".tmp";
+    FILE* out = fopen(temporary.c_str(), "wb");
+    if (!out) {
+        LOG_ERROR("RecordingStore: cannot write {}: {}", temporary, strerror(errno));
+        return false;
+    }
+
+    // PS data streams straight to the file; only the tables stay in memory
+    uint64_t offset = 0;
+    bool ok = pad(out, offset, DATA_OFFSET);
+    PsMuxer muxer(media.codec());
+    std::vector<uint8_t> packed;
+    std::vector<ClipFrame> frames;
+    std::vector<uint32_t> keyframes;
+    MediaFrame frame;
+    uint64_t firstDts = 0;
+    uint64_t lastDts = 0;
+    while (ok && media.readFrame(frame)) {
+        if (frames.empty()) {
+            if (!frame.keyframe) {
+                continue; // Seeks land on keyframes; so does the start
+            }
+            firstDts = frame.dts90k;
+        }
+        ClipFrame entry;
+        memset(&entry, 0, sizeof(entry)); // Padding is written to disk too
+        entry.offset = offset - DATA_OFFSET;
+        entry.pts90k = frame.pts90k >= firstDts ? frame.pts90k - firstDts : 0;
+        entry.dts90k = frame.dts90k >= firstDts ? frame.dts90k - firstDts : 0;
+        entry.keyframe = frame.keyframe;
+        entry.reference = frame.keyframe || isReferenceAccessUnit(frame.data.data(), frame.data.size(),
+                                                                   media.codec() == VideoCodec::H265);
+        packed.clear();
+        muxer.mux(frame.data.data(), frame.data.size(), entry.pts90k, entry.dts90k, frame.keyframe, packed);
+        entry.size = packed.size();
+        ok = writeAll(out, packed.data(), packed.size());
+        offset += packed.size();
+        if (entry.keyframe) {
+            keyframes.push_back(static_cast<uint32_t>(frames.size()));
+        }
+        frames.push_back(entry);
+        lastDts = entry.dts90k;
+    }
+
+    SidecarHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+    header.version = SIDECAR_VERSION;
+    header.frameSize = sizeof(ClipFrame);
+    header.codec = media.codec() == VideoCodec::H265 ? 1 : 0;
+    header.sourceSize = static_cast<uint64_t>(info.st_size);
+    header.sourceMtime = static_cast<int64_t>(info.st_mtime);
+    header.duration90k = lastDts + media.frameDuration90k();
+    header.dataOffset = DATA_OFFSET;
+    header.dataSize = offset - DATA_OFFSET;
+    ok = ok && pad(out, offset, 8);
+    header.framesOffset = offset;
+    header.frameCount = frames.size();
+    ok = ok && writeAll(out, frames.data(), frames.size() * sizeof(ClipFrame));
+    offset += frames.size() * sizeof(ClipFrame);
+    header.keyframesOffset = offset;
+    header.keyframeCount = keyframes.size();
+    ok = ok && writeAll(out, keyframes.data(), keyframes.size() * sizeof(uint32_t));
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 && writeAll(out, &header, sizeof(header));
+    ok = fclose(out) == 0 && ok && !frames.empty();
+
+    // Readers only ever see a complete sidecar
+    if (!ok || rename(temporary.c_str(), (source + SIDECAR_SUFFIX).c_str()) != 0) {
+        LOG_ERROR("RecordingStore: failed to index {}", source);
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+time_t parseDeviceTime(std::string_view text) {
+    std::tm local{};
+    std::string copy(text);
+    const char* end = strptime(copy.c_str(), "%Y-%m-%dT%H:%M:%S", &local);
+    if (!end || *end != '\0') {
+        return -1;
+    }
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+std::string formatDeviceTime(time_t time) {
+    std::tm local;
+    localtime_r(&time, &local);
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &local);
+    return text;
+}
@@ -0,0 +1,64 @@
+#ifndef RECORDING_STORE_H
+#define RECORDING_STORE_H
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#include "MediaCache.h"
+
+// One recorded file of a channel
+struct Recording {
+    std::string fileName;
+    time_t startTime;   // From the file name
+    time_t endTime;     // startTime plus the clip's duration
+    uint64_t sizeBytes; // Of the recording itself
+    std::shared_ptr<const MediaClip> clip; // Mapped from the sidecar
+
+    // Clip time of a wall clock time, clamped to the recording
+    uint64_t toClip90k(time_t time) const;
+};
+
+// Historical media for Playback, Download and RecordInfo. Recordings are
+// files named after their start time, <dir>/<channel ID>/<YYYYmmddHHMMSS>.<ext>;
+// IDs without a directory of their own use <dir>/default.
+//
+// Each recording is demuxed and PS-muxed once into a <file>.gbrec sidecar
+// holding the PS data, the frame table and a keyframe index, laid out to be
+// mmapped as-is. Later runs map the sidecar instead of touching the
+// recording, so opening one costs a mmap and a seek a binary search.
+class RecordingStore {
+public:
+    using RecordingList = std::vector<std::shared_ptr<const Recording>>; // By start time
+
+    explicit RecordingStore(const std::string& directory);
+
+    // Scans the directory and maps every recording, (re)building sidecars
+    // that are missing or stale. Call before the first find(); the store is
+    // read-only afterwards.
+    void load();
+
+    // Recordings of channelId overlapping [start, end), by start time
+    RecordingList find(const std::string& channelId, time_t start, time_t end) const;
+
+    size_t size() const { return recordingCount_; }
+
+private:
+    void loadChannel(const std::string& channelId, const std::string& path);
+    std::shared_ptr<const MediaClip> openSidecar(const std::string& source, const struct stat& info) const;
+    bool buildSidecar(const std::string& source, const struct stat& info) const;
+
+    std::string directory_;
+    std::unordered_map<std::string, RecordingList> channels_;
+    size_t recordingCount_;
+};
+
+// MANSCDP local time (2024-03-01T12:00:00) to and from time_t; parse returns
+// -1 if the text is not such a time
+time_t parseDeviceTime(std::string_view text);
+std::string formatDeviceTime(time_t time);
+
+#endif // RECORDING_STORE_H
@@ -0,0 +1,101 @@
+#include "Rtcp.h"
+
+namespace {
+// Seconds from the NTP epoch (1900) to the Unix epoch (1970)
+const uint64_t NTP_UNIX_OFFSET = 2208988800ULL;
+
+void put16(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void put32(std::vector<uint8_t>& out, uint32_t value) {
+    put16(out, value >> 16);
+    put16(out, value & 0xFFFF);
+}
+
+uint32_t get32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+}
+
+uint64_t toNtp(std::chrono::system_clock::time_point time) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+    uint64_t seconds = static_cast<uint64_t>(micros / 1000000) + NTP_UNIX_OFFSET;
+    uint64_t fraction = (static_cast<uint64_t>(micros % 1000000) << 32) / 1000000;
+    return (seconds << 32) | fraction;
+}
+
+void buildSenderReport(uint32_t ssrc, uint64_t ntp, uint32_t rtpTimestamp, uint32_t packets, uint32_t octets,
+                       const std::string& cname, std::vector<uint8_t>& out) {
+    // SR without report blocks: we receive nothing
+    out.push_back(0x80); // V=2, RC=0
+    out.push_back(RTCP_SR);
+    put16(out, 6); // Length in 32-bit words minus one
+    put32(out, ssrc);
+    put32(out, static_cast<uint32_t>(ntp >> 32));
+    put32(out, static_cast<uint32_t>(ntp));
+    put32(out, rtpTimestamp);
+    put32(out, packets);
+    put32(out, octets);
+
+    // SDES with one chunk: SSRC, CNAME item, null terminator, padded to 32 bits
+    size_t length = cname.size() < 255 ? cname.size() : 255;
+    size_t chunk = 4 + 2 + length + 1;
+    size_t padded = (chunk + 3) & ~size_t(3);
+    out.push_back(0x81); // V=2, SC=1
+    out.push_back(RTCP_SDES);
+    put16(out, static_cast<uint32_t>(padded / 4));
+    put32(out, ssrc);
+    out.push_back(1); // CNAME
+    out.push_back(static_cast<uint8_t>(length));
+    out.insert(out.end(), cname.begin(), cname.begin() + length);
+    out.insert(out.end(), padded - chunk + 1, 0);
+}
+
+bool findReportBlock(const uint8_t* data, size_t size, uint32_t ssrc, RtcpReportBlock& block) {
+    while (size >= 4) {
+        if ((data[0] >> 6) != 2) {
+            return false;
+        }
+        size_t length = (((size_t(data[2]) << 8) | data[3]) + 1) * 4;
+        if (length > size) {
+            return false;
+        }
+        uint8_t type = data[1];
+        if (type == RTCP_SR || type == RTCP_RR) {
+            size_t count = data[0] & 0x1F;
+            size_t offset = type == RTCP_SR ? 28 : 8; // Header, sender SSRC and (SR) sender info
+            for (size_t i = 0; i < count && offset + 24 <= length; ++i, offset += 24) {
+                const uint8_t* p = data + offset;
+                if (get32(p) != ssrc) {
+                    continue;
+                }
+                block.ssrc = ssrc;
+                block.fractionLost = p[4];
+                uint32_t lost = (uint32_t(p[5]) << 16) | (uint32_t(p[6]) << 8) | p[7];
+                block.cumulativeLost = static_cast<int32_t>(lost << 8) >> 8; // Sign-extend 24 bits
+                block.highestSequence = get32(p + 8);
+                block.jitter = get32(p + 12);
+                block.lastSr = get32(p + 16);
+                block.delaySinceLastSr = get32(p + 20);
+                return true;
+            }
+        }
+        data += length;
+        size -= length;
+    }
+    return false;
+}
+
+std::chrono::microseconds roundTripTime(const RtcpReportBlock& block, uint64_t arrivalNtp) {
+    if (block.lastSr == 0) {
+        return std::chrono::microseconds(-1);
+    }
+    // All three are in 1/65536 s; unsigned arithmetic handles the wrap
+    uint32_t rtt = compactNtp(arrivalNtp) - block.lastSr - block.delaySinceLastSr;
+    if (rtt > 0x7FFFFFFF) {
+        return std::chrono::microseconds(0); // Clock noise around zero
+    }
+    return std::chrono::microseconds((uint64_t(rtt) * 1000000) >> 16);
+}
@@ -0,0 +1,46 @@
+#ifndef RTCP_H
+#define RTCP_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const uint8_t RTCP_SR = 200;
+const uint8_t RTCP_RR = 201;
+const uint8_t RTCP_SDES = 202;
+const uint8_t RTCP_BYE = 203;
+
+// 64-bit NTP timestamp (RFC 3550 section 4) of a wall clock time
+uint64_t toNtp(std::chrono::system_clock::time_point time);
+
+// The middle 32 bits of an NTP timestamp, as carried in LSR
+inline uint32_t compactNtp(uint64_t ntp) { return static_cast<uint32_t>(ntp >> 16); }
+
+// Appends a compound SR + SDES(CNAME) packet for ssrc to out. packets and
+// octets are the sender's totals (octets count RTP payload only).
+void buildSenderReport(uint32_t ssrc, uint64_t ntp, uint32_t rtpTimestamp, uint32_t packets, uint32_t octets,
+                       const std::string& cname, std::vector<uint8_t>& out);
+
+// One report block of an SR or RR, about one media source
+struct RtcpReportBlock {
+    uint32_t ssrc = 0;
+    uint8_t fractionLost = 0;    // Since the previous report, in 1/256
+    int32_t cumulativeLost = 0;  // 24-bit signed
+    uint32_t highestSequence = 0;
+    uint32_t jitter = 0;         // Interarrival jitter in RTP timestamp units
+    uint32_t lastSr = 0;         // LSR: compact NTP of the last SR received
+    uint32_t delaySinceLastSr = 0; // DLSR in 1/65536 s
+};
+
+// Finds the report block about ssrc in a compound RTCP packet from the
+// receiver. Returns false if the packet is malformed or does not report on
+// ssrc.
+bool findReportBlock(const uint8_t* data, size_t size, uint32_t ssrc, RtcpReportBlock& block);
+
+// Round-trip time from a report block received at arrivalNtp, per RFC 3550
+// section 6.4.1. Returns a negative duration if the block carries no LSR.
+std::chrono::microseconds roundTripTime(const RtcpReportBlock& block, uint64_t arrivalNtp);
+
+#endif // RTCP_H
@@ -0,0 +1,42 @@
+#include "RtpPacketizer.h"
+#include <random>
+
+RtpPacketizer::RtpPacketizer(uint32_t ssrc, uint8_t payloadType, size_t maxPayload)
+    : ssrc_(ssrc), payloadType_(payloadType), maxPayload_(maxPayload) {
+    // RFC 3550 recommends a random initial sequence number
+    std::random_device rd;
+    sequence_ = static_cast<uint16_t>(rd());
+}
+
+void RtpPacketizer::packetize(const uint8_t* data, size_t size, uint32_t timestamp, RtpPacketBuffer& out) {
+    size_t packetCount = (size + maxPayload_ - 1) / maxPayload_;
+    out.data.reserve(out.data.size() + size + packetCount * RTP_HEADER_SIZE);
+
+    while (size > 0) {
+        size_t chunk = size < maxPayload_ ? size : maxPayload_;
+        size_t offset = out.data.size();
+        out.data.resize(offset + RTP_HEADER_SIZE);
+        writeHeader(out.data.data() + offset, timestamp, chunk == size); // Marker on the last packet of the frame
+        out.data.insert(out.data.end(), data, data + chunk);
+        out.sizes.push_back(RTP_HEADER_SIZE + chunk);
+
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void RtpPacketizer::writeHeader(uint8_t* out, uint32_t timestamp, bool marker) {
+    out[0] = 0x80; // V=2, no padding, no extension, no CSRC
+    out[1] = static_cast<uint8_t>((marker ? 0x80 : 0x00) | (payloadType_ & 0x7F));
+    out[2] = static_cast<uint8_t>(sequence_ >> 8);
+    out[3] = static_cast<uint8_t>(sequence_ & 0xFF);
+    out[4] = static_cast<uint8_t>(timestamp >> 24);
+    out[5] = static_cast<uint8_t>(timestamp >> 16);
+    out[6] = static_cast<uint8_t>(timestamp >> 8);
+    out[7] = static_cast<uint8_t>(timestamp);
+    out[8] = static_cast<uint8_t>(ssrc_ >> 24);
+    out[9] = static_cast<uint8_t>(ssrc_ >> 16);
+    out[10] = static_cast<uint8_t>(ssrc_ >> 8);
+    out[11] = static_cast<uint8_t>(ssrc_);
+    ++sequence_;
+}
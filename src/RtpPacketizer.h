@@ -0,0 +1,45 @@
+#ifndef RTP_PACKETIZER_H
+#define RTP_PACKETIZER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+const size_t RTP_HEADER_SIZE = 12;
+const uint8_t RTP_PAYLOAD_TYPE_PS = 96; // Matches "a=rtpmap:96 PS/90000" in our SDP answer
+const size_t RTP_MAX_PAYLOAD = 1400;
+
+// Packets of one frame, stored back to back in a single buffer
+struct RtpPacketBuffer {
+    std::vector<uint8_t> data;
+    std::vector<size_t> sizes;
+
+    void clear() {
+        data.clear();
+        sizes.clear();
+    }
+};
+
+// Splits PS packs into RTP packets (RFC 3550), one marker bit per frame
+class RtpPacketizer {
+public:
+    RtpPacketizer(uint32_t ssrc, uint8_t payloadType = RTP_PAYLOAD_TYPE_PS, size_t maxPayload = RTP_MAX_PAYLOAD);
+
+    void packetize(const uint8_t* data, size_t size, uint32_t timestamp, RtpPacketBuffer& out);
+
+    // Writes the 12-byte header of the next packet, for callers that keep the
+    // payload elsewhere (e.g. a shared MediaClip) and send header + payload gathered
+    void writeHeader(uint8_t* out, uint32_t timestamp, bool marker);
+
+    size_t maxPayload() const { return maxPayload_; }
+    uint32_t ssrc() const { return ssrc_; }
+    uint16_t sequence() const { return sequence_; }
+
+private:
+    uint32_t ssrc_;
+    uint8_t payloadType_;
+    size_t maxPayload_;
+    uint16_t sequence_;
+};
+
+#endif // RTP_PACKETIZER_H
@@ -0,0 +1,211 @@
+#include "RtpSenderPool.h"
+#include "Log.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+// Wheel resolution. 2 ms is well below any frame interval we stream at.
+const std::chrono::milliseconds TICK(2);
+const size_t WHEEL_SLOTS = 1024;
+const std::chrono::seconds STATS_INTERVAL(10);
+}
+
+RtpSenderPool::RtpSenderPool(size_t workerCount, uint64_t egressBitsPerSecond)
+    : budget_(egressBitsPerSecond), running_(false), epoch_(Clock::now()), lastReport_(epoch_) {
+    if (workerCount == 0) {
+        workerCount = std::thread::hardware_concurrency();
+        if (workerCount == 0) {
+            workerCount = 1;
+        }
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+}
+
+RtpSenderPool::~RtpSenderPool() {
+    stop();
+}
+
+void RtpSenderPool::start() {
+    if (running_) {
+        return;
+    }
+    running_ = true;
+
+    for (auto& worker : workers_) {
+        worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        worker->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        worker->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = worker->timerFd;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->timerFd, &ev);
+        ev.data.fd = worker->wakeFd;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->wakeFd, &ev);
+
+        worker->wheel = TimerWheel<std::shared_ptr<RtpStream>>(WHEEL_SLOTS);
+        worker->wheel.reset(toTick(Clock::now()));
+        worker->thread = std::thread(&RtpSenderPool::workerLoop, this, std::ref(*worker));
+    }
+    LOG_INFO("RTP sender pool started with {} worker(s).", workers_.size());
+}
+
+void RtpSenderPool::stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+
+    for (auto& worker : workers_) {
+        uint64_t one = 1;
+        ssize_t ignored = write(worker->wakeFd, &one, sizeof(one));
+        (void)ignored;
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+        close(worker->epollFd);
+        close(worker->timerFd);
+        close(worker->wakeFd);
+        worker->inbox.clear();
+        worker->wheel = TimerWheel<std::shared_ptr<RtpStream>>(WHEEL_SLOTS);
+        worker->streamCount = 0;
+    }
+}
+
+void RtpSenderPool::add(std::shared_ptr<RtpStream> stream) {
+    Worker* target = workers_.front().get();
+    for (auto& worker : workers_) {
+        if (worker->streamCount < target->streamCount) {
+            target = worker.get();
+        }
+    }
+
+    stream->setEgressBudget(&budget_);
+    ++target->streamCount;
+    {
+        std::lock_guard<std::mutex> lock(target->inboxMutex);
+        target->inbox.push_back(std::move(stream));
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(target->wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+size_t RtpSenderPool::activeStreams() const {
+    size_t total = 0;
+    for (const auto& worker : workers_) {
+        total += worker->streamCount;
+    }
+    return total;
+}
+
+RtpSenderStats RtpSenderPool::stats() const {
+    RtpSenderStats total;
+    for (const auto& worker : workers_) {
+        const UdpBatchStats& batch = worker->batch.stats();
+        total.packets += batch.packets.load(std::memory_order_relaxed);
+        total.syscalls += batch.syscalls.load(std::memory_order_relaxed);
+        total.gsoSends += batch.gsoSends.load(std::memory_order_relaxed);
+        total.dropped += batch.dropped.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void RtpSenderPool::reportStats(Clock::time_point now) {
+    if (now - lastReport_ < STATS_INTERVAL) {
+        return;
+    }
+    RtpSenderStats current = stats();
+    RtpSenderStats window;
+    window.packets = current.packets - lastReportStats_.packets;
+    window.syscalls = current.syscalls - lastReportStats_.syscalls;
+    window.gsoSends = current.gsoSends - lastReportStats_.gsoSends;
+    window.dropped = current.dropped - lastReportStats_.dropped;
+    if (window.packets > 0 || window.dropped > 0) {
+        LOG_INFO("RTP sender: {} streams, {} packets in {} syscalls ({} packets/syscall, {} GSO sends, {} dropped)",
+                 activeStreams(), window.packets, window.syscalls, window.packetsPerSyscall(), window.gsoSends,
+                 window.dropped);
+    }
+    lastReport_ = now;
+    lastReportStats_ = current;
+}
+
+uint64_t RtpSenderPool::toTick(Clock::time_point time) const {
+    if (time <= epoch_) {
+        return 0;
+    }
+    return static_cast<uint64_t>((time - epoch_) / TICK);
+}
+
+void RtpSenderPool::armTimer(Worker& worker, bool enable) {
+    if (worker.timerArmed == enable) {
+        return;
+    }
+    // Periodic tick while there is something to send, fully idle otherwise
+    itimerspec spec{};
+    if (enable) {
+        spec.it_value.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(TICK).count();
+        spec.it_interval = spec.it_value;
+    }
+    timerfd_settime(worker.timerFd, 0, &spec, nullptr);
+    worker.timerArmed = enable;
+}
+
+void RtpSenderPool::workerLoop(Worker& worker) {
+    std::vector<std::shared_ptr<RtpStream>> incoming;
+    epoll_event events[4];
+
+    while (running_) {
+        int count = epoll_wait(worker.epollFd, events, 4, -1);
+        if (count < 0) {
+            continue; // EINTR
+        }
+        for (int i = 0; i < count; ++i) {
+            uint64_t value;
+            ssize_t ignored = read(events[i].data.fd, &value, sizeof(value));
+            (void)ignored;
+        }
+        if (!running_) {
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(worker.inboxMutex);
+            incoming.swap(worker.inbox);
+        }
+        uint64_t nowTick = toTick(Clock::now());
+        for (auto& stream : incoming) {
+            // Sockets and the TCP connection are set up here; the clip comes loaded
+            if (stream->running() && stream->open()) {
+                worker.wheel.schedule(nowTick, std::move(stream));
+            } else {
+                --worker.streamCount;
+            }
+        }
+        incoming.clear();
+
+        // A stream fires at most once per advance, so the packets it queued
+        // stay valid until the flush below.
+        Clock::time_point now = Clock::now();
+        worker.wheel.advance(toTick(now), [&](std::shared_ptr<RtpStream>& stream) {
+            Clock::time_point nextDue;
+            if (stream->running() && stream->sendNextFrame(nextDue, worker.batch)) {
+                worker.wheel.schedule(toTick(nextDue), std::move(stream));
+            } else {
+                worker.batch.flush(); // The stream may be destroyed right after this
+                --worker.streamCount; // Last reference goes away here, closing the socket
+            }
+        });
+        worker.batch.flush();
+
+        if (&worker == workers_.front().get()) {
+            reportStats(now);
+        }
+
+        armTimer(worker, !worker.wheel.empty());
+    }
+}
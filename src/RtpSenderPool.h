@@ -0,0 +1,78 @@
+#ifndef RTP_SENDER_POOL_H
+#define RTP_SENDER_POOL_H
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "EgressBudget.h"
+#include "RtpStream.h"
+#include "TimerWheel.h"
+#include "UdpBatchSender.h"
+
+// Send path counters summed over all workers
+struct RtpSenderStats {
+    uint64_t packets = 0;
+    uint64_t syscalls = 0;
+    uint64_t gsoSends = 0;
+    uint64_t dropped = 0;
+
+    double packetsPerSyscall() const { return syscalls ? static_cast<double>(packets) / syscalls : 0.0; }
+};
+
+// Fixed set of sender threads (one per core by default) that multiplex every
+// active RtpStream. Each worker sleeps in epoll_wait on a timerfd and an
+// eventfd; streams are paced by a timer wheel keyed on their next frame's
+// 90 kHz timestamp, so thread count does not depend on the number of calls.
+class RtpSenderPool {
+public:
+    // egressBitsPerSecond caps the media sent by all workers together; 0 for
+    // no cap. Streams thin themselves as the cap is approached.
+    explicit RtpSenderPool(size_t workerCount = 0, uint64_t egressBitsPerSecond = 0);
+    ~RtpSenderPool();
+
+    void start();
+    void stop();
+
+    // Hands a stream to the least loaded worker. The stream is dropped by the
+    // worker once RtpStream::stop() has been called; nobody has to join anything.
+    void add(std::shared_ptr<RtpStream> stream);
+
+    size_t activeStreams() const;
+    RtpSenderStats stats() const;
+    size_t workerCount() const { return workers_.size(); }
+    const EgressBudget& egressBudget() const { return budget_; }
+    EgressBudget& egressBudget() { return budget_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Worker {
+        int epollFd = -1;
+        int timerFd = -1;
+        int wakeFd = -1;
+        bool timerArmed = false;
+        std::thread thread;
+        std::mutex inboxMutex; // Guards inbox only; never held while sending
+        std::vector<std::shared_ptr<RtpStream>> inbox;
+        TimerWheel<std::shared_ptr<RtpStream>> wheel;
+        UdpBatchSender batch; // Packets of every stream due in one tick go out together
+        std::atomic<size_t> streamCount{0};
+    };
+
+    void workerLoop(Worker& worker);
+    void reportStats(Clock::time_point now);
+    void armTimer(Worker& worker, bool enable);
+    uint64_t toTick(Clock::time_point time) const;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    EgressBudget budget_;
+    std::atomic<bool> running_;
+    Clock::time_point epoch_;
+    Clock::time_point lastReport_;
+    RtpSenderStats lastReportStats_;
+};
+
+#endif // RTP_SENDER_POOL_H
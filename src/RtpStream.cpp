@@ -0,0 +1,317 @@
+#include "RtpStream.h"
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "Log.h"
+#include "Metrics.h"
+#include "Rtcp.h"
+
+namespace {
+// Mean sender report interval, the RFC 3550 minimum
+const std::chrono::milliseconds RTCP_INTERVAL(5000);
+// How often the RTCP socket is checked for receiver reports
+const std::chrono::milliseconds RTCP_POLL_INTERVAL(500);
+// Reported loss above which the stream thins one step further, and below
+// which it steps back (fraction lost, in 1/256)
+const uint8_t LOSS_THIN = 26;    // ~10%
+const uint8_t LOSS_RECOVER = 5;  // ~2%
+// Retry interval while a TCP download waits for the platform to connect or
+// to take more of the queue, and while a finished TCP playback drains it
+const std::chrono::milliseconds DRAIN_INTERVAL(20);
+}
+
+RtpStream::RtpStream(int callId, const std::string& remoteIp, int remotePort, PortLease ports,
+                     std::shared_ptr<const MediaClip> clip, MediaTransport transport, uint32_t ssrc)
+    : callId_(callId), remoteIp_(remoteIp), remotePort_(remotePort), ports_(std::move(ports)), transport_(transport),
+      ssrc_(ssrc), running_(true), socket_(ports_.rtpSocket()), remoteAddr_{}, clip_(std::move(clip)), tcpConnected_(false), cursor_(0), loopOffset90k_(0),
+      bounded_(false), first90k_(0), finished_(false), budget_(nullptr), lossThinning_(Thinning::None), skipToKeyframe_(false), rtcpSocket_(-1), rtcpAddr_{},
+      sentPackets_(0), sentOctets_(0) {
+}
+
+RtpStream::~RtpStream() {
+    LOG_INFO("RTP Stream (Call ID: {}) stopped.", callId_);
+}
+
+bool RtpStream::open() {
+    LOG_INFO("RTP Stream (Call ID: {}) starting to {}:{} from local port {}", callId_, remoteIp_, remotePort_,
+             ports_.rtpPort());
+
+    // The socket was bound to the advertised port when the pair was leased
+    if (socket_ < 0) {
+        LOG_ERROR("No RTP socket for call ID: {}", callId_);
+        return false;
+    }
+
+    remoteAddr_.sin_family = AF_INET;
+    remoteAddr_.sin_port = htons(static_cast<uint16_t>(remotePort_));
+    if (inet_pton(AF_INET, remoteIp_.c_str(), &remoteAddr_.sin_addr) != 1) {
+        LOG_ERROR("Invalid remote RTP address {} for call ID: {}", remoteIp_, callId_);
+        return false;
+    }
+
+    if (!clip_ || clip_->frames().empty()) {
+        LOG_ERROR("No media for call ID: {}", callId_);
+        return false;
+    }
+    if (bounded_) {
+        cursor_ = clip_->keyframeAtOrBefore(range_.begin90k);
+        first90k_ = clip_->frames()[cursor_].dts90k;
+    }
+
+    if (transport_ != MediaTransport::Udp) {
+        tcp_ = std::make_unique<RtpTcpConnection>(transport_, ports_.tcpSocket(), remoteAddr_);
+        if (!tcp_->open()) {
+            return false;
+        }
+    } else {
+        rtcpSocket_ = ports_.rtcpSocket();
+        rtcpAddr_ = remoteAddr_;
+        rtcpAddr_.sin_port = htons(static_cast<uint16_t>(remotePort_ + 1));
+    }
+
+    // The platform matches the y= SSRC it offered
+    std::random_device rd;
+    packetizer_ = std::make_unique<RtpPacketizer>(ssrc_ ? ssrc_ : rd());
+    rng_.seed(packetizer_->ssrc());
+    if (cname_.empty()) {
+        cname_ = "rtp-" + std::to_string(callId_);
+    }
+    startTime_ = Clock::now();
+    nextReport_ = startTime_; // First SR goes out with the first frame
+    nextRtcpPoll_ = startTime_;
+    return true;
+}
+
+void RtpStream::setPlayback(const PlaybackRange& range) {
+    range_ = range;
+    if (range_.speed == 0) {
+        range_.speed = 1;
+    }
+    bounded_ = true;
+}
+
+bool RtpStream::sendNextFrame(Clock::time_point& nextDue, UdpBatchSender& batch) {
+    Clock::time_point now = Clock::now();
+    if (finished_) {
+        return finish(nextDue);
+    }
+    const ClipFrame& frame = clip_->frames()[cursor_];
+    const uint8_t* payload = clip_->data(frame);
+    size_t remaining = frame.size;
+    size_t maxPayload = packetizer_->maxPayload();
+    uint32_t timestamp = static_cast<uint32_t>(frame.dts90k + loopOffset90k_);
+
+    size_t packetCount = (remaining + maxPayload - 1) / maxPayload;
+    if (tcp_ && range_.download) {
+        // A download has to arrive whole: until the platform connects, and
+        // while the queue is full, the frame waits instead of being skipped
+        size_t framedBytes = frame.size + packetCount * RtpTcpConnection::FRAMED_HEADER_SIZE;
+        if (!tcp_->connected() || !tcp_->hasRoom(framedBytes)) {
+            if (!tcp_->service()) {
+                LOG_WARN("RTP/TCP connection lost for call ID: {}", callId_);
+                return false;
+            }
+            if (!tcp_->connected() || !tcp_->hasRoom(framedBytes)) {
+                nextDue = now + DRAIN_INTERVAL;
+                return true;
+            }
+        }
+    }
+    if (tcp_ && !tcpConnected_ && tcp_->connected()) {
+        // What fell due while the platform connected was skipped, so the
+        // decoder would start mid-GOP; resume at a keyframe. A download
+        // skipped nothing and carries on.
+        tcpConnected_ = true;
+        skipToKeyframe_ = !range_.download;
+    }
+    bool thinned = thin(frame, now);
+    bool sent = false;
+    if (tcp_) {
+        // Frames due while the platform has not connected yet are skipped;
+        // the queue is flushed right after the new frame joins it
+        if (!thinned && tcp_->connected()) {
+            sent = queueTcpFrame(frame, payload, timestamp, packetCount);
+            if (!sent && stats_) {
+                stats_->thinnedFrames.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (!tcp_->service()) {
+            LOG_WARN("RTP/TCP connection lost for call ID: {}", callId_);
+            return false;
+        }
+    } else if (!thinned) {
+        headers_.resize(packetCount * RTP_HEADER_SIZE);
+        uint8_t* header = headers_.data();
+        while (remaining > 0) {
+            size_t chunk = remaining < maxPayload ? remaining : maxPayload;
+            packetizer_->writeHeader(header, timestamp, chunk == remaining);
+            iovec iov[2] = {{header, RTP_HEADER_SIZE}, {const_cast<uint8_t*>(payload), chunk}};
+            batch.add(socket_, &remoteAddr_, iov, 2);
+            header += RTP_HEADER_SIZE;
+            payload += chunk;
+            remaining -= chunk;
+        }
+        sent = true;
+    }
+
+    if (sent) {
+        // On TCP every packet also carries the RFC 4571 length prefix
+        size_t headerSize = tcp_ ? RtpTcpConnection::FRAMED_HEADER_SIZE : RTP_HEADER_SIZE;
+        size_t wireBytes = frame.size + packetCount * headerSize;
+        sentPackets_ += static_cast<uint32_t>(packetCount);
+        sentOctets_ += static_cast<uint32_t>(frame.size);
+        if (budget_) {
+            budget_->charge(wireBytes, now);
+        }
+        if (stats_) {
+            stats_->packets.fetch_add(packetCount, std::memory_order_relaxed);
+            stats_->bytes.fetch_add(wireBytes, std::memory_order_relaxed);
+        }
+        Metrics& metrics = Metrics::instance();
+        metrics.add(Metrics::RtpPackets, static_cast<int64_t>(packetCount));
+        metrics.add(Metrics::RtpBytes, static_cast<int64_t>(wireBytes));
+    }
+    serviceRtcp(now);
+
+    if (sent && timeline_) {
+        timeline_->mark(SessionTimeline::FirstPacketSent);
+        if (frame.keyframe) {
+            timeline_->mark(SessionTimeline::FirstKeyframeSent);
+            timeline_.reset();
+        }
+    }
+
+    ++cursor_;
+    if (bounded_ && (cursor_ == clip_->frames().size() || clip_->frames()[cursor_].dts90k > range_.end90k)) {
+        finished_ = true;
+        return finish(nextDue);
+    }
+    if (cursor_ == clip_->frames().size()) {
+        cursor_ = 0;
+        loopOffset90k_ += clip_->duration90k();
+    }
+
+    // Frames are sent in decode order, paced against the 90 kHz clock
+    uint64_t elapsed90k = clip_->frames()[cursor_].dts90k + loopOffset90k_ - first90k_;
+    nextDue = startTime_ + std::chrono::microseconds(elapsed90k * 1000 / 90 / range_.speed);
+    return true;
+}
+
+bool RtpStream::finish(Clock::time_point& nextDue) {
+    // Over TCP the range is only complete once the queue has been written
+    if (tcp_ && !tcp_->drained()) {
+        if (!tcp_->service()) {
+            return false;
+        }
+        if (!tcp_->drained()) {
+            nextDue = Clock::now() + DRAIN_INTERVAL;
+            return true;
+        }
+    }
+    LOG_INFO("RTP Stream (Call ID: {}) reached the end of its playback range.", callId_);
+    if (onFinished_) {
+        onFinished_();
+    }
+    return false;
+}
+
+bool RtpStream::queueTcpFrame(const ClipFrame& frame, const uint8_t* payload, uint32_t timestamp, size_t packetCount) {
+    size_t maxPayload = packetizer_->maxPayload();
+    std::vector<uint8_t> headers = tcp_->takeHeaderBuffer();
+    headers.resize(packetCount * RtpTcpConnection::FRAMED_HEADER_SIZE);
+    uint8_t* header = headers.data();
+    size_t remaining = frame.size;
+    while (remaining > 0) {
+        size_t chunk = remaining < maxPayload ? remaining : maxPayload;
+        // RFC 4571: 16-bit big-endian length of the RTP packet that follows
+        size_t length = RTP_HEADER_SIZE + chunk;
+        header[0] = static_cast<uint8_t>(length >> 8);
+        header[1] = static_cast<uint8_t>(length);
+        packetizer_->writeHeader(header + 2, timestamp, chunk == remaining);
+        header += RtpTcpConnection::FRAMED_HEADER_SIZE;
+        remaining -= chunk;
+    }
+    return tcp_->queueFrame(std::move(headers), payload, frame.size, maxPayload, frame.keyframe);
+}
+
+bool RtpStream::thin(const ClipFrame& frame, Clock::time_point now) {
+    if (frame.keyframe || range_.download) {
+        skipToKeyframe_ = false;
+        return false; // Keyframes are always sent, and a download has to be complete
+    }
+    if (!skipToKeyframe_) {
+        Thinning level = budget_ ? budget_->pressure(now) : Thinning::None;
+        if (lossThinning_ > level) {
+            level = lossThinning_;
+        }
+        if (level == Thinning::None || (level == Thinning::NonReference && frame.reference)) {
+            return false;
+        }
+        // Frames after a dropped reference frame cannot be decoded either
+        skipToKeyframe_ = frame.reference;
+    }
+    if (stats_) {
+        stats_->thinnedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void RtpStream::serviceRtcp(Clock::time_point now) {
+    if (rtcpSocket_ < 0) {
+        return;
+    }
+    if (now >= nextRtcpPoll_) {
+        readReceiverReports();
+        nextRtcpPoll_ = now + RTCP_POLL_INTERVAL;
+    }
+    if (sentPackets_ > 0 && now >= nextReport_) {
+        sendSenderReport(now);
+        std::uniform_int_distribution<int64_t> spread(RTCP_INTERVAL.count() / 2, RTCP_INTERVAL.count() * 3 / 2);
+        nextReport_ = now + std::chrono::milliseconds(spread(rng_));
+    }
+}
+
+void RtpStream::sendSenderReport(Clock::time_point now) {
+    // Our RTP timestamps are clip time, which runs range_.speed times as fast
+    // as the wall clock from startTime_ on
+    auto elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(now - startTime_).count();
+    uint32_t rtpTimestamp = static_cast<uint32_t>(first90k_ + static_cast<uint64_t>(elapsedUs) * 90 * range_.speed / 1000);
+    uint64_t ntp = toNtp(std::chrono::system_clock::now());
+
+    rtcpBuffer_.clear();
+    buildSenderReport(packetizer_->ssrc(), ntp, rtpTimestamp, sentPackets_, sentOctets_, cname_, rtcpBuffer_);
+    if (sendto(rtcpSocket_, rtcpBuffer_.data(), rtcpBuffer_.size(), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>(&rtcpAddr_),
+               sizeof(rtcpAddr_)) < 0) {
+        LOG_WARN("Failed to send RTCP SR for call ID: {}", callId_);
+    }
+}
+
+void RtpStream::readReceiverReports() {
+    uint8_t buffer[1500];
+    for (;;) {
+        ssize_t size = recv(rtcpSocket_, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (size <= 0) {
+            return;
+        }
+        RtcpReportBlock block;
+        if (!findReportBlock(buffer, static_cast<size_t>(size), packetizer_->ssrc(), block)) {
+            continue;
+        }
+
+        if (block.fractionLost > LOSS_THIN && lossThinning_ != Thinning::KeyframesOnly) {
+            lossThinning_ = static_cast<Thinning>(static_cast<uint8_t>(lossThinning_) + 1);
+        } else if (block.fractionLost < LOSS_RECOVER && lossThinning_ != Thinning::None) {
+            lossThinning_ = static_cast<Thinning>(static_cast<uint8_t>(lossThinning_) - 1);
+        }
+
+        if (stats_) {
+            std::chrono::microseconds rtt = roundTripTime(block, toNtp(std::chrono::system_clock::now()));
+            stats_->rtcpReports.fetch_add(1, std::memory_order_relaxed);
+            stats_->fractionLost.store(block.fractionLost, std::memory_order_relaxed);
+            stats_->cumulativeLost.store(block.cumulativeLost, std::memory_order_relaxed);
+            stats_->jitterUs.store(static_cast<uint32_t>(uint64_t(block.jitter) * 1000 / 90), std::memory_order_relaxed);
+            if (rtt.count() >= 0) {
+                stats_->rttUs.store(rtt.count(), std::memory_order_relaxed);
+            }
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#ifndef RTP_STREAM_H
+#define RTP_STREAM_H
+
+#include <string>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <vector>
+#include <netinet/in.h>
+#include "EgressBudget.h"
+#include "MediaCache.h"
+#include "PortAllocator.h"
+#include "RtpPacketizer.h"
+#include "RtpTcpConnection.h"
+#include "UdpBatchSender.h"
+#include "LatencyStats.h"
+#include "StreamRegistry.h"
+
+// Window of a recording sent by a Playback or Download session
+struct PlaybackRange {
+    uint64_t begin90k = 0; // Clip time; sending starts at the keyframe at or before it
+    uint64_t end90k = 0;
+    unsigned speed = 1;    // Multiple of real time
+    bool download = false; // Never thinned or skipped
+};
+
+// Media side of one session: walks a shared MediaClip as a ring and
+// sends its PS frames over UDP, or RFC 4571 framed over TCP. Only the 12-byte
+// RTP headers (SSRC, sequence, timestamp) are per session; payloads are
+// gathered straight from the clip. Owned by an RtpSenderPool worker which
+// calls sendNextFrame() whenever the stream's next frame falls due.
+//
+// Over UDP the stream also runs RTCP on port + 1: it sends sender reports and
+// reads the platform's receiver reports. Reported loss, and the host's egress
+// budget, thin the stream: first non-reference frames are dropped, then
+// everything but keyframes.
+//
+// Playback and Download sessions send a window of a recording once instead of
+// looping, Download at a multiple of real time and never thinned.
+class RtpStream {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // ports is the pair advertised in the SDP answer, already bound; it is
+    // returned to its allocator when the stream is destroyed. clip is loaded
+    // by the caller, so a worker never waits for a source to be demuxed.
+    // ssrc 0 picks a random one.
+    RtpStream(int callId, const std::string& remoteIp, int remotePort, PortLease ports,
+              std::shared_ptr<const MediaClip> clip, MediaTransport transport = MediaTransport::Udp, uint32_t ssrc = 0);
+    ~RtpStream();
+
+    RtpStream(const RtpStream&) = delete;
+    RtpStream& operator=(const RtpStream&) = delete;
+
+    // Resolves the destination and starts the TCP connection if any. Called
+    // on the worker thread.
+    bool open();
+
+    // Queues the pending frame's packets on batch (UDP) or the TCP connection
+    // and sets nextDue to when the following frame is due. The packets stay
+    // valid until the next call. Frames due before a TCP peer is connected are
+    // skipped, except in a Download: it waits for the connection and for room
+    // in the TCP queue, so it is never cut short. Returns false when the
+    // stream cannot continue.
+    bool sendNextFrame(Clock::time_point& nextDue, UdpBatchSender& batch);
+
+    // Startup milestones to mark; set before the stream is handed to the pool
+    void setTimeline(std::shared_ptr<SessionTimeline> timeline) { timeline_ = std::move(timeline); }
+
+    // Registry counters to bump per frame; same
+    void setStats(std::shared_ptr<StreamStats> stats) { stats_ = std::move(stats); }
+
+    // CNAME of our RTCP reports; same
+    void setCname(const std::string& cname) { cname_ = cname; }
+
+    // Sends range of the clip once instead of looping it; same
+    void setPlayback(const PlaybackRange& range);
+
+    // Called on the sender worker once a playback range has been sent
+    void setFinishedHandler(std::function<void()> handler) { onFinished_ = std::move(handler); }
+
+    // Set by the sender pool; the budget outlives the stream's time in the pool
+    void setEgressBudget(EgressBudget* budget) { budget_ = budget; }
+
+    void stop() { running_ = false; }
+    bool running() const { return running_; }
+    int callId() const { return callId_; }
+
+private:
+    bool queueTcpFrame(const ClipFrame& frame, const uint8_t* payload, uint32_t timestamp, size_t packetCount);
+    bool thin(const ClipFrame& frame, Clock::time_point now);
+    bool finish(Clock::time_point& nextDue);
+    void serviceRtcp(Clock::time_point now);
+    void sendSenderReport(Clock::time_point now);
+    void readReceiverReports();
+
+    int callId_;
+    std::string remoteIp_;
+    int remotePort_;
+    PortLease ports_;
+    MediaTransport transport_;
+    uint32_t ssrc_;
+    std::atomic<bool> running_;
+
+    int socket_; // ports_.rtpSocket()
+    sockaddr_in remoteAddr_;
+
+    std::shared_ptr<const MediaClip> clip_;
+    std::unique_ptr<RtpPacketizer> packetizer_;
+    std::unique_ptr<RtpTcpConnection> tcp_;
+    bool tcpConnected_;       // The platform has connected; frames due before were skipped
+    size_t cursor_;           // Next frame of the clip to send
+    uint64_t loopOffset90k_;  // Added to clip timestamps, grows by one clip duration per loop
+    bool bounded_;            // Playback or Download: range_ applies, no looping
+    PlaybackRange range_;
+    uint64_t first90k_;       // Clip time of the first frame sent; startTime_ corresponds to it
+    bool finished_;           // The whole range is queued
+    std::function<void()> onFinished_;
+    std::vector<uint8_t> headers_; // RTP headers of the frame in flight
+    std::shared_ptr<SessionTimeline> timeline_; // Released once the first keyframe is out
+    std::shared_ptr<StreamStats> stats_;
+    std::string cname_;
+    EgressBudget* budget_;
+
+    // Thinning
+    Thinning lossThinning_;  // From the last receiver report
+    bool skipToKeyframe_;    // A reference frame was dropped
+
+    // RTCP, UDP sessions only
+    int rtcpSocket_;         // ports_.rtcpSocket(), -1 without RTCP
+    sockaddr_in rtcpAddr_;
+    uint32_t sentPackets_;   // Sender info of the SR
+    uint32_t sentOctets_;
+    Clock::time_point nextReport_;
+    Clock::time_point nextRtcpPoll_;
+    std::minstd_rand rng_;   // Spreads report times (RFC 3550 section 6.3.1)
+    std::vector<uint8_t> rtcpBuffer_;
+
+    Clock::time_point startTime_;
+};
+
+#endif // RTP_STREAM_H
@@ -0,0 +1,229 @@
+#include "RtpTcpConnection.h"
+#include "Log.h"
+#include <cerrno>
+#include <cstring>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+const std::chrono::seconds CONNECT_TIMEOUT(10);
+const size_t MAX_IOV = 64;
+const size_t MAX_SPARE_HEADERS = 8;
+}
+
+RtpTcpConnection::RtpTcpConnection(MediaTransport mode, int socket, const sockaddr_in& remote, size_t maxQueueBytes)
+    : mode_(mode), listenSocket_(-1), socket_(-1), ownsSocket_(false), remote_(remote), state_(State::Idle),
+      queuedBytes_(0), maxQueueBytes_(maxQueueBytes), skipToKeyframe_(false), droppedFrames_(0) {
+    if (mode_ == MediaTransport::TcpPassive) {
+        listenSocket_ = socket;
+    } else {
+        socket_ = socket;
+    }
+}
+
+RtpTcpConnection::~RtpTcpConnection() {
+    if (ownsSocket_ && socket_ >= 0) {
+        close(socket_);
+    }
+}
+
+bool RtpTcpConnection::open() {
+    deadline_ = Clock::now() + CONNECT_TIMEOUT;
+    if (mode_ == MediaTransport::TcpPassive) {
+        if (listenSocket_ < 0 || listen(listenSocket_, 1) != 0) {
+            LOG_ERROR("RTP/TCP: listen failed: {}", strerror(errno));
+            state_ = State::Failed;
+            return false;
+        }
+        state_ = State::Listening;
+        return true;
+    }
+
+    if (socket_ < 0) {
+        state_ = State::Failed;
+        return false;
+    }
+    if (connect(socket_, reinterpret_cast<const sockaddr*>(&remote_), sizeof(remote_)) != 0 && errno != EINPROGRESS) {
+        LOG_WARN("RTP/TCP: connect failed: {}", strerror(errno));
+        state_ = State::Failed;
+        return false;
+    }
+    state_ = State::Connecting;
+    return true;
+}
+
+bool RtpTcpConnection::service() {
+    switch (state_) {
+        case State::Listening: {
+            int fd = accept4(listenSocket_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    LOG_WARN("RTP/TCP: accept failed: {}", strerror(errno));
+                    state_ = State::Failed;
+                    return false;
+                }
+                break;
+            }
+            socket_ = fd;
+            ownsSocket_ = true;
+            setConnected();
+            break;
+        }
+        case State::Connecting: {
+            // The socket turns writable once the handshake has finished, one way or the other
+            pollfd pfd{socket_, POLLOUT, 0};
+            if (poll(&pfd, 1, 0) <= 0) {
+                break;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(socket_, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+                LOG_WARN("RTP/TCP: connect failed: {}", strerror(error));
+                state_ = State::Failed;
+                return false;
+            }
+            setConnected();
+            break;
+        }
+        case State::Failed:
+            return false;
+        default:
+            break;
+    }
+
+    if (state_ == State::Listening || state_ == State::Connecting) {
+        if (Clock::now() > deadline_) {
+            LOG_WARN("RTP/TCP: platform did not {} within {} s.", state_ == State::Listening ? "connect" : "accept",
+                     CONNECT_TIMEOUT.count());
+            state_ = State::Failed;
+            return false;
+        }
+        return true;
+    }
+    if (state_ == State::Connected) {
+        return flush();
+    }
+    return true;
+}
+
+void RtpTcpConnection::setConnected() {
+    // Frames are written whole; there is nothing for Nagle to coalesce
+    int on = 1;
+    setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    state_ = State::Connected;
+}
+
+std::vector<uint8_t> RtpTcpConnection::takeHeaderBuffer() {
+    if (spareHeaders_.empty()) {
+        return std::vector<uint8_t>();
+    }
+    std::vector<uint8_t> buffer = std::move(spareHeaders_.back());
+    spareHeaders_.pop_back();
+    buffer.clear();
+    return buffer;
+}
+
+bool RtpTcpConnection::queueFrame(std::vector<uint8_t> headers, const uint8_t* payload, size_t size, size_t maxPayload,
+                                  bool keyframe) {
+    if (skipToKeyframe_) {
+        if (!keyframe) {
+            ++droppedFrames_;
+            return false;
+        }
+        skipToKeyframe_ = false;
+    }
+
+    Frame frame;
+    frame.total = headers.size() + size;
+    if (queuedBytes_ + frame.total > maxQueueBytes_) {
+        // Receiver is behind: flush the backlog and restart at a keyframe
+        dropUnsent();
+        if (!keyframe) {
+            skipToKeyframe_ = true;
+            ++droppedFrames_;
+            return false;
+        }
+    }
+
+    frame.headers = std::move(headers);
+    frame.payload = payload;
+    frame.size = size;
+    frame.maxPayload = maxPayload;
+    queuedBytes_ += frame.total;
+    queue_.push_back(std::move(frame));
+    return true;
+}
+
+bool RtpTcpConnection::flush() {
+    while (!queue_.empty()) {
+        iovec iov[MAX_IOV];
+        size_t count = 0;
+        for (auto it = queue_.begin(); it != queue_.end() && count + 2 <= MAX_IOV; ++it) {
+            const Frame& frame = *it;
+            size_t skip = frame.sent;
+            size_t packets = frame.headers.size() / FRAMED_HEADER_SIZE;
+            for (size_t i = 0; i < packets && count + 2 <= MAX_IOV; ++i) {
+                size_t offset = i * frame.maxPayload;
+                size_t chunk = frame.size - offset < frame.maxPayload ? frame.size - offset : frame.maxPayload;
+                const uint8_t* parts[2] = {frame.headers.data() + i * FRAMED_HEADER_SIZE, frame.payload + offset};
+                size_t lengths[2] = {FRAMED_HEADER_SIZE, chunk};
+                for (int p = 0; p < 2; ++p) {
+                    if (skip >= lengths[p]) {
+                        skip -= lengths[p];
+                        continue;
+                    }
+                    iov[count].iov_base = const_cast<uint8_t*>(parts[p] + skip);
+                    iov[count].iov_len = lengths[p] - skip;
+                    skip = 0;
+                    ++count;
+                }
+            }
+        }
+
+        msghdr message{};
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t written = sendmsg(socket_, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true; // Retried when the next frame is due
+            }
+            LOG_WARN("RTP/TCP: send failed: {}", strerror(errno));
+            state_ = State::Failed;
+            return false;
+        }
+
+        size_t remaining = static_cast<size_t>(written);
+        queuedBytes_ -= remaining;
+        while (remaining > 0) {
+            Frame& front = queue_.front();
+            size_t left = front.total - front.sent;
+            if (remaining < left) {
+                front.sent += remaining;
+                break;
+            }
+            remaining -= left;
+            if (spareHeaders_.size() < MAX_SPARE_HEADERS) {
+                spareHeaders_.push_back(std::move(front.headers));
+            }
+            queue_.pop_front();
+        }
+    }
+    return true;
+}
+
+void RtpTcpConnection::dropUnsent() {
+    // A frame already partly on the wire must finish, or the framing breaks
+    size_t keep = !queue_.empty() && queue_.front().sent > 0 ? 1 : 0;
+    while (queue_.size() > keep) {
+        queuedBytes_ -= queue_.back().total - queue_.back().sent;
+        queue_.pop_back();
+        ++droppedFrames_;
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef RTP_TCP_CONNECTION_H
+#define RTP_TCP_CONNECTION_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <netinet/in.h>
+#include "Sdp.h"
+
+// RTP over TCP with RFC 4571 framing (a 16-bit length before every packet),
+// driven by the owning RtpStream on its sender worker. Frames are queued as
+// their framed headers plus a pointer into the shared clip and written with
+// one gathered sendmsg per flush. The queue is bounded: when the receiver
+// falls behind, frames that have not started are dropped and sending resumes
+// at the next keyframe, so a slow platform costs neither memory nor a broken
+// decoder.
+class RtpTcpConnection {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static const size_t FRAMED_HEADER_SIZE = 14; // RFC 4571 length + RTP header
+
+    // socket is the TCP socket bound to our RTP port (owned by the PortLease).
+    // TcpPassive listens on it and accepts one platform connection;
+    // TcpActive connects it to remote.
+    RtpTcpConnection(MediaTransport mode, int socket, const sockaddr_in& remote, size_t maxQueueBytes = 2 << 20);
+    ~RtpTcpConnection();
+
+    RtpTcpConnection(const RtpTcpConnection&) = delete;
+    RtpTcpConnection& operator=(const RtpTcpConnection&) = delete;
+
+    bool open();
+
+    // Advances accept/connect and writes what the socket takes. Returns false
+    // once the connection failed, was closed or never came up in time.
+    bool service();
+    bool connected() const { return state_ == State::Connected; }
+    bool drained() const { return queue_.empty(); }
+    // Whether a frame of bytes framed bytes would be queued without dropping
+    // anything; an empty queue takes any frame
+    bool hasRoom(size_t bytes) const { return queue_.empty() || queuedBytes_ + bytes <= maxQueueBytes_; }
+
+    // A cleared buffer for the next frame's framed headers, recycled from
+    // frames already sent
+    std::vector<uint8_t> takeHeaderBuffer();
+
+    // Queues one frame: headers holds FRAMED_HEADER_SIZE bytes per packet, and
+    // packet i carries payload[i * maxPayload ...]. The payload must outlive
+    // the connection. Returns false if the frame was dropped.
+    bool queueFrame(std::vector<uint8_t> headers, const uint8_t* payload, size_t size, size_t maxPayload, bool keyframe);
+
+    uint64_t droppedFrames() const { return droppedFrames_; }
+
+private:
+    enum class State {
+        Idle,
+        Listening,
+        Connecting,
+        Connected,
+        Failed
+    };
+
+    struct Frame {
+        std::vector<uint8_t> headers;
+        const uint8_t* payload = nullptr;
+        size_t size = 0;
+        size_t maxPayload = 0;
+        size_t total = 0; // Framed bytes
+        size_t sent = 0;
+    };
+
+    void setConnected();
+    bool flush();
+    void dropUnsent();
+
+    MediaTransport mode_;
+    int listenSocket_; // Passive only; owned by the lease
+    int socket_;       // Data connection
+    bool ownsSocket_;  // Accepted sockets are ours to close
+    sockaddr_in remote_;
+    State state_;
+    Clock::time_point deadline_; // For the connection to come up
+
+    std::deque<Frame> queue_;
+    size_t queuedBytes_;
+    size_t maxQueueBytes_;
+    bool skipToKeyframe_;
+    uint64_t droppedFrames_;
+    std::vector<std::vector<uint8_t>> spareHeaders_;
+};
+
+#endif // RTP_TCP_CONNECTION_H
@@ -0,0 +1,159 @@
+#include "Sdp.h"
+#include <cstdlib>
+
+namespace {
+// Splits off the next space-separated token of line
+std::string_view nextToken(std::string_view& line) {
+    size_t begin = line.find_first_not_of(' ');
+    if (begin == std::string_view::npos) {
+        line = std::string_view();
+        return std::string_view();
+    }
+    size_t end = line.find(' ', begin);
+    std::string_view token = line.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin);
+    line.remove_prefix(end == std::string_view::npos ? line.size() : end);
+    return token;
+}
+
+uint64_t toNumber(std::string_view text) {
+    uint64_t value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return 0;
+        }
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return value;
+}
+}
+
+MediaTransport SdpOffer::transport() const {
+    if (!tcp()) {
+        return MediaTransport::Udp;
+    }
+    // An offer without a=setup is treated as actpass; listening keeps NAT on
+    // the platform side out of the way
+    return setup == "passive" ? MediaTransport::TcpActive : MediaTransport::TcpPassive;
+}
+
+uint32_t SdpOffer::ssrcValue() const {
+    uint64_t value = ssrc.size() <= 10 ? toNumber(ssrc) : 0;
+    return value <= 0xFFFFFFFFu ? static_cast<uint32_t>(value) : 0;
+}
+
+bool parseSdpOffer(std::string_view sdp, SdpOffer& offer) {
+    offer = SdpOffer();
+    std::string sessionIp;
+    bool inVideo = false;
+    bool haveVideo = false;
+
+    while (!sdp.empty()) {
+        size_t end = sdp.find('\n');
+        std::string_view line = sdp.substr(0, end);
+        sdp.remove_prefix(end == std::string_view::npos ? sdp.size() : end + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.size() < 2 || line[1] != '=') {
+            continue;
+        }
+        char type = line[0];
+        line.remove_prefix(2);
+
+        switch (type) {
+            case 's':
+                offer.sessionName = std::string(line);
+                break;
+            case 'c': {
+                // c=IN IP4 <address>
+                nextToken(line);
+                nextToken(line);
+                std::string_view address = nextToken(line);
+                if (!haveVideo) {
+                    sessionIp = std::string(address);
+                } else if (inVideo) {
+                    offer.connectionIp = std::string(address);
+                }
+                break;
+            }
+            case 't': {
+                offer.startTime = toNumber(nextToken(line));
+                offer.stopTime = toNumber(nextToken(line));
+                break;
+            }
+            case 'm': {
+                std::string_view media = nextToken(line);
+                inVideo = !haveVideo && media == "video";
+                if (inVideo) {
+                    haveVideo = true;
+                    uint64_t port = toNumber(nextToken(line));
+                    offer.port = port <= 65535 ? static_cast<int>(port) : -1;
+                    offer.proto = std::string(nextToken(line));
+                }
+                break;
+            }
+            case 'a':
+                if (inVideo && line.compare(0, 6, "setup:") == 0) {
+                    offer.setup = std::string(line.substr(6));
+                } else if (line.compare(0, 14, "downloadspeed:") == 0) {
+                    uint64_t speed = toNumber(line.substr(14));
+                    offer.downloadSpeed = speed <= 64 ? static_cast<unsigned>(speed) : 64;
+                }
+                break;
+            case 'y':
+                offer.ssrc = std::string(line);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (offer.connectionIp.empty()) {
+        offer.connectionIp = sessionIp;
+    }
+    if (!haveVideo || offer.connectionIp.empty() || offer.port < 0 || offer.port > 65535) {
+        return false;
+    }
+    // When the platform connects to us its own port is meaningless (often 9 or 0)
+    return offer.port > 0 || offer.transport() == MediaTransport::TcpPassive;
+}
+
+std::string buildSdpAnswer(const SdpOffer& offer, const std::string& deviceId, const std::string& localIp,
+                           MediaTransport transport, int localRtpPort, uint64_t fileSize) {
+    std::string sdp;
+    sdp.reserve(256);
+    sdp += "v=0\r\no=";
+    sdp += deviceId;
+    sdp += " 0 0 IN IP4 ";
+    sdp += localIp;
+    sdp += "\r\ns=";
+    sdp += offer.sessionName.empty() ? std::string_view("Play") : std::string_view(offer.sessionName);
+    sdp += "\r\nc=IN IP4 ";
+    sdp += localIp;
+    sdp += "\r\nt=";
+    sdp += std::to_string(offer.startTime);
+    sdp += ' ';
+    sdp += std::to_string(offer.stopTime);
+    sdp += "\r\nm=video ";
+    sdp += std::to_string(localRtpPort);
+    if (transport == MediaTransport::Udp) {
+        sdp += " RTP/AVP 96\r\n";
+    } else {
+        sdp += " TCP/RTP/AVP 96\r\n";
+        sdp += transport == MediaTransport::TcpPassive ? "a=setup:passive\r\n" : "a=setup:active\r\n";
+        sdp += "a=connection:new\r\n";
+    }
+    sdp += "a=sendonly\r\n"; // The device is the media source
+    sdp += "a=rtpmap:96 PS/90000\r\n";
+    if (fileSize > 0 && offer.sessionName == "Download") {
+        sdp += "a=filesize:";
+        sdp += std::to_string(fileSize);
+        sdp += "\r\n";
+    }
+    if (!offer.ssrc.empty()) {
+        sdp += "y=";
+        sdp += offer.ssrc;
+        sdp += "\r\n";
+    }
+    return sdp;
+}
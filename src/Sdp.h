@@ -0,0 +1,46 @@
+#ifndef SDP_H
+#define SDP_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// How RTP reaches the platform, from our (the sender's) side
+enum class MediaTransport {
+    Udp,
+    TcpPassive, // RFC 4571 over TCP; we listen, the platform connects
+    TcpActive   // RFC 4571 over TCP; we connect to the platform
+};
+
+// The parts of a GB28181 INVITE offer the client acts on. Parsed by hand
+// rather than through osip's SDP parser, which rejects GB28181's y= and f=
+// lines.
+struct SdpOffer {
+    std::string sessionName;  // s=: Play, Playback or Download
+    std::string connectionIp; // c=, the media-level line overriding the session-level one
+    int port = 0;             // Of the first m=video line
+    std::string proto;        // RTP/AVP, TCP/RTP/AVP or RTP/AVP/TCP
+    std::string setup;        // a=setup: active, passive or actpass (RFC 4145)
+    std::string ssrc;         // y=, ten decimal digits
+    uint64_t startTime = 0;   // t= for Playback/Download, NTP-less Unix seconds
+    uint64_t stopTime = 0;
+    unsigned downloadSpeed = 0; // a=downloadspeed: of a Download, 0 if absent
+
+    bool tcp() const { return proto.compare(0, 4, "TCP/") == 0 || proto.find("/TCP") != std::string::npos; }
+
+    // Our role for this offer: the opposite of the platform's a=setup
+    MediaTransport transport() const;
+
+    // y= as a number; 0 if absent or malformed
+    uint32_t ssrcValue() const;
+};
+
+// Returns false if the body has no usable m=video line
+bool parseSdpOffer(std::string_view sdp, SdpOffer& offer);
+
+// Our sendonly answer to offer, sending from localIp:localRtpPort over
+// transport. fileSize goes in a=filesize of a Download answer when known.
+std::string buildSdpAnswer(const SdpOffer& offer, const std::string& deviceId, const std::string& localIp,
+                           MediaTransport transport, int localRtpPort, uint64_t fileSize = 0);
+
+#endif // SDP_H
@@ -0,0 +1,72 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Bounded single-producer single-consumer ring. push() and pop() never block
+// or allocate; each side owns one index and reads the other's with acquire
+// ordering. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity)
+        : capacity_(roundUp(capacity)), slots_(new T[capacity_]), head_(0), tail_(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer only. Returns false when full.
+    bool push(T item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == capacity_) {
+            return false;
+        }
+        slots_[tail & (capacity_ - 1)] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false when empty.
+    bool pop(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(slots_[head & (capacity_ - 1)]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only: the next item without removing it, or nullptr
+    const T* peek() const {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots_[head & (capacity_ - 1)];
+    }
+
+    // Exact on either side for that side's own changes, approximate otherwise
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+    size_t capacity() const { return capacity_; }
+
+private:
+    static size_t roundUp(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    const size_t capacity_;
+    std::unique_ptr<T[]> slots_;
+    // On separate cache lines so the two sides don't false-share
+    alignas(64) std::atomic<size_t> head_; // Next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail_; // Next slot to push, written by the producer
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,139 @@
+#include "StreamRegistry.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+const std::chrono::seconds JSON_MAX_AGE(1);
+
+bool lessById(const std::shared_ptr<const StreamRegistry::Entry>& entry, const std::string& streamId) {
+    return entry->info.streamId < streamId;
+}
+
+void appendJsonString(std::string& out, const std::string& text) {
+    out += '"';
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+}
+
+const StreamRegistry::Entry* StreamRegistry::Snapshot::find(const std::string& streamId) const {
+    auto it = std::lower_bound(entries.begin(), entries.end(), streamId, lessById);
+    return it != entries.end() && (*it)->info.streamId == streamId ? it->get() : nullptr;
+}
+
+StreamRegistry::StreamRegistry()
+    : snapshot_(std::make_shared<const Snapshot>()), jsonVersion_(0) {
+}
+
+std::shared_ptr<StreamStats> StreamRegistry::publish(const StreamInfo& info, const std::string& destination) {
+    auto entry = std::make_shared<Entry>();
+    entry->info = info;
+    entry->destination = destination;
+    entry->started = Clock::now();
+    entry->stats = std::make_shared<StreamStats>();
+    entry->stats->sampledAt = entry->started;
+    std::shared_ptr<StreamStats> stats = entry->stats;
+
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    std::shared_ptr<const Snapshot> current = std::atomic_load(&snapshot_);
+    auto next = std::make_shared<Snapshot>();
+    next->version = current->version + 1;
+    next->entries = current->entries; // Copies pointers only; entries are shared
+    auto it = std::lower_bound(next->entries.begin(), next->entries.end(), info.streamId, lessById);
+    if (it != next->entries.end() && (*it)->info.streamId == info.streamId) {
+        *it = std::move(entry);
+    } else {
+        next->entries.insert(it, std::move(entry));
+    }
+    std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>(std::move(next)));
+    return stats;
+}
+
+void StreamRegistry::unpublish(const std::string& streamId) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    std::shared_ptr<const Snapshot> current = std::atomic_load(&snapshot_);
+    auto it = std::lower_bound(current->entries.begin(), current->entries.end(), streamId, lessById);
+    if (it == current->entries.end() || (*it)->info.streamId != streamId) {
+        return;
+    }
+    auto next = std::make_shared<Snapshot>();
+    next->version = current->version + 1;
+    next->entries.reserve(current->entries.size() - 1);
+    next->entries.insert(next->entries.end(), current->entries.begin(), it);
+    next->entries.insert(next->entries.end(), it + 1, current->entries.end());
+    std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>(std::move(next)));
+}
+
+std::shared_ptr<const std::string> StreamRegistry::json(Clock::time_point now) {
+    std::shared_ptr<const Snapshot> snapshot = std::atomic_load(&snapshot_);
+
+    std::lock_guard<std::mutex> lock(renderMutex_);
+    if (json_ && jsonVersion_ == snapshot->version && now - jsonRenderedAt_ < JSON_MAX_AGE) {
+        return json_;
+    }
+
+    auto body = std::make_shared<std::string>();
+    body->reserve(64 + snapshot->entries.size() * 192);
+    *body += "{\"count\":" + std::to_string(snapshot->entries.size()) + ",\"streams\":[";
+    bool first = true;
+    for (const auto& entry : snapshot->entries) {
+        StreamStats& stats = *entry->stats;
+        uint64_t bytes = stats.bytes.load(std::memory_order_relaxed);
+        auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - stats.sampledAt).count();
+        if (elapsedMs >= 500) {
+            stats.bitrate = (bytes - stats.sampledBytes) * 8000 / static_cast<uint64_t>(elapsedMs);
+            stats.sampledBytes = bytes;
+            stats.sampledAt = now;
+        }
+
+        *body += first ? "{" : ",{";
+        first = false;
+        *body += "\"stream_id\":";
+        appendJsonString(*body, entry->info.streamId);
+        *body += ",\"device_id\":";
+        appendJsonString(*body, entry->info.deviceId);
+        *body += ",\"destination\":";
+        appendJsonString(*body, entry->destination);
+        *body += ",\"uptime_s\":" +
+                 std::to_string(std::chrono::duration_cast<std::chrono::seconds>(now - entry->started).count());
+        *body += ",\"packets\":" + std::to_string(stats.packets.load(std::memory_order_relaxed));
+        *body += ",\"bytes\":" + std::to_string(bytes);
+        *body += ",\"bitrate_bps\":" + std::to_string(stats.bitrate);
+        *body += ",\"viewers\":" + std::to_string(stats.viewers.load(std::memory_order_relaxed));
+        *body += ",\"thinned_frames\":" + std::to_string(stats.thinnedFrames.load(std::memory_order_relaxed));
+        uint32_t reports = stats.rtcpReports.load(std::memory_order_relaxed);
+        if (reports > 0) {
+            int64_t rtt = stats.rttUs.load(std::memory_order_relaxed);
+            *body += ",\"rtcp\":{\"reports\":" + std::to_string(reports);
+            *body += ",\"fraction_lost\":" +
+                     std::to_string(stats.fractionLost.load(std::memory_order_relaxed) / 256.0).substr(0, 5);
+            *body += ",\"cumulative_lost\":" + std::to_string(stats.cumulativeLost.load(std::memory_order_relaxed));
+            *body += ",\"jitter_ms\":" + std::to_string(stats.jitterUs.load(std::memory_order_relaxed) / 1000);
+            *body += ",\"rtt_ms\":" + (rtt < 0 ? std::string("null") : std::to_string(rtt / 1000));
+            *body += '}';
+        }
+        *body += '}';
+    }
+    *body += "]}\n";
+
+    json_ = std::move(body);
+    jsonVersion_ = snapshot->version;
+    jsonRenderedAt_ = now;
+    return json_;
+}
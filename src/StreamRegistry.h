@@ -0,0 +1,88 @@
+#ifndef STREAM_REGISTRY_H
+#define STREAM_REGISTRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct StreamInfo {
+    std::string deviceId;
+    std::string streamId;
+    std::string rtmpUrl;
+    std::string flvUrl;
+    std::string hlsUrl;
+    std::string webrtcUrl;
+    std::string sourcePath; // Media served at /live/<streamId>.flv and .mp4; empty for none
+};
+
+// Counters bumped by whoever moves the stream's media; relaxed atomics, read
+// by the /api/streams renderer
+struct StreamStats {
+    std::atomic<uint64_t> packets{0}; // RTP packets, or chunks handed to HTTP viewers
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint32_t> viewers{0};
+    std::atomic<uint64_t> thinnedFrames{0}; // Dropped for loss or the egress budget
+
+    // From the platform's RTCP receiver reports, RTP sessions only
+    std::atomic<uint32_t> rtcpReports{0};
+    std::atomic<uint32_t> fractionLost{0};  // Last report, in 1/256
+    std::atomic<int32_t> cumulativeLost{0};
+    std::atomic<uint32_t> jitterUs{0};
+    std::atomic<int64_t> rttUs{-1};         // -1 until a report echoes one of our SRs
+
+    // Previous sample for the bitrate; guarded by the registry's render mutex
+    uint64_t sampledBytes = 0;
+    std::chrono::steady_clock::time_point sampledAt;
+    uint64_t bitrate = 0; // Bits per second over the last sampling interval
+};
+
+// Published streams, read without locks. Writers (session setup and teardown)
+// copy the sorted entry list under a mutex and swap in the new snapshot with
+// std::atomic_store; readers take the current snapshot with std::atomic_load
+// and keep it alive for as long as they use it, so a reader never blocks a
+// writer and a retired snapshot is freed by whoever drops the last reference.
+class StreamRegistry {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        StreamInfo info;
+        std::string destination; // "ip:port" the media goes to; empty for HTTP-only streams
+        Clock::time_point started;
+        std::shared_ptr<StreamStats> stats;
+    };
+
+    struct Snapshot {
+        uint64_t version = 0;
+        std::vector<std::shared_ptr<const Entry>> entries; // Sorted by streamId
+
+        const Entry* find(const std::string& streamId) const;
+    };
+
+    StreamRegistry();
+
+    // Adds or replaces a stream; returns the counters its sender should bump
+    std::shared_ptr<StreamStats> publish(const StreamInfo& info, const std::string& destination = std::string());
+    void unpublish(const std::string& streamId);
+
+    std::shared_ptr<const Snapshot> snapshot() const { return std::atomic_load(&snapshot_); }
+
+    // /api/streams body. Rendered at most once per second (or on a change of
+    // the stream set) and shared by every poller in between.
+    std::shared_ptr<const std::string> json(Clock::time_point now);
+
+private:
+    std::shared_ptr<const Snapshot> snapshot_;
+    std::mutex writeMutex_;
+
+    std::mutex renderMutex_;
+    std::shared_ptr<const std::string> json_;
+    uint64_t jsonVersion_;
+    Clock::time_point jsonRenderedAt_;
+};
+
+#endif // STREAM_REGISTRY_H
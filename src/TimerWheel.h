@@ -0,0 +1,185 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <utility>
+
+// Hashed timer wheel. Items are scheduled at an absolute tick and handed back
+// by advance() once that tick has passed. Scheduling is O(1); advancing visits
+// only the slots between the previous and the current tick.
+template <typename T>
+class TimerWheel {
+public:
+    explicit TimerWheel(size_t slotCount = 1024)
+        : slots_(slotCount), currentTick_(0), size_(0) {}
+
+    void reset(uint64_t tick) { currentTick_ = tick; }
+
+    void schedule(uint64_t tick, T item) {
+        if (tick <= currentTick_) {
+            tick = currentTick_ + 1; // Already due: fire on the next advance
+        }
+        slots_[tick % slots_.size()].push_back(Entry{tick, std::move(item)});
+        ++size_;
+    }
+
+    // Calls fn(item) for every item due at or before nowTick. fn may schedule new items.
+    template <typename Fn>
+    void advance(uint64_t nowTick, Fn&& fn) {
+        if (nowTick <= currentTick_) {
+            return;
+        }
+        uint64_t steps = nowTick - currentTick_;
+        if (steps > slots_.size()) {
+            steps = slots_.size();
+        }
+        uint64_t firstTick = currentTick_ + 1;
+        currentTick_ = nowTick;
+
+        for (uint64_t i = 0; i < steps; ++i) {
+            std::vector<Entry>& slot = slots_[(firstTick + i) % slots_.size()];
+            if (slot.empty()) {
+                continue;
+            }
+            firing_.swap(slot);
+            for (Entry& entry : firing_) {
+                if (entry.tick <= nowTick) {
+                    --size_;
+                    fn(entry.item);
+                } else {
+                    slot.push_back(std::move(entry)); // Due in a later rotation
+                }
+            }
+            firing_.clear();
+        }
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    struct Entry {
+        uint64_t tick;
+        T item;
+    };
+
+    std::vector<std::vector<Entry>> slots_;
+    std::vector<Entry> firing_;
+    uint64_t currentTick_;
+    size_t size_;
+};
+
+// Hierarchical timer wheel: Levels wheels of 2^SlotBits slots, each slot of a
+// level spanning one full rotation of the level below. An item goes on the
+// coarsest level its delay needs and drops a level whenever its slot comes
+// up, so scheduling is O(1) and an item is moved at most Levels - 1 times
+// however far out it is. Suits large numbers of long timers (keepalives,
+// registration refreshes) that would crowd the flat wheel's rotations. With
+// the defaults it spans 2^32 ticks.
+template <typename T, unsigned SlotBits = 8, unsigned Levels = 4>
+class HierarchicalTimerWheel {
+public:
+    HierarchicalTimerWheel() : currentTick_(0), size_(0) {}
+
+    void reset(uint64_t tick) { currentTick_ = tick; }
+
+    void schedule(uint64_t tick, T item) {
+        if (tick <= currentTick_) {
+            tick = currentTick_ + 1; // Already due: fire on the next advance
+        }
+        insert(Entry{tick, std::move(item)});
+        ++size_;
+    }
+
+    // Calls fn(item) for every item due at or before nowTick, in tick order.
+    // fn may schedule new items.
+    template <typename Fn>
+    void advance(uint64_t nowTick, Fn&& fn) {
+        while (currentTick_ < nowTick && size_ > 0) {
+            ++currentTick_;
+            // Bring down the coarser slots whose span starts now
+            for (unsigned level = 1; level < Levels && (currentTick_ & mask(level - 1)) == 0; ++level) {
+                cascade(level);
+            }
+            std::vector<Entry>& slot = levels_[0][currentTick_ & SLOT_MASK];
+            if (slot.empty()) {
+                continue;
+            }
+            firing_.swap(slot);
+            for (Entry& entry : firing_) {
+                --size_;
+                fn(entry.item);
+            }
+            firing_.clear();
+        }
+        if (currentTick_ < nowTick) {
+            currentTick_ = nowTick; // Nothing scheduled; skip the idle ticks
+        }
+    }
+
+    // Earliest tick advance() may have work at, for sleeping until then.
+    // Max uint64 when empty.
+    uint64_t nextTick() const {
+        if (size_ == 0) {
+            return std::numeric_limits<uint64_t>::max();
+        }
+        for (uint64_t tick = currentTick_ + 1;; ++tick) {
+            // A rotation boundary may cascade items due right there
+            if (!levels_[0][tick & SLOT_MASK].empty() || (tick & SLOT_MASK) == 0) {
+                return tick;
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    static const uint64_t SLOTS = uint64_t(1) << SlotBits;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+
+    struct Entry {
+        uint64_t tick;
+        T item;
+    };
+
+    // Ticks below the span of level + 1
+    static uint64_t mask(unsigned level) { return (uint64_t(1) << (SlotBits * (level + 1))) - 1; }
+
+    void insert(Entry entry) {
+        uint64_t delta = entry.tick - currentTick_;
+        unsigned level = 0;
+        while (level + 1 < Levels && delta > mask(level)) {
+            ++level;
+        }
+        uint64_t tick = entry.tick;
+        if (delta > mask(level)) {
+            tick = currentTick_ + mask(level); // Beyond the top level: parked, re-placed when its slot comes up
+        }
+        levels_[level][(tick >> (SlotBits * level)) & SLOT_MASK].push_back(std::move(entry));
+    }
+
+    void cascade(unsigned level) {
+        std::vector<Entry>& slot = levels_[level][(currentTick_ >> (SlotBits * level)) & SLOT_MASK];
+        if (slot.empty()) {
+            return;
+        }
+        cascading_.swap(slot);
+        for (Entry& entry : cascading_) {
+            insert(std::move(entry)); // Lands on a finer level, or level 0 at the current tick
+        }
+        cascading_.clear();
+    }
+
+    std::array<std::array<std::vector<Entry>, SLOTS>, Levels> levels_;
+    std::vector<Entry> firing_;
+    std::vector<Entry> cascading_;
+    uint64_t currentTick_;
+    size_t size_;
+};
+
+#endif // TIMER_WHEEL_H
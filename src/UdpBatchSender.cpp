@@ -0,0 +1,140 @@
+#include "UdpBatchSender.h"
+#include "Log.h"
+#include <cerrno>
+#include <cstring>
+#include <netinet/udp.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 // linux/udp.h, kernel 4.18+
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+namespace {
+const size_t MAX_MESSAGES = 256;      // Per sendmmsg call
+const size_t MAX_GSO_SEGMENTS = 64;   // UDP_MAX_SEGMENTS on older kernels
+const size_t MAX_GSO_BYTES = 65000;   // Must fit one IPv4 UDP datagram before segmentation
+}
+
+UdpBatchSender::UdpBatchSender(bool useGso)
+    : useGso_(useGso), control_(MAX_MESSAGES) {
+    messages_.reserve(MAX_MESSAGES);
+    messagePackets_.reserve(MAX_MESSAGES);
+}
+
+void UdpBatchSender::add(int fd, const sockaddr_in* dst, const iovec* iov, size_t iovCount) {
+    size_t length = 0;
+    for (size_t i = 0; i < iovCount; ++i) {
+        length += iov[i].iov_len;
+    }
+    packets_.push_back(Pending{fd, dst, iovs_.size(), iovCount, length});
+    iovs_.insert(iovs_.end(), iov, iov + iovCount);
+}
+
+void UdpBatchSender::flush() {
+    // Packets are queued stream by stream, so a run of equal fds is one
+    // socket's share of this flush and goes out with one sendmmsg.
+    size_t begin = 0;
+    while (begin < packets_.size()) {
+        size_t end = begin + 1;
+        while (end < packets_.size() && packets_[end].fd == packets_[begin].fd) {
+            ++end;
+        }
+
+        size_t next = begin;
+        while (next < end) {
+            size_t built = buildMessages(next, end, useGso_);
+            int sent = sendmmsg(packets_[begin].fd, messages_.data(), messages_.size(), 0);
+            stats_.syscalls.fetch_add(1, std::memory_order_relaxed);
+
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (useGso_ && messagePackets_[0] > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+                    // No UDP_SEGMENT support (or no checksum offload): retry plain
+                    LOG_WARN("UDP GSO unavailable ({}), using plain sendmmsg.", strerror(errno));
+                    useGso_ = false;
+                    continue;
+                }
+                // Socket buffer full or unreachable peer: drop what we built, as UDP would
+                stats_.dropped.fetch_add(built, std::memory_order_relaxed);
+                next += built;
+                continue;
+            }
+
+            size_t packets = 0;
+            uint64_t gso = 0;
+            for (int i = 0; i < sent; ++i) {
+                packets += messagePackets_[i];
+                if (messagePackets_[i] > 1) {
+                    ++gso;
+                }
+            }
+            stats_.packets.fetch_add(packets, std::memory_order_relaxed);
+            stats_.gsoSends.fetch_add(gso, std::memory_order_relaxed);
+            next += packets; // Partially sent batches are retried from the first unsent message
+        }
+        begin = end;
+    }
+
+    packets_.clear();
+    iovs_.clear();
+}
+
+size_t UdpBatchSender::buildMessages(size_t begin, size_t end, bool useGso) {
+    messages_.clear();
+    messagePackets_.clear();
+
+    size_t covered = 0;
+    size_t index = begin;
+    while (index < end && messages_.size() < MAX_MESSAGES) {
+        const Pending& first = packets_[index];
+        size_t count = 1;
+        size_t total = first.length;
+        size_t iovCount = first.iovCount;
+
+        if (useGso) {
+            // GSO splits the payload into first.length sized datagrams; only the
+            // last one may be shorter.
+            while (index + count < end && count < MAX_GSO_SEGMENTS) {
+                const Pending& next = packets_[index + count];
+                if (next.dst != first.dst || next.length > first.length || total + next.length > MAX_GSO_BYTES) {
+                    break;
+                }
+                total += next.length;
+                iovCount += next.iovCount;
+                ++count;
+                if (next.length < first.length) {
+                    break;
+                }
+            }
+        }
+
+        mmsghdr message{};
+        message.msg_hdr.msg_name = const_cast<sockaddr_in*>(first.dst);
+        message.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        message.msg_hdr.msg_iov = &iovs_[first.iovBegin];
+        message.msg_hdr.msg_iovlen = iovCount;
+
+        if (count > 1) {
+            char* buffer = control_[messages_.size()].data();
+            memset(buffer, 0, CMSG_SPACE(sizeof(uint16_t)));
+            message.msg_hdr.msg_control = buffer;
+            message.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&message.msg_hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segmentSize = static_cast<uint16_t>(first.length);
+            memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+        }
+
+        messages_.push_back(message);
+        messagePackets_.push_back(count);
+        covered += count;
+        index += count;
+    }
+    return covered;
+}
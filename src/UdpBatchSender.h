@@ -0,0 +1,58 @@
+#ifndef UDP_BATCH_SENDER_H
+#define UDP_BATCH_SENDER_H
+
+#include <vector>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+// Counters for verifying batching under load. Written by one sender thread,
+// readable from any thread.
+struct UdpBatchStats {
+    std::atomic<uint64_t> packets{0};   // RTP packets handed to the kernel
+    std::atomic<uint64_t> syscalls{0};  // sendmmsg calls
+    std::atomic<uint64_t> gsoSends{0};  // Messages sent as one UDP_SEGMENT super-datagram
+    std::atomic<uint64_t> dropped{0};   // Packets the kernel refused (full socket buffer etc.)
+};
+
+// Collects datagrams queued by the streams of one sender worker and sends
+// them with as few syscalls as possible: one sendmmsg per socket per flush,
+// and consecutive equal-sized packets to the same destination are merged into
+// a single UDP GSO message where the kernel supports it.
+class UdpBatchSender {
+public:
+    explicit UdpBatchSender(bool useGso = true);
+
+    // Queues one datagram gathered from iov. The buffers and dst must stay
+    // valid until flush() returns.
+    void add(int fd, const sockaddr_in* dst, const iovec* iov, size_t iovCount);
+    void flush();
+
+    bool empty() const { return packets_.empty(); }
+    const UdpBatchStats& stats() const { return stats_; }
+
+private:
+    struct Pending {
+        int fd;
+        const sockaddr_in* dst;
+        size_t iovBegin;
+        size_t iovCount;
+        size_t length;
+    };
+
+    size_t buildMessages(size_t begin, size_t end, bool useGso);
+
+    bool useGso_;
+    std::vector<Pending> packets_;
+    std::vector<iovec> iovs_;
+    std::vector<mmsghdr> messages_;
+    std::vector<size_t> messagePackets_; // Packets carried by each message
+    std::vector<std::array<char, CMSG_SPACE(sizeof(uint16_t))>> control_;
+    UdpBatchStats stats_;
+};
+
+#endif // UDP_BATCH_SENDER_H
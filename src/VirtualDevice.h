@@ -0,0 +1,50 @@
+#ifndef VIRTUAL_DEVICE_H
+#define VIRTUAL_DEVICE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include "CatalogPages.h"
+
+// One simulated GB28181 device. All devices share the client's eXosip
+// context, SIP transport and event loop; only identity and state live here.
+struct VirtualDevice {
+    std::string deviceId;
+    std::vector<std::string> channelIds;
+    size_t templateIndex = 0; // Its [device] section; password and media source are looked up there
+    std::string fromUri; // sip:<deviceId>@<realm>, built once
+    std::string keepAliveTail; // Keepalive body after the SN, built by prepareKeepAlive()
+
+    int registerId = -1; // eXosip registration ID, -1 until the first REGISTER is built
+    std::atomic<bool> registered{false};
+
+    // Scheduling state, guarded by the client's scheduleMutex_. Bumping an
+    // epoch cancels the device's pending task of that kind.
+    uint32_t registerEpoch = 0;
+    uint32_t keepAliveEpoch = 0;
+    int registerFailures = 0; // Since the last success; drives the retry backoff
+    bool challenged = false;  // The current attempt already answered a 401/407
+
+    // Pre-rendered Catalog pages, built on the first query. Access with std::atomic_load/store.
+    std::shared_ptr<const CatalogPages> catalog;
+
+    void prepareKeepAlive() {
+        keepAliveTail = "</SN>\n  <DeviceID>" + deviceId + "</DeviceID>\n  <Status>OK</Status>\n</Notify>";
+    }
+
+    // Writes a Keepalive Notify with sn to out (replacing its contents); only
+    // the SN differs between keepalives
+    void renderKeepAlive(std::string_view sn, std::string& out) const {
+        static const char head[] = "<?xml version=\"1.0\"?>\n<Notify>\n  <CmdType>Keepalive</CmdType>\n  <SN>";
+        out.clear();
+        out.reserve(sizeof(head) - 1 + sn.size() + keepAliveTail.size());
+        out.append(head, sizeof(head) - 1);
+        out += sn;
+        out += keepAliveTail;
+    }
+};
+
+#endif // VIRTUAL_DEVICE_H
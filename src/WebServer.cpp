@@ -1,9 +1,147 @@
 #include "WebServer.h"
-#include <sstream>
+#include "Log.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
-WebServer::WebServer(int port)
-    : port_(port), running_(false) {
-    std::cout << "Web Server initialized on port: " << port_ << std::endl;
+namespace {
+const int MAX_EVENTS = 64;
+const size_t MAX_REQUEST_HEADER = 8192;
+const size_t MAX_IOV = 16;
+const std::chrono::seconds IDLE_TIMEOUT(30);
+const int SWEEP_INTERVAL_MS = 1000;
+const int LIVE_TICK_MS = 5;            // Pacing resolution of live streams
+const size_t MAX_VIEWER_BACKLOG = 4 << 20; // Unsent bytes before a viewer starts skipping frames
+const int HLS_BLOCK_TARGET_DURATIONS = 3;  // A blocking reload gives up after this many target durations
+
+// Text and attribute values on the index page come from device configuration
+std::string escapeHtml(std::string_view text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '&': escaped += "&amp;"; break;
+            case '<': escaped += "&lt;"; break;
+            case '>': escaped += "&gt;"; break;
+            case '"': escaped += "&quot;"; break;
+            default: escaped += c; break;
+        }
+    }
+    return escaped;
+}
+
+const char* PAGE_HEAD =
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<head>\n"
+    "<title>GB28181 Stream Viewer</title>\n"
+    "<link href=\"https://vjs.zencdn.net/7.11.4/video-js.css\" rel=\"stylesheet\" />\n"
+    "<style>\n"
+    "  body { font-family: sans-serif; margin: 20px; background-color: #f0f2f5; }\n"
+    "  h1 { color: #333; text-align: center; margin-bottom: 30px; }\n"
+    "  .stream-grid { display: grid; grid-template-columns: repeat(auto-fit, minmax(300px, 1fr)); gap: 20px; }\n"
+    "  .stream-card { background-color: #fff; border: 1px solid #ddd; border-radius: 8px; box-shadow: 0 2px 4px rgba(0,0,0,0.1); padding: 20px; }\n"
+    "  .stream-card h3 { margin-top: 0; color: #0056b3; }\n"
+    "  .video-js { width: 100%; height: 200px; }\n"
+    "  .stream-info { margin-top: 15px; font-size: 0.9em; color: #555; }\n"
+    "  .stream-info p { margin: 5px 0; }\n"
+    "</style>\n"
+    "</head>\n"
+    "<body>\n"
+    "<h1>Active GB28181 Streams</h1>\n"
+    "<div class=\"stream-grid\">\n";
+
+const char* PAGE_EMPTY = "<p>No active streams currently.</p>\n";
+
+const char* PAGE_TAIL =
+    "</div>\n"
+    "<script src=\"https://vjs.zencdn.net/7.11.4/video.min.js\"></script>\n"
+    "<script src=\"https://cdnjs.cloudflare.com/ajax/libs/videojs-contrib-hls/5.15.0/videojs-contrib-hls.min.js\"></script>\n"
+    "<script>\n"
+    "  document.addEventListener('DOMContentLoaded', function() {\n"
+    "    var players = document.querySelectorAll('.video-js');\n"
+    "    players.forEach(function(playerElement) {\n"
+    "      var player = videojs(playerElement.id);\n"
+    "      player.play();\n"
+    "    });\n"
+    "  });\n"
+    "</script>\n"
+    "</body>\n"
+    "</html>\n";
+
+const char* reasonPhrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 503: return "Service Unavailable";
+        case 431: return "Request Header Fields Too Large";
+        default: return "Internal Server Error";
+    }
+}
+
+// Whole string as a non-negative decimal number
+bool parseNumber(const std::string& text, int64_t& value) {
+    if (text.empty() || text.size() > 18) {
+        return false;
+    }
+    value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+// Value of "name" in a query string, empty if absent
+std::string queryParam(const std::string& query, const char* name) {
+    size_t length = strlen(name);
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos) {
+            end = query.size();
+        }
+        if (end - pos > length && query.compare(pos, length, name) == 0 && query[pos + length] == '=') {
+            return query.substr(pos + length + 1, end - pos - length - 1);
+        }
+        pos = end + 1;
+    }
+    return std::string();
+}
+
+bool equalsIgnoreCase(const std::string& a, const char* b) {
+    return strcasecmp(a.c_str(), b) == 0;
+}
+
+std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    size_t end = text.find_last_not_of(" \t");
+    return text.substr(begin, end - begin + 1);
+}
+}
+
+WebServer::WebServer(int port, StreamRegistry& registry)
+    : port_(port), running_(false), listenFd_(-1), epollFd_(-1), wakeFd_(-1), registry_(registry), indexVersion_(0),
+      liveStreams_(std::make_shared<const LiveStreamMap>()) {
+    LOG_INFO("Web Server initialized on port: {}", port_);
 }
 
 WebServer::~WebServer() {
@@ -12,110 +150,820 @@ WebServer::~WebServer() {
 
 void WebServer::start() {
     if (!running_) {
+        if (!openListener()) {
+            return;
+        }
         running_ = true;
         serverThread_ = std::thread(&WebServer::serverLoop, this);
-        std::cout << "Web Server started." << std::endl;
+        LOG_INFO("Web Server started.");
     }
 }
 
 void WebServer::stop() {
     if (running_) {
         running_ = false;
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
         if (serverThread_.joinable()) {
             serverThread_.join();
         }
-        std::cout << "Web Server stopped." << std::endl;
+
+        for (auto& entry : connections_) {
+            close(entry.first);
+        }
+        connections_.clear();
+        watchedStreams_.clear();
+        close(listenFd_);
+        close(wakeFd_);
+        close(epollFd_);
+        listenFd_ = wakeFd_ = epollFd_ = -1;
+        LOG_INFO("Web Server stopped.");
     }
 }
 
 void WebServer::addStream(const StreamInfo& info) {
-    std::lock_guard<std::mutex> lock(streamsMutex_);
-    activeStreams_[info.streamId] = info;
-    std::cout << "Added stream: " << info.streamId << " to WebServer." << std::endl;
+    // Opening the source may hit the disk; do it before taking the lock
+    std::shared_ptr<LiveStream> live;
+    if (!info.sourcePath.empty()) {
+        live = std::make_shared<LiveStream>(info.streamId, info.sourcePath);
+        if (!live->open()) {
+            LOG_WARN("Stream {} is listed without live playback.", info.streamId);
+            live.reset();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(streamsMutex_);
+        std::shared_ptr<StreamStats> stats = registry_.publish(info);
+        if (live) {
+            live->setStats(std::move(stats));
+        }
+
+        auto streams = std::make_shared<LiveStreamMap>(*std::atomic_load(&liveStreams_));
+        auto it = streams->find(info.streamId);
+        if (it != streams->end()) {
+            it->second->close();
+            streams->erase(it);
+        }
+        if (live) {
+            (*streams)[info.streamId] = live;
+        }
+        std::atomic_store(&liveStreams_, std::shared_ptr<const LiveStreamMap>(std::move(streams)));
+    }
+    LOG_INFO("Added stream: {} to WebServer.", info.streamId);
+
+    // The loop switches to the live tick as soon as it has something to pace
+    if (live && running_) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
+    }
 }
 
 void WebServer::removeStream(const std::string& streamId) {
     std::lock_guard<std::mutex> lock(streamsMutex_);
-    if (activeStreams_.count(streamId)) {
-        activeStreams_.erase(streamId);
-        std::cout << "Removed stream: " << streamId << " from WebServer." << std::endl;
+    registry_.unpublish(streamId);
+
+    auto streams = std::make_shared<LiveStreamMap>(*std::atomic_load(&liveStreams_));
+    auto it = streams->find(streamId);
+    if (it != streams->end()) {
+        it->second->close(); // Viewers are dropped by the server thread
+        streams->erase(it);
+        std::atomic_store(&liveStreams_, std::shared_ptr<const LiveStreamMap>(std::move(streams)));
+        LOG_INFO("Removed stream: {} from WebServer.", streamId);
     }
 }
 
+bool WebServer::openListener() {
+    listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) {
+        LOG_ERROR("Web Server: socket failed: {}", strerror(errno));
+        return false;
+    }
+    int on = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(port_));
+    if (bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listenFd_, SOMAXCONN) < 0) {
+        LOG_ERROR("Web Server: cannot listen on port {}: {}", port_, strerror(errno));
+        close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &ev);
+    ev.data.fd = wakeFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+    return true;
+}
+
 void WebServer::serverLoop() {
-    // This is a simulated web server loop.
-    // In a real application, you would use a library like Crow, Civetweb, or Boost.Beast
-    // to handle HTTP requests and serve content.
-    std::cout << "Web Server: Listening for connections on port " << port_ << std::endl;
+    LOG_INFO("Web Server: Listening for connections on port {}", port_);
+    epoll_event events[MAX_EVENTS];
+    Clock::time_point lastSweep = Clock::now();
+
     while (running_) {
-        // Simulate handling a request every few seconds
-        std::this_thread::sleep_for(std::chrono::seconds(5)); 
-        // For demonstration, we'll just print the current index page content
-        // In a real scenario, this would be served via HTTP.
-        // std::cout << "--- Current Web Index Page ---\n" << buildIndexPage() << "\n------------------------------" << std::endl;
-    }
-}
-
-std::string WebServer::buildIndexPage() {
-    std::stringstream ss;
-    ss << "<!DOCTYPE html>\n";
-    ss << "<html>\n";
-    ss << "<head>\n";
-    ss << "<title>GB28181 Stream Viewer</title>\n";
-    ss << "<link href=\"https://vjs.zencdn.net/7.11.4/video-js.css\" rel=\"stylesheet\" />\n";
-    ss << "<style>\n";
-    ss << "  body { font-family: sans-serif; margin: 20px; background-color: #f0f2f5; }\n";
-    ss << "  h1 { color: #333; text-align: center; margin-bottom: 30px; }\n";
-    ss << "  .stream-grid { display: grid; grid-template-columns: repeat(auto-fit, minmax(300px, 1fr)); gap: 20px; }\n";
-    ss << "  .stream-card { background-color: #fff; border: 1px solid #ddd; border-radius: 8px; box-shadow: 0 2px 4px rgba(0,0,0,0.1); padding: 20px; }\n";
-    ss << "  .stream-card h3 { margin-top: 0; color: #0056b3; }\n";
-    ss << "  .video-js { width: 100%; height: 200px; }\n";
-    ss << "  .stream-info { margin-top: 15px; font-size: 0.9em; color: #555; }\n";
-    ss << "  .stream-info p { margin: 5px 0; }\n";
-    ss << "</style>\n";
-    ss << "</head>\n";
-    ss << "<body>\n";
-    ss << "<h1>Active GB28181 Streams</h1>\n";
-    ss << "<div class=\"stream-grid\">\n";
+        bool live = !std::atomic_load(&liveStreams_)->empty() || !watchedStreams_.empty();
+        int count = epoll_wait(epollFd_, events, MAX_EVENTS, live ? LIVE_TICK_MS : SWEEP_INTERVAL_MS);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Web Server: epoll_wait failed: {}", strerror(errno));
+            break;
+        }
 
-    std::lock_guard<std::mutex> lock(streamsMutex_);
-    if (activeStreams_.empty()) {
-        ss << "<p>No active streams currently.</p>\n";
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd_) {
+                uint64_t value;
+                ssize_t ignored = read(wakeFd_, &value, sizeof(value));
+                (void)ignored;
+                continue;
+            }
+            if (fd == listenFd_) {
+                acceptConnections();
+                continue;
+            }
+
+            auto it = connections_.find(fd);
+            if (it == connections_.end()) {
+                continue;
+            }
+            Connection& connection = *it->second;
+            connection.lastActive = Clock::now();
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(fd);
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && !flushOutput(connection)) {
+                continue; // Closed
+            }
+            if (events[i].events & EPOLLIN) {
+                handleReadable(connection);
+            }
+        }
+
+        Clock::time_point now = Clock::now();
+        if (live) {
+            pumpLiveStreams(now);
+        }
+        if (now - lastSweep >= std::chrono::milliseconds(SWEEP_INTERVAL_MS)) {
+            closeIdleConnections(now);
+            lastSweep = now;
+        }
+    }
+}
+
+void WebServer::acceptConnections() {
+    while (true) {
+        int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERROR("Web Server: accept failed: {}", strerror(errno));
+            }
+            return;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        connection->lastActive = Clock::now();
+        connections_[fd] = std::move(connection);
+    }
+}
+
+void WebServer::handleReadable(Connection& connection) {
+    char buffer[4096];
+    bool peerClosed = false;
+    while (true) {
+        ssize_t n = read(connection.fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            connection.input.append(buffer, static_cast<size_t>(n));
+            continue;
+        }
+        if (n == 0) {
+            peerClosed = true; // Still answer what it sent before shutting down its side
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        closeConnection(connection.fd);
+        return;
+    }
+
+    if (connection.live) {
+        // A live response never ends, so anything after the request is ignored
+        connection.input.clear();
+        if (peerClosed) {
+            closeConnection(connection.fd);
+        }
+        return;
+    }
+    if (peerClosed && connection.hlsWait.stream) {
+        closeConnection(connection.fd); // Nobody left to answer
+        return;
+    }
+    processInput(connection, peerClosed);
+}
+
+void WebServer::processInput(Connection& connection, bool peerClosed) {
+    // Answer every complete request in the buffer (pipelining); responses are
+    // queued in order and go out together
+    int fd = connection.fd;
+    while (!connection.closeAfterWrite && !connection.live && !connection.hlsWait.stream) {
+        HttpRequest request;
+        bool malformed = false;
+        if (!parseRequest(connection, request, malformed)) {
+            if (malformed) {
+                queueResponse(connection, 400, "text/plain", std::make_shared<const std::string>("Bad Request\n"), "", false);
+            } else if (connection.input.size() > MAX_REQUEST_HEADER) {
+                queueResponse(connection, 431, "text/plain", std::make_shared<const std::string>("Request header too large\n"), "", false);
+            }
+            break;
+        }
+        handleRequest(connection, request);
+    }
+    if (peerClosed && !connection.hlsWait.stream) {
+        connection.closeAfterWrite = true;
+    }
+    if (connections_.count(fd)) {
+        flushOutput(connection);
+    }
+}
+
+bool WebServer::parseRequest(Connection& connection, HttpRequest& request, bool& malformed) {
+    size_t end = connection.input.find("\r\n\r\n");
+    if (end == std::string::npos || end > MAX_REQUEST_HEADER) {
+        return false;
+    }
+
+    size_t lineEnd = connection.input.find("\r\n");
+    std::string requestLine = connection.input.substr(0, lineEnd);
+    size_t sp1 = requestLine.find(' ');
+    size_t sp2 = requestLine.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1) {
+        malformed = true;
+        return false;
+    }
+    request.method = requestLine.substr(0, sp1);
+    request.path = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+    std::string version = requestLine.substr(sp2 + 1);
+    if (version.compare(0, 5, "HTTP/") != 0) {
+        malformed = true;
+        return false;
+    }
+    request.keepAlive = version != "HTTP/1.0";
+
+    size_t contentLength = 0;
+    size_t pos = lineEnd + 2;
+    while (pos < end) {
+        size_t next = connection.input.find("\r\n", pos);
+        std::string line = connection.input.substr(pos, next - pos);
+        pos = next + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = trim(line.substr(0, colon));
+        std::string value = trim(line.substr(colon + 1));
+        if (equalsIgnoreCase(name, "Connection")) {
+            if (equalsIgnoreCase(value, "close")) request.keepAlive = false;
+            else if (equalsIgnoreCase(value, "keep-alive")) request.keepAlive = true;
+        } else if (equalsIgnoreCase(name, "If-None-Match")) {
+            request.ifNoneMatch = value;
+        } else if (equalsIgnoreCase(name, "Content-Length")) {
+            contentLength = static_cast<size_t>(strtoul(value.c_str(), nullptr, 10));
+        }
+    }
+
+    // Request bodies are not used by any route; skip them once complete
+    size_t total = end + 4 + contentLength;
+    if (connection.input.size() < total) {
+        return false;
+    }
+    connection.input.erase(0, total);
+
+    // Routes match on the path; the query is kept for LL-HLS directives
+    size_t query = request.path.find('?');
+    if (query != std::string::npos) {
+        request.query = request.path.substr(query + 1);
+        request.path.erase(query);
+    }
+    return true;
+}
+
+void WebServer::handleRequest(Connection& connection, const HttpRequest& request) {
+    bool head = request.method == "HEAD";
+    if (request.method != "GET" && !head) {
+        queueResponse(connection, 405, "text/plain", std::make_shared<const std::string>("Method Not Allowed\n"),
+                      "Allow: GET, HEAD\r\n", request.keepAlive);
+        return;
+    }
+
+    if (request.path.compare(0, 6, "/live/") == 0 && handleLiveRequest(connection, request)) {
+        return;
+    }
+
+    if (request.path == "/api/streams") {
+        queueResponse(connection, 200, "application/json", registry_.json(Clock::now()),
+                      "Cache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\n", request.keepAlive, head);
+        return;
+    }
+
+    if (request.path == "/metrics") {
+        auto body = std::make_shared<std::string>();
+        Metrics::instance().render(*body);
+        queueResponse(connection, 200, "text/plain; version=0.0.4", std::move(body), "Cache-Control: no-cache\r\n",
+                      request.keepAlive, head);
+        return;
+    }
+
+    if (request.path == "/" || request.path == "/index.html") {
+        refreshIndexPage();
+        std::shared_ptr<const IndexPage> page = indexPage_;
+        std::string etagHeader = "ETag: " + page->etag + "\r\nCache-Control: no-cache\r\n";
+        if (request.ifNoneMatch == page->etag) {
+            // Dashboards polling an unchanged page get headers only
+            queueResponse(connection, 304, nullptr, nullptr, etagHeader, request.keepAlive);
+            return;
+        }
+        // Aliases the snapshot: the body is sent from the shared buffer
+        std::shared_ptr<const std::string> body(page, &page->html);
+        queueResponse(connection, 200, "text/html; charset=utf-8", body, etagHeader, request.keepAlive, head);
+        return;
+    }
+
+    queueResponse(connection, 404, "text/plain", std::make_shared<const std::string>("Not Found\n"), "", request.keepAlive, head);
+}
+
+bool WebServer::handleLiveRequest(Connection& connection, const HttpRequest& request) {
+    std::string name = request.path.substr(6);
+    size_t slash = name.find('/');
+    if (slash != std::string::npos) {
+        return handleHlsRequest(connection, request, name.substr(0, slash), name.substr(slash + 1));
+    }
+    if (name.size() > 5 && name.compare(name.size() - 5, 5, ".m3u8") == 0) {
+        return handleHlsRequest(connection, request, name.substr(0, name.size() - 5), std::string());
+    }
+
+    LiveFormat format;
+    const char* contentType;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".flv") == 0) {
+        format = LiveFormat::Flv;
+        contentType = "video/x-flv";
+    } else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".mp4") == 0) {
+        format = LiveFormat::Fmp4;
+        contentType = "video/mp4";
+    } else {
+        return false; // Not a live format; falls through to 404
+    }
+    name.erase(name.size() - 4);
+
+    std::shared_ptr<const LiveStreamMap> streams = std::atomic_load(&liveStreams_);
+    auto it = streams->find(name);
+    if (it == streams->end() || it->second->closed()) {
+        return false;
+    }
+    const std::shared_ptr<LiveStream>& stream = it->second;
+
+    // No Content-Length: the body runs until either side closes
+    auto headers = std::make_shared<std::string>("HTTP/1.1 200 OK\r\nContent-Type: ");
+    *headers += contentType;
+    *headers += "\r\nCache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n";
+    queueBuffer(connection, std::move(headers));
+    if (request.method == "HEAD") {
+        connection.closeAfterWrite = true;
+        return true;
+    }
+
+    // Header plus the cached GOP, so playback starts at once on a keyframe
+    std::vector<std::shared_ptr<const std::string>> join;
+    stream->joinData(format, join);
+    for (auto& buffer : join) {
+        queueBuffer(connection, std::move(buffer));
+    }
+
+    connection.live = stream;
+    connection.liveFormat = format;
+    stream->viewers.push_back(connection.fd);
+    if (StreamStats* stats = stream->stats()) {
+        stats->viewers.store(static_cast<uint32_t>(stream->viewers.size()), std::memory_order_relaxed);
+    }
+    if (std::find(watchedStreams_.begin(), watchedStreams_.end(), stream) == watchedStreams_.end()) {
+        watchedStreams_.push_back(stream);
+    }
+    LOG_INFO("Web Server: viewer joined {}{} ({} watching)", name, format == LiveFormat::Flv ? ".flv" : ".mp4",
+             stream->viewers.size());
+    return true;
+}
+
+bool WebServer::handleHlsRequest(Connection& connection, const HttpRequest& request, const std::string& streamId,
+                                 const std::string& file) {
+    std::shared_ptr<const LiveStreamMap> streams = std::atomic_load(&liveStreams_);
+    auto it = streams->find(streamId);
+    if (it == streams->end() || it->second->closed()) {
+        return false;
+    }
+
+    HlsRequest hls;
+    hls.stream = it->second;
+    hls.head = request.method == "HEAD";
+    hls.keepAlive = request.keepAlive;
+
+    if (file.empty()) {
+        // Blocking reload: _HLS_msn=<M>[&_HLS_part=<P>]
+        hls.resource = HlsResource::Playlist;
+        std::string msn = queryParam(request.query, "_HLS_msn");
+        std::string part = queryParam(request.query, "_HLS_part");
+        if (!msn.empty() && !parseNumber(msn, hls.msn)) {
+            return false;
+        }
+        // _HLS_part needs _HLS_msn, and an msn too far ahead could never be answered in time
+        if ((!part.empty() && (hls.msn < 0 || !parseNumber(part, hls.part))) ||
+            hls.msn > static_cast<int64_t>(hls.stream->hls().openSequence()) + 2) {
+            queueResponse(connection, 400, "text/plain", std::make_shared<const std::string>("Bad Request\n"), "",
+                          request.keepAlive, hls.head);
+            return true;
+        }
+    } else if (file == "init.mp4") {
+        hls.resource = HlsResource::Init;
+    } else if (file.size() > 4 && file.compare(file.size() - 4, 4, ".m4s") == 0) {
+        std::string name = file.substr(0, file.size() - 4);
+        size_t dot = name.find('.');
+        if (dot == std::string::npos) {
+            hls.resource = HlsResource::Segment;
+            if (!parseNumber(name, hls.msn)) {
+                return false;
+            }
+        } else {
+            hls.resource = HlsResource::Part;
+            if (!parseNumber(name.substr(0, dot), hls.msn) || !parseNumber(name.substr(dot + 1), hls.part)) {
+                return false;
+            }
+        }
+    } else {
+        return false;
+    }
+
+    if (answerHls(connection, hls)) {
+        return true;
+    }
+    if (hls.resource == HlsResource::Segment ||
+        (hls.resource == HlsResource::Part &&
+         !hls.stream->hls().isUpcomingPart(static_cast<uint64_t>(hls.msn), static_cast<size_t>(hls.part)))) {
+        return false; // Gone from the ring or never going to exist
+    }
+
+    // Hold the request until the packager publishes what it asked for
+    hls.deadline = Clock::now() + std::chrono::seconds(hls.stream->hls().targetDurationSeconds() * HLS_BLOCK_TARGET_DURATIONS);
+    hls.stream->hlsWaiters.push_back(connection.fd);
+    if (std::find(watchedStreams_.begin(), watchedStreams_.end(), hls.stream) == watchedStreams_.end()) {
+        watchedStreams_.push_back(hls.stream);
+    }
+    connection.hlsWait = std::move(hls);
+    return true;
+}
+
+bool WebServer::answerHls(Connection& connection, const HlsRequest& request) {
+    const HlsPackager& hls = request.stream->hls();
+    std::vector<std::shared_ptr<const std::string>> body;
+    switch (request.resource) {
+        case HlsResource::Playlist:
+            if (request.msn >= 0 && !hls.hasPart(static_cast<uint64_t>(request.msn), request.part)) {
+                return false;
+            }
+            queueResponse(connection, 200, "application/vnd.apple.mpegurl", hls.playlist(),
+                          "Cache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\n", request.keepAlive, request.head);
+            return true;
+        case HlsResource::Init:
+            body.push_back(hls.initSegment());
+            break;
+        case HlsResource::Segment:
+            if (!hls.segment(static_cast<uint64_t>(request.msn), body)) {
+                return false;
+            }
+            break;
+        case HlsResource::Part:
+            if (!hls.part(static_cast<uint64_t>(request.msn), static_cast<size_t>(request.part), body)) {
+                return false;
+            }
+            break;
+    }
+    // Media never changes once published
+    queueResponse(connection, 200, "video/mp4", body,
+                  "Cache-Control: max-age=60\r\nAccess-Control-Allow-Origin: *\r\n", request.keepAlive, request.head);
+    return true;
+}
+
+void WebServer::resolveHlsWaiters(LiveStream& stream, Clock::time_point now) {
+    std::vector<int> waiters = stream.hlsWaiters;
+    for (int fd : waiters) {
+        auto it = connections_.find(fd);
+        if (it == connections_.end()) {
+            continue;
+        }
+        Connection& connection = *it->second;
+        HlsRequest& wait = connection.hlsWait;
+        if (!answerHls(connection, wait)) {
+            if (now < wait.deadline) {
+                continue;
+            }
+            queueResponse(connection, 503, "text/plain", std::make_shared<const std::string>("Not available yet\n"),
+                          "Retry-After: 1\r\n", wait.keepAlive, wait.head);
+        }
+        stream.hlsWaiters.erase(std::remove(stream.hlsWaiters.begin(), stream.hlsWaiters.end(), fd),
+                                stream.hlsWaiters.end());
+        wait = HlsRequest();
+        connection.lastActive = now;
+        processInput(connection, false); // Pipelined requests queued behind it; flushes
+    }
+}
+
+void WebServer::pumpLiveStreams(Clock::time_point now) {
+    // Streams removed since the last tick: drop their viewers
+    for (size_t i = 0; i < watchedStreams_.size();) {
+        std::shared_ptr<LiveStream> stream = watchedStreams_[i];
+        if (stream->closed()) {
+            std::vector<int> fds = stream->viewers;
+            fds.insert(fds.end(), stream->hlsWaiters.begin(), stream->hlsWaiters.end());
+            for (int fd : fds) {
+                closeConnection(fd);
+            }
+        }
+        if (stream->viewers.empty() && stream->hlsWaiters.empty()) {
+            watchedStreams_.erase(watchedStreams_.begin() + static_cast<std::ptrdiff_t>(i));
+        } else {
+            ++i;
+        }
+    }
+
+    std::shared_ptr<const LiveStreamMap> streams = std::atomic_load(&liveStreams_);
+    std::vector<LiveChunk> chunks;
+    for (const auto& entry : *streams) {
+        LiveStream& stream = *entry.second;
+        chunks.clear();
+        stream.pump(now, chunks);
+        if (!stream.hlsWaiters.empty()) {
+            resolveHlsWaiters(stream, now);
+        }
+        if (chunks.empty() || stream.viewers.empty()) {
+            continue;
+        }
+
+        std::vector<int> viewers = stream.viewers;
+        for (int fd : viewers) {
+            auto it = connections_.find(fd);
+            if (it == connections_.end()) {
+                continue;
+            }
+            Connection& connection = *it->second;
+            for (const LiveChunk& chunk : chunks) {
+                // A slow viewer skips whole GOPs rather than buffering without bound
+                if (connection.outputBytes > MAX_VIEWER_BACKLOG) {
+                    connection.skipToKeyframe = true;
+                }
+                if (connection.skipToKeyframe) {
+                    if (!chunk.keyframe || connection.outputBytes > MAX_VIEWER_BACKLOG) {
+                        continue;
+                    }
+                    connection.skipToKeyframe = false;
+                }
+                const auto& buffer = connection.liveFormat == LiveFormat::Flv ? chunk.flv : chunk.fmp4;
+                if (StreamStats* stats = stream.stats()) {
+                    stats->packets.fetch_add(1, std::memory_order_relaxed);
+                    stats->bytes.fetch_add(buffer->size(), std::memory_order_relaxed);
+                }
+                queueBuffer(connection, buffer);
+            }
+            flushOutput(connection);
+        }
+    }
+}
+
+void WebServer::queueBuffer(Connection& connection, std::shared_ptr<const std::string> buffer) {
+    connection.outputBytes += buffer->size();
+    connection.output.push_back(std::move(buffer));
+}
+
+void WebServer::queueResponse(Connection& connection, int status, const char* contentType,
+                              std::shared_ptr<const std::string> body, const std::string& extraHeaders,
+                              bool keepAlive, bool headOnly) {
+    queueHeaders(connection, status, contentType, body ? body->size() : 0, extraHeaders, keepAlive);
+    if (body && !body->empty() && !headOnly && status != 304) {
+        queueBuffer(connection, std::move(body));
+    }
+}
+
+void WebServer::queueResponse(Connection& connection, int status, const char* contentType,
+                              const std::vector<std::shared_ptr<const std::string>>& body,
+                              const std::string& extraHeaders, bool keepAlive, bool headOnly) {
+    size_t length = 0;
+    for (const auto& buffer : body) {
+        length += buffer->size();
+    }
+    queueHeaders(connection, status, contentType, length, extraHeaders, keepAlive);
+    if (!headOnly) {
+        for (const auto& buffer : body) {
+            queueBuffer(connection, buffer);
+        }
+    }
+}
+
+void WebServer::queueHeaders(Connection& connection, int status, const char* contentType, size_t contentLength,
+                             const std::string& extraHeaders, bool keepAlive) {
+    auto headers = std::make_shared<std::string>();
+    headers->reserve(160 + extraHeaders.size());
+    *headers += "HTTP/1.1 " + std::to_string(status) + " " + reasonPhrase(status) + "\r\n";
+    if (contentType) {
+        *headers += "Content-Type: ";
+        *headers += contentType;
+        *headers += "\r\n";
+    }
+    if (status != 304) {
+        *headers += "Content-Length: " + std::to_string(contentLength) + "\r\n";
+    }
+    *headers += extraHeaders;
+    if (!keepAlive) {
+        *headers += "Connection: close\r\n";
+    }
+    *headers += "\r\n";
+
+    queueBuffer(connection, std::move(headers));
+    if (!keepAlive) {
+        connection.closeAfterWrite = true;
+    }
+}
+
+bool WebServer::flushOutput(Connection& connection) {
+    while (!connection.output.empty()) {
+        iovec iov[MAX_IOV];
+        size_t count = 0;
+        for (auto it = connection.output.begin(); it != connection.output.end() && count < MAX_IOV; ++it) {
+            size_t offset = count == 0 ? connection.outputOffset : 0;
+            iov[count].iov_base = const_cast<char*>((*it)->data() + offset);
+            iov[count].iov_len = (*it)->size() - offset;
+            ++count;
+        }
+
+        ssize_t written = writev(connection.fd, iov, static_cast<int>(count));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            closeConnection(connection.fd);
+            return false;
+        }
+
+        size_t remaining = static_cast<size_t>(written);
+        connection.outputBytes -= remaining;
+        while (remaining > 0) {
+            size_t left = connection.output.front()->size() - connection.outputOffset;
+            if (remaining < left) {
+                connection.outputOffset += remaining;
+                break;
+            }
+            remaining -= left;
+            connection.output.pop_front();
+            connection.outputOffset = 0;
+        }
+    }
+
+    if (connection.output.empty() && connection.closeAfterWrite) {
+        closeConnection(connection.fd);
+        return false;
+    }
+
+    // Only watch for writability while something is stuck in the socket buffer
+    bool wantWrite = !connection.output.empty();
+    if (wantWrite != connection.writeWatched) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        if (wantWrite) {
+            ev.events |= EPOLLOUT;
+        }
+        ev.data.fd = connection.fd;
+        epoll_ctl(epollFd_, EPOLL_CTL_MOD, connection.fd, &ev);
+        connection.writeWatched = wantWrite;
+    }
+    return true;
+}
+
+void WebServer::closeConnection(int fd) {
+    auto it = connections_.find(fd);
+    if (it != connections_.end() && it->second->live) {
+        std::vector<int>& viewers = it->second->live->viewers;
+        viewers.erase(std::remove(viewers.begin(), viewers.end(), fd), viewers.end());
+        if (StreamStats* stats = it->second->live->stats()) {
+            stats->viewers.store(static_cast<uint32_t>(viewers.size()), std::memory_order_relaxed);
+        }
+    }
+    if (it != connections_.end() && it->second->hlsWait.stream) {
+        std::vector<int>& waiters = it->second->hlsWait.stream->hlsWaiters;
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), fd), waiters.end());
+    }
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections_.erase(fd);
+}
+
+void WebServer::closeIdleConnections(Clock::time_point now) {
+    std::vector<int> idle;
+    for (const auto& entry : connections_) {
+        // Live viewers never send anything after their request; blocked HLS
+        // requests have their own deadline
+        if (!entry.second->live && !entry.second->hlsWait.stream && now - entry.second->lastActive > IDLE_TIMEOUT) {
+            idle.push_back(entry.first);
+        }
+    }
+    for (int fd : idle) {
+        closeConnection(fd);
+    }
+}
+
+void WebServer::refreshIndexPage() {
+    std::shared_ptr<const StreamRegistry::Snapshot> snapshot = registry_.snapshot();
+    if (indexPage_ && snapshot->version == indexVersion_) {
+        return;
+    }
+
+    // Cards are rendered once per registry entry; a rebuild mostly concatenates
+    std::map<std::string, StreamCard> cards;
+    size_t size = strlen(PAGE_HEAD) + strlen(PAGE_EMPTY) + strlen(PAGE_TAIL);
+    for (const auto& entry : snapshot->entries) {
+        StreamCard& card = cards[entry->info.streamId];
+        auto old = streamCards_.find(entry->info.streamId);
+        if (old != streamCards_.end() && old->second.entry == entry) {
+            card = std::move(old->second);
+        } else {
+            card.entry = entry;
+            card.html = renderStreamCard(entry->info);
+        }
+        size += card.html.size();
+    }
+    streamCards_ = std::move(cards);
+
+    auto page = std::make_shared<IndexPage>();
+    page->html.reserve(size);
+    page->html += PAGE_HEAD;
+    if (streamCards_.empty()) {
+        page->html += PAGE_EMPTY;
     } else {
-        for (const auto& pair : activeStreams_) {
-            const StreamInfo& info = pair.second;
-            ss << "<div class=\"stream-card\">\n";
-            ss << "  <h3>Device ID: " << info.deviceId << " (Stream ID: " << info.streamId << ")</h3>\n";
-            ss << "  <video id=\"video-" << info.streamId << "\" class=\"video-js vjs-default-skin\" controls preload=\"auto\" width=\"640\" height=\"264\" data-setup=\"{}\">\n";
-            ss << "    <source src=\"http://localhost:8080/live/" << info.streamId << ".m3u8\" type=\"application/x-mpegURL\">\n";
-            ss << "    <p class=\"vjs-no-js\">\n";
-            ss << "      To view this video please enable JavaScript, and consider upgrading to a web browser that\n";
-            ss << "      <a href=\"https://videojs.com/html5-video-support/\" target=\"_blank\">supports HTML5 video</a>\n";
-            ss << "    </p>\n";
-            ss << "  </video>\n";
-            ss << "  <div class=\"stream-info\">\n";
-            ss << "    <p><strong>ZLMediaKit Push URL:</strong> " << info.rtmpUrl << "</p>\n";
-            ss << "    <p><strong>HLS Playback:</strong> <a href=\"http://localhost:8080/live/" << info.streamId << ".m3u8\" target=\"_blank\">http://localhost:8080/live/" << info.streamId << ".m3u8</a></p>\n";
-            ss << "    <p><strong>FLV Playback:</strong> <a href=\"http://localhost:8080/live/" << info.streamId << ".flv\" target=\"_blank\">http://localhost:8080/live/" << info.streamId << ".flv</a></p>\n";
-            ss << "    <p><strong>WebRTC Playback:</strong> <a href=\"http://localhost:8080/webrtc/" << info.streamId << "\" target=\"_blank\">http://localhost:8080/webrtc/" << info.streamId << "</a></p>\n";
-            ss << "  </div>\n";
-            ss << "</div>\n";
-        }
-    }
-
-    ss << "</div>\n";
-    ss << "<script src=\"https://vjs.zencdn.net/7.11.4/video.min.js\"></script>\n";
-    ss << "<script src=\"https://cdnjs.cloudflare.com/ajax/libs/videojs-contrib-hls/5.15.0/videojs-contrib-hls.min.js\"></script>\n";
-    ss << "<script>\n";
-    ss << "  document.addEventListener('DOMContentLoaded', function() {\n";
-    ss << "    var players = document.querySelectorAll('.video-js');\n";
-    ss << "    players.forEach(function(playerElement) {\n";
-    ss << "      var player = videojs(playerElement.id);\n";
-    ss << "      player.play();\n";
-    ss << "    });\n";
-    ss << "  });\n";
-    ss << "</script>\n";
-    ss << "</body>\n";
-    ss << "</html>\n";
-    return ss.str();
+        for (const auto& card : streamCards_) {
+            page->html += card.second.html;
+        }
+    }
+    page->html += PAGE_TAIL;
+    indexVersion_ = snapshot->version;
+    page->etag = "\"" + std::to_string(indexVersion_) + "\"";
+    indexPage_ = std::move(page);
+}
+
+std::string WebServer::renderStreamCard(const StreamInfo& info) {
+    std::string deviceId = escapeHtml(info.deviceId);
+    std::string streamId = escapeHtml(info.streamId);
+    std::string card;
+    card.reserve(1536);
+    card += "<div class=\"stream-card\">\n";
+    card += "  <h3>Device ID: " + deviceId + " (Stream ID: " + streamId + ")</h3>\n";
+    card += "  <video id=\"video-" + streamId + "\" class=\"video-js vjs-default-skin\" controls preload=\"auto\" width=\"640\" height=\"264\" data-setup=\"{}\">\n";
+    card += "    <source src=\"/live/" + streamId + ".m3u8\" type=\"application/x-mpegURL\">\n";
+    card += "    <p class=\"vjs-no-js\">\n";
+    card += "      To view this video please enable JavaScript, and consider upgrading to a web browser that\n";
+    card += "      <a href=\"https://videojs.com/html5-video-support/\" target=\"_blank\">supports HTML5 video</a>\n";
+    card += "    </p>\n";
+    card += "  </video>\n";
+    card += "  <div class=\"stream-info\">\n";
+    card += "    <p><strong>ZLMediaKit Push URL:</strong> " + escapeHtml(info.rtmpUrl) + "</p>\n";
+    card += "    <p><strong>HLS Playback:</strong> <a href=\"/live/" + streamId + ".m3u8\" target=\"_blank\">/live/" + streamId + ".m3u8</a></p>\n";
+    card += "    <p><strong>FLV Playback:</strong> <a href=\"/live/" + streamId + ".flv\" target=\"_blank\">/live/" + streamId + ".flv</a></p>\n";
+    card += "    <p><strong>fMP4 Playback:</strong> <a href=\"/live/" + streamId + ".mp4\" target=\"_blank\">/live/" + streamId + ".mp4</a></p>\n";
+    card += "    <p><strong>WebRTC Playback:</strong> <a href=\"http://localhost:8080/webrtc/" + streamId + "\" target=\"_blank\">http://localhost:8080/webrtc/" + streamId + "</a></p>\n";
+    card += "  </div>\n";
+    card += "</div>\n";
+    return card;
 }
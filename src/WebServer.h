@@ -3,44 +3,148 @@
 
 #include <string>
 #include <thread>
-#include <iostream>
 #include <chrono>
 #include <vector>
+#include <deque>
 #include <map>
+#include <unordered_map>
+#include <memory>
 #include <mutex>
+#include <atomic>
+#include "LiveStream.h"
+#include "StreamRegistry.h"
 
-// For a real web server, you would integrate a library like Crow, Civetweb, or Boost.Beast
-// This is a placeholder for demonstration purposes.
-
-struct StreamInfo {
-    std::string deviceId;
-    std::string streamId;
-    std::string rtmpUrl;
-    std::string flvUrl;
-    std::string hlsUrl;
-    std::string webrtcUrl;
-};
-
+// Minimal HTTP/1.1 server: one epoll thread, non-blocking sockets, keep-alive
+// and pipelining. The index page lists the StreamRegistry and is re-rendered
+// only when the registry's snapshot version moves; serving it never copies the
+// body: responses are gathered with writev straight from the shared buffer.
+// /api/streams returns the registry as JSON, /metrics the process Metrics in
+// the Prometheus text format.
+//
+// Streams added with a sourcePath are also served live as HTTP-FLV and fMP4
+// (/live/<streamId>.flv, .mp4) and as LL-HLS (/live/<streamId>.m3u8). The same
+// thread paces each LiveStream, fans its shared chunks out to the viewers and
+// answers blocking playlist reloads once the awaited part exists.
 class WebServer {
 public:
-    WebServer(int port);
+    WebServer(int port, StreamRegistry& registry);
     ~WebServer();
 
     void start();
     void stop();
+    // Publishes a stream served from a local file (info.sourcePath) over HTTP
     void addStream(const StreamInfo& info);
     void removeStream(const std::string& streamId);
 
 private:
+    using Clock = std::chrono::steady_clock;
+
+    // Rendered index page; replaced as a whole, never modified
+    struct IndexPage {
+        std::string html;
+        std::string etag;
+    };
+
+    // Card HTML, reused while the registry keeps the same entry
+    struct StreamCard {
+        std::shared_ptr<const StreamRegistry::Entry> entry;
+        std::string html;
+    };
+
+    struct HttpRequest {
+        std::string method;
+        std::string path;
+        std::string query; // Without the '?'
+        std::string ifNoneMatch;
+        bool keepAlive = true;
+    };
+
+    enum class HlsResource {
+        Playlist,
+        Init,
+        Segment,
+        Part
+    };
+
+    // An HLS request; kept on the connection while it blocks
+    struct HlsRequest {
+        std::shared_ptr<LiveStream> stream; // Null when not waiting
+        HlsResource resource = HlsResource::Playlist;
+        int64_t msn = -1;  // Media sequence number; -1 for a plain playlist reload
+        int64_t part = -1; // Part index; -1 for a whole segment
+        bool head = false;
+        bool keepAlive = true;
+        Clock::time_point deadline;
+    };
+
+    struct Connection {
+        int fd = -1;
+        std::string input;
+        std::deque<std::shared_ptr<const std::string>> output; // Buffers still to send, front first
+        size_t outputOffset = 0; // Bytes of output.front() already sent
+        bool writeWatched = false; // EPOLLOUT registered
+        size_t outputBytes = 0;    // Unsent bytes in output
+        bool closeAfterWrite = false;
+        Clock::time_point lastActive;
+
+        // Live viewers only
+        std::shared_ptr<LiveStream> live;
+        LiveFormat liveFormat = LiveFormat::Flv;
+        bool skipToKeyframe = false; // Fell behind; resume at the next keyframe
+
+        HlsRequest hlsWait; // Blocked HLS request; later pipelined requests wait behind it
+    };
+
+    using LiveStreamMap = std::map<std::string, std::shared_ptr<LiveStream>>;
+
     void serverLoop();
-    std::string buildIndexPage();
+    bool openListener();
+    void acceptConnections();
+    void handleReadable(Connection& connection);
+    void processInput(Connection& connection, bool peerClosed);
+    bool parseRequest(Connection& connection, HttpRequest& request, bool& malformed);
+    void handleRequest(Connection& connection, const HttpRequest& request);
+    bool handleLiveRequest(Connection& connection, const HttpRequest& request);
+    bool handleHlsRequest(Connection& connection, const HttpRequest& request, const std::string& streamId,
+                          const std::string& file);
+    bool answerHls(Connection& connection, const HlsRequest& request);
+    void resolveHlsWaiters(LiveStream& stream, Clock::time_point now);
+    void pumpLiveStreams(Clock::time_point now);
+    void queueBuffer(Connection& connection, std::shared_ptr<const std::string> buffer);
+    void queueResponse(Connection& connection, int status, const char* contentType,
+                       std::shared_ptr<const std::string> body, const std::string& extraHeaders,
+                       bool keepAlive, bool headOnly = false);
+    void queueResponse(Connection& connection, int status, const char* contentType,
+                       const std::vector<std::shared_ptr<const std::string>>& body, const std::string& extraHeaders,
+                       bool keepAlive, bool headOnly = false);
+    void queueHeaders(Connection& connection, int status, const char* contentType, size_t contentLength,
+                      const std::string& extraHeaders, bool keepAlive);
+    bool flushOutput(Connection& connection);
+    void closeConnection(int fd);
+    void closeIdleConnections(Clock::time_point now);
+
+    void refreshIndexPage(); // Server thread
+    static std::string renderStreamCard(const StreamInfo& info);
 
     int port_;
-    bool running_;
+    std::atomic<bool> running_;
     std::thread serverThread_;
 
-    std::map<std::string, StreamInfo> activeStreams_; // Map streamId to StreamInfo
-    std::mutex streamsMutex_; // Mutex for protecting activeStreams_
+    int listenFd_;
+    int epollFd_;
+    int wakeFd_; // eventfd that interrupts epoll_wait on stop()
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_; // Server thread only
+
+    StreamRegistry& registry_;
+
+    // Server thread only
+    std::map<std::string, StreamCard> streamCards_;
+    uint64_t indexVersion_; // Registry version the page was rendered from; used as the ETag
+    std::shared_ptr<const IndexPage> indexPage_;
+
+    std::mutex streamsMutex_; // Serialises addStream/removeStream
+    std::shared_ptr<const LiveStreamMap> liveStreams_; // Read and replaced with std::atomic_load/store
+    std::vector<std::shared_ptr<LiveStream>> watchedStreams_; // Streams with viewers or HLS waiters; server thread only
 };
 
 #endif // WEB_SERVER_H
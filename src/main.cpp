@@ -1,23 +1,122 @@
 #include <iostream>
+#include <csignal>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "Config.h"
 #include "Gb28181Client.h"
+#include "LatencyStats.h"
+#include "Log.h"
+#include "StreamRegistry.h"
 #include "WebServer.h"
 
-int main() {
+int main(int argc, char* argv[]) {
     std::cout << "Device Access Module Starting..." << std::endl;
 
+    // Optional config file; without one a single device with built-in defaults is simulated
+    AppConfig config;
+    std::string configPath = argc > 1 ? argv[1] : "";
+    if (!configPath.empty()) {
+        std::string error;
+        if (!loadConfig(configPath, config, error)) {
+            std::cerr << "Failed to load configuration: " << error << std::endl;
+            return 1;
+        }
+    }
+    Log::setLevel(static_cast<Log::Level>(config.logLevel));
+
+    // Every RealPlay session holds two UDP sockets; lift the soft descriptor
+    // limit to the hard one so thousands of sessions fit
+    rlimit files{};
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    // Signals are handled synchronously by the main thread below. Block them
+    // before any other thread exists so every thread inherits the mask.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    // Streams from both sides: RealPlay sessions and local previews
+    StreamRegistry registry;
+
     // Initialize GB28181 Client
-    Gb28181Client gbClient("192.168.1.100", 5060, "34020000001320000001", "3402000000", "admin123");
+    Gb28181Client gbClient(config, registry);
     gbClient.start();
 
     // Initialize Web Server for video streaming
-    WebServer webServer(8080);
+    WebServer webServer(config.httpPort, registry);
     webServer.start();
 
+    // One live preview per device template, fed from the template's media
+    std::vector<DeviceTemplate> templates = config.devices;
+    if (templates.empty()) {
+        templates.emplace_back();
+    }
+    for (const DeviceTemplate& deviceTemplate : templates) {
+        StreamInfo info;
+        info.deviceId = generateDeviceId(deviceTemplate, 0);
+        info.streamId = info.deviceId;
+        info.flvUrl = "/live/" + info.streamId + ".flv";
+        info.sourcePath = deviceTemplate.mediaSource.empty() ? config.mediaSource : deviceTemplate.mediaSource;
+        webServer.addStream(info);
+    }
+
     std::cout << "Device Access Module Running." << std::endl;
 
-    // Keep the main thread alive
+    // SIGUSR1 dumps the latency histograms and port usage, SIGHUP reloads the
+    // configuration file; SIGINT/SIGTERM shut down
     while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        int signal = 0;
+        if (sigwait(&signals, &signal) != 0) {
+            continue;
+        }
+        if (signal == SIGUSR1) {
+            LatencyStats::instance().dump(std::cout);
+            const PortAllocator& ports = gbClient.rtpPorts();
+            std::cout << "RTP ports: " << ports.inUse() << " of " << ports.capacity() << " pairs in use, "
+                      << ports.bindFailures() << " bind failures" << std::endl;
+            continue;
+        }
+        if (signal == SIGHUP) {
+            if (configPath.empty()) {
+                std::cerr << "No configuration file to reload." << std::endl;
+                continue;
+            }
+            // A file that doesn't parse changes nothing
+            AppConfig next;
+            std::string error;
+            if (!loadConfig(configPath, next, error)) {
+                std::cerr << "Configuration not reloaded: " << error << std::endl;
+                continue;
+            }
+            if (next.httpPort != config.httpPort) {
+                std::cerr << "[local] http_port changed, restart to apply" << std::endl;
+                next.httpPort = config.httpPort;
+            }
+            Log::setLevel(static_cast<Log::Level>(next.logLevel));
+            gbClient.reload(next);
+            config = next; // latency_file is read at shutdown
+            continue;
+        }
+        std::cout << "Device Access Module Stopping..." << std::endl;
+        break;
+    }
+
+    webServer.stop();
+    gbClient.stop();
+
+    if (!config.latencyFile.empty()) {
+        if (LatencyStats::instance().writeFile(config.latencyFile)) {
+            std::cout << "Latency histograms written to " << config.latencyFile << std::endl;
+        } else {
+            std::cerr << "Failed to write latency histograms to " << config.latencyFile << std::endl;
+        }
     }
 
     return 0;